@@ -0,0 +1,2 @@
+#define DEBUG_SELECTION_ID 1
+#include "sprite_instanced.hlsl"
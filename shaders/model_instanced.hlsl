@@ -0,0 +1,63 @@
+#include "common.hlsli"
+
+// Point entity models, one instance per entity.
+// Instance data matches PointInstance in MapRender.h.
+
+struct Input
+{
+    float3 position : POSITION;
+    float3 normal   : NORMAL0;
+    float3 uv       : TEXCOORD0;
+    uint   face     : BLENDINDICES0;
+
+    float3 origin   : INSTANCE0;
+    float  size     : INSTANCE1;
+    float4 color    : INSTANCE2;
+    uint   id       : INSTANCE3;
+};
+
+struct Varyings
+{
+    float4 position : SV_POSITION;
+    float3 normal   : NORMAL0;
+    float3 uv       : TEXCOORD0;
+    float3 view     : TEXCOORD1;
+    float4 color    : COLOR0;
+    uint   id       : BLENDINDICES0;
+};
+
+struct Output
+{
+    float4 color : SV_TARGET0;
+    uint   id    : SV_TARGET1;
+};
+
+Texture2D    s_texture  : register(t0);
+SamplerState s_sampler  : register(s0);
+
+Varyings vs_main(Input i)
+{
+    Varyings v = (Varyings)0;
+
+    float4 pos = float4(i.position + i.origin, 1.0);
+    v.position = mul(Camera.viewProj, pos);
+    v.normal   = i.normal;
+    v.view     = mul(Camera.view, pos).xyz;
+    v.uv       = i.uv;
+    v.color    = i.color;
+    v.id       = i.id == 0 ? i.face : i.id;
+
+    return v;
+}
+
+Output ps_main(Varyings v)
+{
+    Output o = (Output)0;
+
+    float4 baseColor  = s_texture.Sample(s_sampler, v.uv.xy);
+
+    o.color.rgb = Lighting(v.normal, v.view) * baseColor.rgb * v.color.rgb;
+    o.color.a   = baseColor.a * v.color.a;
+    o.id        = v.id;
+    return o;
+}
@@ -0,0 +1,71 @@
+#include "common.hlsli"
+
+// Camera facing sprites, one instance per point entity.
+// Instance data matches PointInstance in MapRender.h.
+
+struct Input
+{
+    float3 position : POSITION;
+    float2 uv       : TEXCOORD0;
+
+    float3 origin   : INSTANCE0;
+    float  size     : INSTANCE1;
+    float4 color    : INSTANCE2;
+    uint   id       : INSTANCE3;
+};
+
+struct Varyings
+{
+    float4 position : SV_POSITION;
+    float2 uv       : TEXCOORD0;
+    float4 color    : COLOR0;
+    uint   id       : BLENDINDICES0;
+};
+
+struct Output
+{
+    float4 color : SV_TARGET0;
+    uint   id    : SV_TARGET1;
+};
+
+Texture2D    s_texture : register(t0);
+SamplerState s_sampler : register(s0);
+
+Varyings vs_main(Input i)
+{
+    float3x3 invViewAxes = transpose((float3x3)Camera.view);
+
+    Varyings v = (Varyings)0;
+
+    float3 camRight = float3(invViewAxes[0][0], invViewAxes[1][0], invViewAxes[2][0]);
+    float3 camUp    = float3(invViewAxes[0][1], invViewAxes[1][1], invViewAxes[2][1]);
+    float3 pos      = i.origin + ((camRight * i.position.x) + (camUp * i.position.y)) * i.size;
+
+    v.position = mul(Camera.viewProj, float4(pos, 1));
+    v.uv       = i.uv;
+    v.color    = i.color;
+    v.id       = i.id;
+
+    return v;
+}
+
+Output ps_main(Varyings v)
+{
+    Output o = (Output)0;
+
+    float4 color = s_texture.Sample(s_sampler, v.uv);
+
+    // Basic alpha test
+    if (color.a < 0.05)
+        discard;
+
+    o.color = color * v.color;
+    o.id = v.id;
+
+#if DEBUG_SELECTION_ID
+    o.color.rgb = DebugSelectionID(v.id);
+    o.color.a = 1;
+#endif
+    
+    return o;
+}
@@ -2,6 +2,7 @@
 
 #include "common/Common.h"
 #include "common/Path.h"
+#include "common/PathKey.h"
 #include "common/Rc.h"
 #include <unordered_map>
 #include <memory>
@@ -13,9 +14,16 @@ namespace chisel
     using AssetID = uint;
     static constexpr AssetID InvalidAssetID = 0;
 
+    enum class AssetState : uint8
+    {
+        Loaded,
+        Loading,    // Queued with Assets.LoadAsync, still empty
+        Failed,     // Background load failed, the asset stays empty
+    };
+
     struct Asset : public RcObject
     {
-        using AssetTable = std::unordered_map<fs::Path, Asset*>;
+        using AssetTable = std::unordered_map<PathKey, Asset*>;
 
         AssetID id = ++s_NextID;
 
@@ -23,32 +31,50 @@ namespace chisel
         {
             if (!path.empty())
             {
-                auto res = AssetDB.insert(std::make_pair<fs::Path, Asset*>(fs::Path(path), this));
+                m_path = path;
+                m_key  = PathKey(path);
+                auto res = AssetDB.insert({ m_key, this });
                 assert(res.second);
-                m_path = &res.first->first;
             }
         }
 
         virtual ~Asset()
         {
-            if (m_path)
-                AssetDB.erase(*m_path);
+            if (m_key)
+                AssetDB.erase(m_key);
+            s_MemoryUsage -= m_memoryUsage;
         }
 
+        // The path as the asset was requested
         const fs::Path& GetPath() const
         {
-            return *m_path;
+            return m_path;
         }
 
+        // Case-folded path the asset is cached under
+        const PathKey& GetKey() const
+        {
+            return m_key;
+        }
+
+        AssetState GetState() const { return m_state; }
+        bool IsLoading() const { return m_state == AssetState::Loading; }
+
+        // Bytes of memory this asset holds on to, CPU or GPU.
+        // Referenced assets are not included, a material doesn't count its textures.
+        virtual size_t GetMemoryUsage() const { return 0; }
+
     private:
-        const fs::Path* m_path = nullptr;
+        fs::Path m_path;
+        PathKey m_key;
+        AssetState m_state = AssetState::Loaded;
+        size_t m_memoryUsage = 0;   // As accounted when loading finished
 
         friend struct Assets;
 
         static inline AssetTable AssetDB;
         static inline AssetID s_NextID = 0;
-
-        static inline const fs::Path nullPath = fs::Path();
+        static inline size_t s_MemoryUsage = 0;
     };
 }
 
@@ -5,71 +5,117 @@
 #include "console/Console.h"
 #include "common/Hash.h"
 #include "common/Path.h"
+#include "common/PathKey.h"
+#include <functional>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 #include <span>
 
 namespace chisel
 {
+    /**
+     * Read-only view of a file's contents. 'owner' keeps the memory alive:
+     * either the mapped pak archive the view points into, or a buffer the
+     * file was read into.
+     */
+    struct FileView
+    {
+        std::span<const byte> data;
+        std::shared_ptr<const void> owner;
+
+        static FileView FromBuffer(Buffer buffer)
+        {
+            auto owned = std::make_shared<Buffer>(std::move(buffer));
+            return FileView { std::span<const byte>(owned->data(), owned->size()), owned };
+        }
+    };
+
     struct BaseAssetLoader
     {
         static std::optional<Buffer> ReadFile(const fs::Path& path, bool complain = true);
+        static std::optional<FileView> MapFile(const fs::Path& path, bool complain = true);
     };
 
     template <class Asset>
     struct AssetLoader : BaseAssetLoader
     {
-        using AssetLoadFn = void(Asset&, const Buffer&);
+        using AssetLoadFn = void(Asset&, std::span<const byte>);
+
+        // Loaders that can run in the background come in two halves. Decoding
+        // runs on a worker and must not touch the GPU or any other asset; it
+        // returns the half that finishes the asset on the main thread.
+        using AssetFinishFn = std::function<void(Asset&)>;
+        using AssetDecodeFn = AssetFinishFn(std::span<const byte>);
 
         AssetLoader(const char* ext, AssetLoadFn* fn) : function(fn)
         {
-            if (!ext)
-                return;
+            Register(ext);
+        }
 
-            if (ext[0] != '.')
-            {
-                std::string dotext = std::string(".") + ext;
-                AssetLoader<Asset>::Extensions().insert({ HashStringLower(dotext), this });
-            }
-            else
-            {
-                AssetLoader<Asset>::Extensions().insert({ HashStringLower(ext), this });
-            }
+        AssetLoader(const char* ext, AssetDecodeFn* fn) : decodeFunction(fn)
+        {
+            Register(ext);
         }
 
         virtual bool Load(Asset& asset, const fs::Path& path)
         {
-            if (!function)
+            if (!function && !decodeFunction)
                 return false;
             
-            auto data = BaseAssetLoader::ReadFile(path);
-            if (!data)
+            // Loaders parse straight out of the pak mapping where they can.
+            auto file = BaseAssetLoader::MapFile(path);
+            if (!file)
                 return false;
             
-            function(asset, *data);
+            if (decodeFunction)
+                decodeFunction(file->data)(asset);
+            else
+                function(asset, file->data);
             return true;
         }
 
+        bool CanDecodeAsync() const { return decodeFunction != nullptr; }
+
+        // Worker thread half of an async load.
+        AssetFinishFn Decode(std::span<const byte> data) const
+        {
+            return decodeFunction(data);
+        }
+
     protected:
         AssetLoader() {}
 
         AssetLoadFn* function = nullptr;
+        AssetDecodeFn* decodeFunction = nullptr;
+
+        void Register(const char* ext)
+        {
+            if (!ext)
+                return;
+
+            if (ext[0] != '.')
+                AssetLoader<Asset>::Extensions().insert({ PathKey(std::string(".") + ext), this });
+            else
+                AssetLoader<Asset>::Extensions().insert({ PathKey(ext), this });
+        }
 
     public:
         static AssetLoader* ForExtension(std::string_view ext)
         {
-            if (!ext.size())
+            PathKey key = PathKey::Find(ext);
+            if (!key)
                 return nullptr;
-            auto hash = HashStringLower(ext);
-            return AssetLoader::Extensions().contains(hash)
-                 ? AssetLoader::Extensions()[hash]
-                 : nullptr;
+
+            auto it = AssetLoader::Extensions().find(key);
+            return it != AssetLoader::Extensions().end() ? it->second : nullptr;
         }
 
     protected:
         friend struct Assets;
-        static inline std::unordered_map<Hash, AssetLoader<Asset>*>& Extensions()
+        static inline std::unordered_map<PathKey, AssetLoader<Asset>*>& Extensions()
         {
-            static std::unordered_map<Hash, AssetLoader<Asset>*> map;
+            static std::unordered_map<PathKey, AssetLoader<Asset>*> map;
             return map;
         }
     };
@@ -85,20 +131,7 @@ namespace chisel
                 return;
 
             for (auto ext : extensions)
-            {
-                if (!ext)
-                    continue;
-
-                if (ext[0] != '.')
-                {
-                    std::string dotext = std::string(".") + ext;
-                    AssetLoader<Asset>::Extensions().insert({ HashStringLower(dotext), this });
-                }
-                else
-                {
-                    AssetLoader<Asset>::Extensions().insert({ HashStringLower(ext), this });
-                }
-            }
+                this->Register(ext);
         }
 
         virtual bool Load(Asset& asset, const fs::Path& path) override
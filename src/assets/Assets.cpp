@@ -1,6 +1,15 @@
 #include "Assets.h"
 #include "assets/SearchPaths.h"
+#include "common/Jobs.h"
+#include "common/Time.h"
+#include "console/ConVar.h"
+#include "console/ConCommand.h"
 
+#include <filesystem>
+#include <algorithm>
+#include <charconv>
+#include <map>
+#include <typeinfo>
 #include <variant>
 #include <vector>
 
@@ -17,60 +26,95 @@ namespace chisel
 
     Assets::~Assets()
     {
+        // Workers are stopped by now, drop whatever they left behind.
+        completed.clear();
+        loading.clear();
+        retainedIndex.clear();
+        retained.clear();
+
         // Delete all remaining assets on the heap
         while (Asset::AssetDB.size() > 0)
         {
-            auto& [path, asset] = *Asset::AssetDB.begin();
+            Asset* asset = Asset::AssetDB.begin()->second;
             uint32 refCount = (asset->incRef(), asset->decRef());
-            Console.Warn("Deleted unreleased asset: (references = {}) '{}'", refCount, path);
+            Console.Warn("Deleted unreleased asset: (references = {}) '{}'", refCount, asset->GetPath());
             delete asset;
         }
     }
 
 // Asset Loading //
 
-    static inline std::string NormalizePath(const fs::Path& path)
+    bool Assets::IsLoaded(const Path& path)
     {
-        std::string str = str::toLower(path);
-        str = str::replace(str, "\\", "/");
-        return str;
+        return FindAsset(PathKey::Find(path)) != nullptr;
     }
 
-    bool Assets::IsLoaded(const Path& path)
+    bool Assets::IsLoaded(const PathKey& key)
     {
-        return Asset::AssetDB.contains(path);
+        return FindAsset(key) != nullptr;
     }
 
-    bool Assets::FileExists(const Path& path)
+    Asset* Assets::FindAsset(const PathKey& key)
     {
-        // Check loose files
-        for (const auto& dir : searchPaths)
-        {
-            Path fullPath = dir / path;
-            if (fs::exists(fullPath))
-                return true;
-        }
+        if (!key)
+            return nullptr;
 
-        // Check paks
-        std::string cleanPath = NormalizePath(path);
-        for (const auto& pak : pakFiles)
-        {
-            if (pak->files().contains(cleanPath))
-                return true;
-        }
+        auto it = Asset::AssetDB.find(key);
+        return it != Asset::AssetDB.end() ? it->second : nullptr;
+    }
 
-        return false;
+    static bool IsAbsolute(const fs::Path& path)
+    {
+        return static_cast<const std::filesystem::path&>(path).is_absolute();
+    }
+
+    uint64 Assets::FileStamp(const Path& path)
+    {
+        const FileEntry* entry = FindFile(path);
+        if (entry && entry->pak)
+            return (uint64(entry->pak->Size(*entry->pakEntry)) << 32) | entry->pakEntry->crc;
+
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(entry ? *entry->searchPath / entry->path : path, ec);
+        if (ec)
+            return 0;
+        return uint64(time.time_since_epoch().count());
+    }
+
+    bool Assets::FileExists(const Path& path)
+    {
+        if (FindFile(path))
+            return true;
+
+        // Absolute paths live outside the search paths
+        return IsAbsolute(path) && fs::exists(path);
     }
 
     std::optional<Buffer> Assets::ReadFile(const Path& path, bool complain)
     {
-        auto loose_data = ReadLooseFile(path);
-        if (loose_data)
-            return loose_data;
+        if (const FileEntry* entry = FindFile(path))
+            return ReadFile(*entry);
 
-        auto vpk_data = ReadPakFile(path);
-        if (vpk_data)
-            return vpk_data;
+        if (IsAbsolute(path) && fs::exists(path))
+            return fs::readFile(path);
+
+        if (complain)
+            Console.Error("[Assets] Can't find file: '{}'", path);
+        return std::nullopt;
+    }
+
+    std::optional<FileView> Assets::MapFile(const Path& path, bool complain)
+    {
+        if (const FileEntry* entry = FindFile(path))
+        {
+            if (auto view = MapFile(*entry))
+                return view;
+        }
+        else if (IsAbsolute(path) && fs::exists(path))
+        {
+            if (auto data = fs::readFile(path))
+                return FileView::FromBuffer(std::move(*data));
+        }
 
         if (complain)
             Console.Error("[Assets] Can't find file: '{}'", path);
@@ -82,36 +126,348 @@ namespace chisel
         return Assets.ReadFile(path, complain);
     }
 
+    std::optional<FileView> BaseAssetLoader::MapFile(const fs::Path& path, bool complain)
+    {
+        return Assets.MapFile(path, complain);
+    }
+
     std::optional<Buffer> Assets::ReadLooseFile(const Path& path)
     {
-        for (const auto& dir : searchPaths)
+        const FileEntry* entry = FindFile(path);
+        if (!entry || !entry->searchPath)
+            return std::nullopt;
+        return ReadFile(*entry);
+    }
+
+    std::optional<Buffer> Assets::ReadPakFile(const Path& path)
+    {
+        const FileEntry* entry = FindFile(path);
+        if (!entry || !entry->pak)
+            return std::nullopt;
+        return ReadFile(*entry);
+    }
+
+    std::optional<Buffer> Assets::ReadFile(const FileEntry& entry)
+    {
+        if (entry.searchPath)
+            return fs::readFile(*entry.searchPath / entry.path);
+
+        auto view = entry.pak->View(*entry.pakEntry);
+        if (!view)
+            return std::nullopt;
+
+        return Buffer(view->data.begin(), view->data.end());
+    }
+
+    std::optional<FileView> Assets::MapFile(const FileEntry& entry)
+    {
+        if (entry.pak)
+            return entry.pak->View(*entry.pakEntry);
+
+        auto data = fs::readFile(*entry.searchPath / entry.path);
+        if (!data)
+            return std::nullopt;
+
+        return FileView::FromBuffer(std::move(*data));
+    }
+
+// Background Loading //
+
+    static ConVar<float> asset_load_budget("asset_load_budget", 4.0f, "Milliseconds per frame spent finishing background asset loads.");
+
+    std::optional<Assets::FileSource> Assets::LocateFile(const Path& path)
+    {
+        if (const FileEntry* entry = FindFile(path))
         {
-            Path fullPath = dir / path;
-            if (fs::exists(fullPath))
-                return fs::readFile(fullPath);
+            if (!entry->pak)
+                return FileSource { std::nullopt, *entry->searchPath / entry->path };
+
+            auto view = entry->pak->View(*entry->pakEntry);
+            if (!view)
+                return std::nullopt;
+            return FileSource { std::move(view), Path() };
         }
+
+        if (IsAbsolute(path) && fs::exists(path))
+            return FileSource { std::nullopt, path };
+
         return std::nullopt;
     }
 
-    std::optional<Buffer> Assets::ReadPakFile(const Path& path)
+    bool Assets::ReadAsync(const Path& path, DecodeJob decode, std::function<void()> failed)
     {
-        std::string cleanPath = NormalizePath(path);
+        auto source = LocateFile(path);
+        if (!source)
+            return false;
 
-        for (const auto& pak : pakFiles)
+        QueueLoad(nullptr, path, std::move(*source), std::move(decode), std::move(failed));
+        return true;
+    }
+
+    void Assets::QueueLoad(Asset* asset, const Path& path, FileSource source, DecodeJob decode, std::function<void()> failed)
+    {
+        if (asset)
+        {
+            asset->m_state = AssetState::Loading;
+            loading.emplace(asset, Rc<Asset>(asset));
+        }
+
+        Jobs.Submit([this, asset, path, source = std::move(source), decode = std::move(decode), failed = std::move(failed)]() mutable
+        {
+            CompletedLoad result = { .asset = asset, .path = path, .failed = std::move(failed) };
+            try
+            {
+                if (!source.view)
+                {
+                    if (auto data = fs::readFile(source.loosePath))
+                        source.view = FileView::FromBuffer(std::move(*data));
+                }
+
+                if (source.view)
+                    result.finish = decode(source.view->data);
+                else
+                    result.error = "Can't read file";
+            }
+            catch (std::exception& err)
+            {
+                result.error = err.what();
+            }
+            result.file = std::move(source.view);
+
+            std::lock_guard lock(completedMutex);
+            completed.push_back(std::move(result));
+        });
+    }
+
+    void Assets::FinishLoads(double budget)
+    {
+        Time::Seconds start = Time::GetTime();
+        std::vector<Asset*> finished;
+
+        // Always finish at least one, so a slow upload can't stall loading entirely.
+        do
+        {
+            CompletedLoad load;
+            {
+                std::lock_guard lock(completedMutex);
+                if (completed.empty())
+                    break;
+                load = std::move(completed.front());
+                completed.pop_front();
+            }
+            finishedLoads++;
+
+            // Load got to it first, only the reference is left to drop
+            if (load.asset && !load.asset->IsLoading())
+            {
+                loading.erase(load.asset);
+                continue;
+            }
+
+            if (load.finish)
+            {
+                try
+                {
+                    load.finish();
+                }
+                catch (std::exception& err)
+                {
+                    load.error = err.what();
+                }
+            }
+
+            Asset* asset = load.asset;
+            if (!asset)
+            {
+                if (!load.error.empty())
+                {
+                    Console.Error("[Assets] Failed to read '{}': {}", load.path, load.error);
+                    if (load.failed)
+                        load.failed();
+                }
+                continue;
+            }
+
+            if (load.error.empty())
+            {
+                asset->m_state = AssetState::Loaded;
+                Account(asset);
+            }
+            else
+            {
+                asset->m_state = AssetState::Failed;
+                Console.Error("[Assets] Failed to import {} asset: {}", asset->GetPath().ext(), asset->GetPath());
+                Console.Error("[Assets] Exception: '{}'", load.error);
+            }
+            finished.push_back(asset);
+        }
+        while (Time::GetTime() - start < budget);
+
+        if (finished.empty())
+            return;
+
+        OnLoaded(finished);
+
+        // Listeners may still look at the assets, release them last.
+        for (Asset* asset : finished)
+            loading.erase(asset);
+    }
+
+    void Assets::Update()
+    {
+        FinishLoads(asset_load_budget.value / 1000.0);
+        EvictToBudget();
+    }
+
+// Memory Budget //
+
+    static ConVar<int> asset_memory_budget("asset_memory_budget", 1024, "Megabytes of asset memory before retained, unused assets are released.");
+
+    static uint32 RefCount(Asset* asset)
+    {
+        return (asset->incRef(), asset->decRef());
+    }
+
+    void Assets::Account(Asset* asset)
+    {
+        Asset::s_MemoryUsage -= asset->m_memoryUsage;
+        asset->m_memoryUsage = asset->GetMemoryUsage();
+        Asset::s_MemoryUsage += asset->m_memoryUsage;
+
+        if (asset->m_memoryUsage)
+            Retain(asset);
+    }
+
+    void Assets::Retain(Asset* asset)
+    {
+        if (!asset)
+            return;
+
+        if (auto it = retainedIndex.find(asset); it != retainedIndex.end())
+        {
+            retained.splice(retained.begin(), retained, it->second);
+            return;
+        }
+
+        retained.emplace_front(asset);
+        retainedIndex.emplace(asset, retained.begin());
+    }
+
+    void Assets::EvictToBudget()
+    {
+        const size_t budget = size_t(std::max(asset_memory_budget.value, 0)) * 1024 * 1024;
+
+        auto it = retained.end();
+        while (Asset::s_MemoryUsage > budget && it != retained.begin())
         {
-            auto file = pak->file(cleanPath);
-            if (!file)
+            --it;
+
+            // Only the list holds it, and it isn't being filled in by a loader thread.
+            Asset* asset = it->ptr();
+            if (RefCount(asset) > 1 || asset->IsLoading())
                 continue;
 
-            auto stream = libvpk::VPKFileStream(*file);
+            retainedIndex.erase(asset);
+            it = retained.erase(it);
+        }
+    }
+
+    static std::string_view TypeName(const Asset& asset)
+    {
+        std::string_view name = typeid(asset).name();
+        for (std::string_view prefix : { "struct ", "class ", "chisel::" })
+        {
+            if (name.starts_with(prefix))
+                name.remove_prefix(prefix.size());
+        }
+        return name;
+    }
+
+    void Assets::PrintMemoryUsage(size_t count)
+    {
+        static constexpr double MB = 1024.0 * 1024.0;
 
-            Buffer data;
-            data.resize(file->length());
-            stream.read((char*)data.data(), file->length());
+        struct TypeUsage
+        {
+            size_t bytes = 0;
+            size_t count = 0;
+        };
+        std::map<std::string_view, TypeUsage> types;
+        std::vector<Asset*> assets;
+        assets.reserve(Asset::AssetDB.size());
 
-            return data;
+        for (const auto& [key, asset] : Asset::AssetDB)
+        {
+            TypeUsage& usage = types[TypeName(*asset)];
+            usage.bytes += asset->m_memoryUsage;
+            usage.count++;
+            assets.push_back(asset);
+        }
+
+        Console.Log("[Assets] {:.1f} / {} MB in {} assets, {} retained",
+            Asset::s_MemoryUsage / MB, asset_memory_budget.value, assets.size(), retained.size());
+
+        for (const auto& [name, usage] : types)
+            Console.Log("    {:<12} {:>9.1f} MB  {} assets", name, usage.bytes / MB, usage.count);
+
+        count = std::min(count, assets.size());
+        std::partial_sort(assets.begin(), assets.begin() + count, assets.end(), [](Asset* a, Asset* b) {
+            return a->m_memoryUsage > b->m_memoryUsage;
+        });
+
+        for (size_t i = 0; i < count; i++)
+        {
+            Asset* asset = assets[i];
+            bool unused = retainedIndex.contains(asset) && RefCount(asset) == 1;
+            Console.Log("    {:>9.2f} MB  {}{}", asset->m_memoryUsage / MB, asset->GetPath(), unused ? " (unused)" : "");
         }
-        return std::nullopt;
+    }
+
+// File Index //
+
+    const Assets::FileEntry* Assets::FindFile(std::string_view path)
+    {
+        if (fileIndexDirty)
+            Mount();
+
+        // Paths that were never interned can't be in the index.
+        PathKey key = PathKey::Find(path);
+        if (!key)
+            return nullptr;
+
+        auto it = fileIndex.find(key);
+        return it != fileIndex.end() ? &it->second : nullptr;
+    }
+
+    void Assets::Mount()
+    {
+        fileIndex.clear();
+        fileIndexDirty = false;
+
+        // try_emplace keeps the first entry for a path, so insert in lookup priority order.
+        for (const Path& dir : searchPaths)
+        {
+            const std::filesystem::path& root = dir;
+
+            std::error_code ec;
+            auto it = std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec);
+            for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (!it->is_regular_file(ec))
+                    continue;
+
+                std::string relative = it->path().lexically_relative(root).generic_string();
+                fileIndex.try_emplace(PathKey(relative), FileEntry { relative, &dir });
+            }
+        }
+
+        for (const auto& pak : pakFiles)
+        {
+            for (const auto& [name, entry] : pak->Files())
+                fileIndex.try_emplace(PathKey(name), FileEntry { name, nullptr, pak.get(), &entry });
+        }
+
+        if (!Quiet) Console.Log("[Assets] Indexed {} files", fileIndex.size());
     }
 
 // Search Paths //
@@ -137,26 +493,27 @@ namespace chisel
         }
 
         searchPaths.push_back(path);
+        fileIndexDirty = true;
         if (!Quiet) Console.Log("[Assets] Added search path: '{}'", p);
     }
 
     void Assets::AddPakFile(const Path& p)
     {
         Path path = SearchPaths.Resolve(p);
-        try
-        {
-            auto pak = std::make_unique<libvpk::VPKSet>(path);
-            pakFiles.emplace_back(std::move(pak));
-            if (!Quiet) Console.Log("[Assets] Loaded pak file: '{}'", p);
-        }
-        catch (const std::exception& e)
-        {
-            Console.Error("[Assets] Failed to load pak file '{}': {}", p, e.what());
-        }
+
+        auto pak = std::make_unique<PakFile>();
+        if (!pak->Open(path))
+            return Console.Error("[Assets] Failed to load pak file '{}'", p);
+
+        pakFiles.emplace_back(std::move(pak));
+        fileIndexDirty = true;
+        if (!Quiet) Console.Log("[Assets] Loaded pak file: '{}'", p);
     }
 
     void Assets::ResetSearchPaths()
     {
+        fileIndex.clear();
+        fileIndexDirty = true;
         searchPaths.clear();
         pakFiles.clear();
         AddSearchPath("core");
@@ -165,6 +522,19 @@ namespace chisel
     void Assets::Refresh()
     {
         Console.Log("[Assets] Refreshing...");
+        Mount();
         OnRefresh();
     }
 }
+
+namespace chisel::commands
+{
+    static ConCommand asset_memory("asset_memory", "List asset memory per type and the biggest assets. Usage: asset_memory [count]", [](ConCmd& cmd)
+    {
+        size_t count = 20;
+        if (cmd.argc >= 1)
+            std::from_chars(cmd.argv[0].data(), cmd.argv[0].data() + cmd.argv[0].size(), count);
+
+        Assets.PrintMemoryUsage(count);
+    });
+}
@@ -8,9 +8,12 @@
 #include "common/Span.h"
 #include "common/Filesystem.h"
 #include "common/Event.h"
-#include "../submodules/libvpk-plusplus/libvpk++.h"
+#include "assets/PakFile.h"
 
+#include <deque>
+#include <functional>
 #include <list>
+#include <mutex>
 #include <unordered_map>
 
 namespace chisel
@@ -27,26 +30,106 @@ namespace chisel
     // Asset Loading //
 
         bool IsLoaded(const Path& path);
+        bool IsLoaded(const PathKey& key);
 
+        // Loads on this thread, including an asset LoadAsync hasn't finished yet.
         template <typename T>
         Rc<T> Load(const Path& path);
+        // For callers that keep the key around. Cache hits never build a Path.
+        template <typename T>
+        Rc<T> Load(const PathKey& key);
 
         bool FileExists(const Path& path);
         std::optional<Buffer> ReadFile(const Path& path, bool complain = true);
+        // Like ReadFile, but files in paks are returned without a copy where possible.
+        std::optional<FileView> MapFile(const Path& path, bool complain = true);
         std::optional<Buffer> ReadLooseFile(const Path& path);
         std::optional<Buffer> ReadPakFile(const Path& path);
 
+        // Changes whenever the file's contents may have: the write time of loose
+        // files, the CRC and size of pak entries. Zero if there is no such file.
+        uint64 FileStamp(const Path& path);
+
+    // Background Loading //
+
+        // Returns the asset straight away and reads and decodes it on a worker.
+        // It stays empty while IsLoading(), so draw a placeholder until then.
+        // Loaders that can't decode off the main thread load synchronously.
+        template <typename T>
+        Rc<T> LoadAsync(const Path& path);
+        template <typename T>
+        Rc<T> LoadAsync(const PathKey& key);
+
+        // Finishes background loads on the main thread (GPU uploads, dependent
+        // assets) until the asset_load_budget for this frame runs out.
+        void Update();
+
+        // Worker half of a background read or load. Gets the file's contents and
+        // returns what to run on the main thread once it's done.
+        using DecodeJob = std::function<std::function<void()>(std::span<const byte>)>;
+
+        // Reads a file and runs 'decode' on a worker, then its result in Update,
+        // like an asset load without the asset. If reading, decoding or the result
+        // throws, 'failed' runs instead. False if there is no such file.
+        bool ReadAsync(const Path& path, DecodeJob decode, std::function<void()> failed = {});
+
+        size_t PendingLoads() const { return loading.size(); }
+
+        // Loads and reads finished so far. Changes whenever something that
+        // was loading in the background shows up.
+        uint64 FinishedLoads() const { return finishedLoads; }
+
+        // Fired from Update with the assets that finished loading, or failed to.
+        Event<std::span<Asset* const>> OnLoaded;
+
+    // Memory Budget //
+
+        // Keeps an asset alive after its last user lets go, until it's the least
+        // recently retained and the asset_memory_budget needs the space.
+        // Call again whenever the asset is used to mark it as recent.
+        // Anything that holds memory of its own is retained by Account.
+        void Retain(Asset* asset);
+        bool IsRetained(Asset* asset) const { return retainedIndex.contains(asset); }
+
+        // Releases retained assets nothing else uses, oldest first, until under budget.
+        void EvictToBudget();
+
+        size_t MemoryUsage() const { return Asset::s_MemoryUsage; }
+
+        // Records the memory of an asset that just finished loading, or
+        // whose memory changed since, eg. when mips were streamed in.
+        // Assets with memory (textures, meshes) are retained, so the budget
+        // decides when they go rather than their last user.
+        void Account(Asset* asset);
+
+        // Logs memory per asset type and the 'count' biggest assets.
+        void PrintMemoryUsage(size_t count);
+
+        // The cached asset, or null if it isn't loaded (anymore). Never loads.
+        template <typename T>
+        Rc<T> Cached(const PathKey& key) { return Rc<T>(static_cast<T*>(FindAsset(key))); }
+
+    // Headless //
+
+        // When set, Load and LoadAsync never read anything and return empty assets
+        // that only carry their path. For the command line tools, which pass asset
+        // references from one map format to another without looking inside them.
+        bool referencesOnly = false;
+
     // Search Paths //
 
         void AddSearchPath(const Path& p);
         void AddPakFile(const Path& p);
         void ResetSearchPaths();
 
-        // Call this after changing search paths
+        // Call this after changing search paths.
+        // Rebuilds the file index and notifies OnRefresh listeners.
         void Refresh();
 
     // File Enumeration //
 
+        // Calls func(const PathKey&, std::string_view path) for every indexed file
+        // a loader for T can handle. Only walks the index, never the disk.
         template <typename T>
         void ForEachFile(auto func);
 
@@ -54,16 +137,75 @@ namespace chisel
         Event<> OnRefresh;
 
     private:
+        // Where a file in the virtual filesystem actually lives.
+        struct FileEntry
+        {
+            std::string path;                           // As found on disk or in the pak, relative to its search path
+            const Path* searchPath = nullptr;           // Loose file under this search path...
+            const PakFile* pak = nullptr;               // ...or an entry in one of the paks
+            const PakFile::Entry* pakEntry = nullptr;
+        };
+
+        // Indexes every file in every search path and pak.
+        void Mount();
+        const FileEntry* FindFile(std::string_view path);
+
+        std::optional<Buffer> ReadFile(const FileEntry& entry);
+        std::optional<FileView> MapFile(const FileEntry& entry);
+
+        // A file resolved on the main thread, so workers never touch the index.
+        struct FileSource
+        {
+            std::optional<FileView> view;   // Pak entries are mapped up front...
+            Path loosePath;                 // ...loose files are read by the worker.
+        };
+
+        std::optional<FileSource> LocateFile(const Path& path);
+
+        // The asset cached under a key, or null. Empty keys are never cached.
+        Asset* FindAsset(const PathKey& key);
+
+        struct CompletedLoad
+        {
+            Asset* asset = nullptr;         // Null for plain reads
+            Path path;
+            std::function<void()> finish;   // Empty if reading or decoding failed
+            std::function<void()> failed;   // Plain reads only
+            std::string error;
+            std::optional<FileView> file;   // Decoded data may still point into the file
+        };
+
+        void QueueLoad(Asset* asset, const Path& path, FileSource source, DecodeJob decode, std::function<void()> failed = {});
+        void FinishLoads(double budget);
+
         std::list<Path> searchPaths;
-        std::list<std::unique_ptr<libvpk::VPKSet>> pakFiles;
+        std::list<std::unique_ptr<PakFile>> pakFiles;
+
+        // Normalized path -> file. Earlier search paths win, loose files before paks.
+        std::unordered_map<PathKey, FileEntry> fileIndex;
+        bool fileIndexDirty = true;
+
+        // Assets with a load in flight. Holding them here means the last
+        // reference is never dropped by a worker.
+        std::unordered_map<Asset*, Rc<Asset>> loading;
+
+        // Most recently retained first
+        std::list<Rc<Asset>> retained;
+        std::unordered_map<Asset*, std::list<Rc<Asset>>::iterator> retainedIndex;
+
+        std::mutex completedMutex;
+        std::deque<CompletedLoad> completed;
+        uint64 finishedLoads = 0;
     } Assets;
 
     template <typename T>
     inline Rc<T> Assets::Load(const Path& path)
     {
-        // Cache hit
-        if (IsLoaded(path)) [[likely]]
-            return Rc<T>(static_cast<T*>(T::AssetDB[path]));
+        // Cache hit. One that LoadAsync is still loading is loaded again here rather
+        // than handed out empty, and FinishLoads drops the background result.
+        Rc<T> asset = static_cast<T*>(FindAsset(PathKey::Find(path)));
+        if (asset != nullptr && !asset->IsLoading()) [[likely]]
+            return asset;
 
         // Lookup file extension
         auto* loader = AssetLoader<T>::ForExtension(path.ext());
@@ -73,7 +215,11 @@ namespace chisel
         }
 
         // Create the asset
-        Rc<T> asset = new T(path);
+        const bool wasLoading = asset != nullptr;
+        if (asset == nullptr)
+            asset = new T(path);
+        if (referencesOnly)
+            return asset;
 
         // Attempt to load asset for first time
         try
@@ -91,44 +237,89 @@ namespace chisel
             return nullptr;
         }
 
+        Account(asset.ptr());
+        if (wasLoading)
+        {
+            Asset* loaded = asset.ptr();
+            loaded->m_state = AssetState::Loaded;
+            OnLoaded(std::span<Asset* const>(&loaded, 1));
+        }
         return asset;
     }
 
     template <typename T>
-    inline void Assets::ForEachFile(auto func)
+    inline Rc<T> Assets::LoadAsync(const Path& path)
     {
-        // Enumerate loose files.
-        for (const auto& dir : searchPaths)
+        // Cache hit, possibly still loading
+        if (Asset* cached = FindAsset(PathKey::Find(path))) [[likely]]
+            return Rc<T>(static_cast<T*>(cached));
+
+        // Lookup file extension
+        auto* loader = AssetLoader<T>::ForExtension(path.ext());
+        if (!loader) {
+            Console.Error("[Assets] No importer for {} file: {}", path.ext(), path);
+            return nullptr;
+        }
+
+        if (!loader->CanDecodeAsync() || referencesOnly)
+            return Load<T>(path);
+
+        auto source = LocateFile(path);
+        if (!source) {
+            Console.Error("[Assets] Can't find file: '{}'", path);
+            return nullptr;
+        }
+
+        Rc<T> asset = new T(path);
+
+        // The worker only carries the pointer around, 'loading' keeps it alive.
+        QueueLoad(asset.ptr(), path, std::move(*source), [loader, ptr = asset.ptr()](std::span<const byte> data) -> std::function<void()>
         {
-            for (auto file : std::filesystem::recursive_directory_iterator(dir))
-            {
-                Path path = file.path();
-                if (file.is_directory())
-                    continue;
-                
-                auto ext = str::toUpper(path.ext());
-                auto hash = HashedString(ext);
-
-                if (!AssetLoader<T>::ForExtension(path.ext()))
-                    continue;
-                
-                func(path);
-            }
+            return [finish = loader->Decode(data), ptr] { finish(*ptr); };
+        });
+
+        return asset;
+    }
+
+    template <typename T>
+    inline Rc<T> Assets::Load(const PathKey& key)
+    {
+        if (Asset* cached = FindAsset(key)) [[likely]]
+        {
+            if (!cached->IsLoading()) [[likely]]
+                return Rc<T>(static_cast<T*>(cached));
+            return Load<T>(cached->GetPath());
         }
 
-        // Enumerate files in paks
-        for (const auto& pak : pakFiles)
+        return Load<T>(Path(key.str()));
+    }
+
+    template <typename T>
+    inline Rc<T> Assets::LoadAsync(const PathKey& key)
+    {
+        if (Asset* cached = FindAsset(key)) [[likely]]
+            return Rc<T>(static_cast<T*>(cached));
+
+        return LoadAsync<T>(Path(key.str()));
+    }
+
+    template <typename T>
+    inline void Assets::ForEachFile(auto func)
+    {
+        if (fileIndexDirty)
+            Mount();
+
+        for (const auto& [key, entry] : fileIndex)
         {
-            auto& files = pak->files();
-            for (const auto& file : files)
-            {
-                auto path = fs::Path(file.first);
+            std::string_view path = entry.path;
+            size_t dot = path.find_last_of("./\\");
+            if (dot == std::string_view::npos || path[dot] != '.')
+                continue;
 
-                if (!AssetLoader<T>::ForExtension(path.ext()))
-                    continue;
+            if (!AssetLoader<T>::ForExtension(path.substr(dot)))
+                continue;
 
-                func(path);
-            }
+            func(key, path);
         }
     }
 }
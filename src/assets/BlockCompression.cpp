@@ -0,0 +1,194 @@
+#include "assets/BlockCompression.h"
+#include "common/Jobs.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace chisel
+{
+    using Pixel = byte[4];
+
+    static uint16 To565(const int rgb[3])
+    {
+        return uint16(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+    }
+
+    static void From565(uint16 color, int rgb[3])
+    {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    static void Write16(byte* out, uint16 value)
+    {
+        out[0] = byte(value);
+        out[1] = byte(value >> 8);
+    }
+
+    // Endpoints on the diagonal of the colors' bounding box, the one they lie along,
+    // inset a little to lower the error at the ends. Always four-color mode.
+    static void EncodeColorBlock(const Pixel block[16], byte* out)
+    {
+        int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+        for (uint i = 0; i < 16; i++)
+        {
+            for (uint c = 0; c < 3; c++)
+            {
+                lo[c] = std::min<int>(lo[c], block[i][c]);
+                hi[c] = std::max<int>(hi[c], block[i][c]);
+                mean[c] += block[i][c];
+            }
+        }
+
+        for (uint c = 0; c < 3; c++)
+        {
+            mean[c] = (mean[c] + 8) / 16;
+            int inset = (hi[c] - lo[c]) >> 4;
+            lo[c] += inset;
+            hi[c] -= inset;
+        }
+
+        // Flip green and blue to the diagonal that goes the same way as red
+        int covG = 0, covB = 0;
+        for (uint i = 0; i < 16; i++)
+        {
+            int r = block[i][0] - mean[0];
+            covG += r * (block[i][1] - mean[1]);
+            covB += r * (block[i][2] - mean[2]);
+        }
+        if (covG < 0)
+            std::swap(lo[1], hi[1]);
+        if (covB < 0)
+            std::swap(lo[2], hi[2]);
+
+        uint16 c0 = To565(hi), c1 = To565(lo);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        Write16(out + 0, c0);
+        Write16(out + 2, c1);
+        if (c0 == c1)
+        {
+            memset(out + 4, 0, 4);
+            return;
+        }
+
+        int palette[4][3];
+        From565(c0, palette[0]);
+        From565(c1, palette[1]);
+        for (uint c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        uint32 indices = 0;
+        for (uint i = 0; i < 16; i++)
+        {
+            uint best = 0;
+            int bestError = INT32_MAX;
+            for (uint p = 0; p < 4; p++)
+            {
+                int error = 0;
+                for (uint c = 0; c < 3; c++)
+                {
+                    int d = int(block[i][c]) - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+
+        for (uint i = 0; i < 4; i++)
+            out[4 + i] = byte(indices >> (i * 8));
+    }
+
+    // Eight-value mode between the smallest and largest alpha
+    static void EncodeAlphaBlock(const Pixel block[16], byte* out)
+    {
+        int lo = 255, hi = 0;
+        for (uint i = 0; i < 16; i++)
+        {
+            lo = std::min<int>(lo, block[i][3]);
+            hi = std::max<int>(hi, block[i][3]);
+        }
+
+        out[0] = byte(hi);
+        out[1] = byte(lo);
+        memset(out + 2, 0, 6);
+        if (hi == lo)
+            return;
+
+        int palette[8] = { hi, lo };
+        for (int p = 2; p < 8; p++)
+            palette[p] = ((8 - p) * hi + (p - 1) * lo) / 7;
+
+        uint64 indices = 0;
+        for (uint i = 0; i < 16; i++)
+        {
+            uint64 best = 0;
+            int bestError = INT32_MAX;
+            for (uint p = 0; p < 8; p++)
+            {
+                int error = std::abs(int(block[i][3]) - palette[p]);
+                if (error < bestError)
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+
+        for (uint i = 0; i < 6; i++)
+            out[2 + i] = byte(indices >> (i * 8));
+    }
+
+    Buffer CompressBlocks(std::span<const byte> rgba, uint width, uint height, DXGI_FORMAT format)
+    {
+        assert(format == DXGI_FORMAT_BC1_UNORM || format == DXGI_FORMAT_BC3_UNORM);
+        assert(rgba.size() >= size_t(width) * height * 4);
+
+        const bool alpha = format == DXGI_FORMAT_BC3_UNORM;
+        const uint blockBytes = alpha ? 16 : 8;
+        const uint blocksWide = (width + 3) / 4;
+        const uint blocksHigh = (height + 3) / 4;
+
+        Buffer out(size_t(blocksWide) * blocksHigh * blockBytes);
+
+        Jobs.ParallelFor(blocksHigh, [&](uint by)
+        {
+            for (uint bx = 0; bx < blocksWide; bx++)
+            {
+                Pixel block[16];
+                for (uint y = 0; y < 4; y++)
+                {
+                    const uint py = std::min(by * 4 + y, height - 1);
+                    for (uint x = 0; x < 4; x++)
+                    {
+                        const uint px = std::min(bx * 4 + x, width - 1);
+                        memcpy(block[y * 4 + x], &rgba[(size_t(py) * width + px) * 4], 4);
+                    }
+                }
+
+                byte* dst = &out[(size_t(by) * blocksWide + bx) * blockBytes];
+                if (alpha)
+                {
+                    EncodeAlphaBlock(block, dst);
+                    dst += 8;
+                }
+                EncodeColorBlock(block, dst);
+            }
+        });
+
+        return out;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common/Common.h"
+#include "common/Span.h"
+#include "render/D3D11Include.h"
+
+#include <span>
+
+namespace chisel
+{
+    // Block compresses a tightly packed RGBA8 image to DXGI_FORMAT_BC1_UNORM (opaque)
+    // or DXGI_FORMAT_BC3_UNORM. Partial blocks at the edges repeat the last row and column.
+    // Rows of blocks are spread over the job pool, this is fine to call from a job.
+    Buffer CompressBlocks(std::span<const byte> rgba, uint width, uint height, DXGI_FORMAT format);
+}
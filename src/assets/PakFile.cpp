@@ -0,0 +1,224 @@
+#include "assets/PakFile.h"
+#include "console/Console.h"
+
+#include <cstring>
+#include <fmt/format.h>
+
+namespace chisel
+{
+    static constexpr uint32_t VPKSignature = 0x55aa1234;
+
+    struct VPKHeaderV1
+    {
+        uint32_t signature;
+        uint32_t version;
+        uint32_t treeSize;
+    };
+
+    struct VPKHeaderV2 : VPKHeaderV1
+    {
+        uint32_t fileDataSectionSize;
+        uint32_t archiveMD5SectionSize;
+        uint32_t otherMD5SectionSize;
+        uint32_t signatureSectionSize;
+    };
+
+#pragma pack(push, 1)
+    struct VPKDirectoryEntry
+    {
+        uint32_t crc;
+        uint16_t preloadBytes;
+        uint16_t archiveIndex;
+        uint32_t entryOffset;
+        uint32_t entryLength;
+        uint16_t terminator;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(VPKHeaderV1) == 12);
+    static_assert(sizeof(VPKHeaderV2) == 28);
+    static_assert(sizeof(VPKDirectoryEntry) == 18);
+
+    // Walks the directory tree. Every read is bounds checked against the tree.
+    struct VPKTreeReader
+    {
+        const byte* pos;
+        const byte* end;
+        bool failed = false;
+
+        std::string_view ReadString()
+        {
+            const byte* terminator = (const byte*)memchr(pos, '\0', size_t(end - pos));
+            if (!terminator)
+            {
+                failed = true;
+                return {};
+            }
+
+            std::string_view str((const char*)pos, size_t(terminator - pos));
+            pos = terminator + 1;
+            return str;
+        }
+
+        bool Read(VPKDirectoryEntry& entry)
+        {
+            if (size_t(end - pos) < sizeof(entry))
+                return false;
+
+            memcpy(&entry, pos, sizeof(entry));
+            pos += sizeof(entry);
+            return true;
+        }
+
+        std::span<const byte> ReadBytes(size_t count)
+        {
+            if (size_t(end - pos) < count)
+            {
+                failed = true;
+                return {};
+            }
+
+            std::span<const byte> bytes(pos, count);
+            pos += count;
+            return bytes;
+        }
+    };
+
+    bool PakFile::Open(const fs::Path& path)
+    {
+        m_dir = std::make_shared<MappedFile>();
+        if (!m_dir->Open(path))
+            return false;
+
+        std::span<const byte> dir = m_dir->Data();
+
+        VPKHeaderV2 header = {};
+        if (dir.size() < sizeof(VPKHeaderV1))
+            return false;
+
+        memcpy(&header, dir.data(), sizeof(VPKHeaderV1));
+        if (header.signature != VPKSignature || (header.version != 1 && header.version != 2))
+            return false;
+
+        const size_t headerSize = header.version == 1 ? sizeof(VPKHeaderV1) : sizeof(VPKHeaderV2);
+        if (dir.size() < headerSize || dir.size() - headerSize < header.treeSize)
+            return false;
+
+        m_dirDataOffset = headerSize + header.treeSize;
+
+        // Tree layout: extension { path { filename { entry } } }, each level ends with an empty string.
+        VPKTreeReader tree = { dir.data() + headerSize, dir.data() + m_dirDataOffset };
+        uint16_t maxArchive = 0;
+        bool anyArchives = false;
+
+        while (!tree.failed)
+        {
+            std::string_view ext = tree.ReadString();
+            if (ext.empty())
+                break;
+
+            while (!tree.failed)
+            {
+                std::string_view dirname = tree.ReadString();
+                if (dirname.empty())
+                    break;
+
+                while (!tree.failed)
+                {
+                    std::string_view filename = tree.ReadString();
+                    if (filename.empty())
+                        break;
+
+                    VPKDirectoryEntry desc;
+                    if (!tree.Read(desc) || desc.terminator != 0xffff)
+                    {
+                        tree.failed = true;
+                        break;
+                    }
+
+                    Entry entry;
+                    entry.crc     = desc.crc;
+                    entry.archive = desc.archiveIndex;
+                    entry.offset  = desc.entryOffset;
+                    entry.length  = desc.entryLength;
+                    entry.preload = tree.ReadBytes(desc.preloadBytes);
+
+                    if (entry.archive != DirArchive)
+                    {
+                        maxArchive  = std::max(maxArchive, entry.archive);
+                        anyArchives = true;
+                    }
+
+                    // A single space stands in for an empty component.
+                    std::string name;
+                    if (dirname != " ")
+                        (name += dirname) += '/';
+                    if (filename != " ")
+                        name += filename;
+                    if (ext != " ")
+                        (name += '.') += ext;
+
+                    m_files.emplace_back(std::move(name), entry);
+                }
+            }
+        }
+
+        if (tree.failed)
+        {
+            Console.Error("[Assets] Corrupt VPK directory: '{}'", path);
+            return false;
+        }
+
+        // Map the numbered archives next to the directory: foo_dir.vpk -> foo_000.vpk ...
+        std::string_view base = path;
+        if (anyArchives && base.ends_with("_dir.vpk"))
+        {
+            base.remove_suffix(std::string_view("dir.vpk").size());
+
+            m_archives.resize(size_t(maxArchive) + 1);
+            for (size_t i = 0; i < m_archives.size(); i++)
+            {
+                auto archive = std::make_shared<MappedFile>();
+                std::string archivePath = fmt::format("{}{:03}.vpk", base, i);
+                if (archive->Open(archivePath.c_str()))
+                    m_archives[i] = std::move(archive);
+            }
+        }
+
+        return true;
+    }
+
+    std::optional<FileView> PakFile::View(const Entry& entry) const
+    {
+        if (entry.length == 0)
+            return FileView { entry.preload, m_dir };
+
+        const std::shared_ptr<MappedFile>* archive;
+        size_t offset = entry.offset;
+        if (entry.archive == DirArchive)
+        {
+            archive = &m_dir;
+            offset += m_dirDataOffset;
+        }
+        else
+        {
+            if (entry.archive >= m_archives.size() || !m_archives[entry.archive])
+                return std::nullopt;
+            archive = &m_archives[entry.archive];
+        }
+
+        std::span<const byte> data = (*archive)->Data();
+        if (offset > data.size() || data.size() - offset < entry.length)
+            return std::nullopt;
+
+        std::span<const byte> body = data.subspan(offset, entry.length);
+        if (entry.preload.empty())
+            return FileView { body, *archive };
+
+        Buffer buffer;
+        buffer.reserve(Size(entry));
+        buffer.insert(buffer.end(), entry.preload.begin(), entry.preload.end());
+        buffer.insert(buffer.end(), body.begin(), body.end());
+        return FileView::FromBuffer(std::move(buffer));
+    }
+}
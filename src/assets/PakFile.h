@@ -0,0 +1,52 @@
+#pragma once
+
+#include "assets/AssetLoader.h"
+#include "common/Common.h"
+#include "common/Path.h"
+#include "platform/MappedFile.h"
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace chisel
+{
+    /**
+     * A mounted VPK (v1 or v2). The directory and every numbered archive
+     * are memory mapped once when the pak is opened, and entries stored in
+     * one piece are handed out as views straight into the mapping.
+     */
+    class PakFile
+    {
+    public:
+        // Archive index for data stored after the tree in the _dir.vpk itself.
+        static constexpr uint16_t DirArchive = 0x7fff;
+
+        struct Entry
+        {
+            uint32_t crc;
+            uint16_t archive;
+            uint32_t offset;
+            uint32_t length;
+            std::span<const byte> preload;  // Leading bytes stored inline in the directory
+        };
+
+        bool Open(const fs::Path& path);
+
+        const std::vector<std::pair<std::string, Entry>>& Files() const { return m_files; }
+
+        size_t Size(const Entry& entry) const { return entry.preload.size() + entry.length; }
+
+        // Zero-copy for entries stored in one piece, otherwise the parts are copied together.
+        std::optional<FileView> View(const Entry& entry) const;
+
+    private:
+        std::shared_ptr<MappedFile> m_dir;
+        std::vector<std::shared_ptr<MappedFile>> m_archives;    // By archive index, null if missing
+        size_t m_dirDataOffset = 0;
+
+        std::vector<std::pair<std::string, Entry>> m_files;
+    };
+}
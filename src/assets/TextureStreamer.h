@@ -0,0 +1,60 @@
+#pragma once
+
+#include "render/Render.h"
+#include "common/Time.h"
+
+#include <unordered_map>
+
+namespace chisel
+{
+    /**
+     * Streams the detailed mips of VTF textures in and out by on-screen size.
+     *
+     * The VTF loader only uploads the small end of each mip chain, so the
+     * texture shows up straight away. Renderers report the streamed textures
+     * they draw with Touch(). Update() re-reads the file in the background for
+     * the ones drawn largest, and swaps in a texture with the extra mips.
+     * Textures that haven't been drawn for a while give their extra mips up
+     * again, least recently drawn first, to stay under tex_stream_budget.
+     */
+    inline class TextureStreamer
+    {
+    public:
+        // Most detailed mip a texture is uploaded with when it first loads.
+        uint InitialMip(uint2 size, uint mipCount) const;
+
+        // Records that 'tex' was drawn this frame, at about 'texelsPerPixel' of its
+        // mip 0 to a screen pixel. 'pixels' is how large it was on screen,
+        // larger textures stream in first.
+        void Touch(Texture* tex, float texelsPerPixel, float pixels);
+
+        // Streams in what was touched since the last call and keeps to the budget.
+        void Update();
+
+        // GPU memory held by textures with more than their initial mips resident.
+        size_t StreamedBytes() const;
+
+    private:
+        struct Touched
+        {
+            Rc<Texture> tex;
+            uint wantedMip;
+            float pixels;
+        };
+
+        struct Streamed
+        {
+            Rc<Texture> tex;
+            Time::Frames lastUsed = 0;
+            bool loading = false;
+            bool failed = false;    // Stop trying, the file changed or went away
+        };
+
+        void StreamIn(Streamed& entry, uint mip);
+        void DropMips(Texture* tex, uint mip);
+
+        std::unordered_map<Texture*, Touched> m_touched;
+        std::unordered_map<Texture*, Streamed> m_streamed;
+        uint m_inFlight = 0;
+    } TextureStreamer;
+}
@@ -0,0 +1,480 @@
+#include "assets/ThumbnailCache.h"
+#include "chisel/Engine.h"
+#include "formats/KeyValues.h"
+#include "render/TextureFormat.h"
+#include "common/Bit.h"
+#include "common/Jobs.h"
+#include "console/ConVar.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace chisel
+{
+    static constexpr uint32 PackMagic   = 'C' | ('T' << 8) | ('H' << 16) | ('P' << 24);
+    static constexpr uint32 PackVersion = 1;
+    static constexpr size_t DataAlignment = 16;
+
+    static ConVar<int> thumbnail_budget("thumbnail_budget", 64, "Megabytes of asset picker thumbnails kept on the GPU, the least recently shown are released first.");
+
+    static Rc<Texture> Upload(uint width, uint height, DXGI_FORMAT format, std::span<const byte> data)
+    {
+        auto [blockWidth, blockHeight] = GetBlockSize(format);
+        uint pitch;
+        try
+        {
+            pitch = (align(width, blockWidth) / blockWidth) * GetElementSize(format);
+        }
+        catch (std::exception&)
+        {
+            return nullptr;
+        }
+
+        const uint rows = align(height, blockHeight) / blockHeight;
+        if (data.size() < size_t(pitch) * rows)
+            return nullptr;
+
+        D3D11_TEXTURE2D_DESC desc =
+        {
+            .Width      = width,
+            .Height     = height,
+            .MipLevels  = 1,
+            .ArraySize  = 1,
+            .Format     = LinearToTypeless(format),
+            .SampleDesc = { 1, 0 },
+            .Usage      = D3D11_USAGE_IMMUTABLE,
+            .BindFlags  = D3D11_BIND_SHADER_RESOURCE,
+        };
+        D3D11_SUBRESOURCE_DATA initialData =
+        {
+            .pSysMem          = data.data(),
+            .SysMemPitch      = pitch,
+            .SysMemSlicePitch = 0,
+        };
+
+        Rc<Texture> tex = new Texture();
+        if (FAILED(Engine.rctx.device->CreateTexture2D(&desc, &initialData, &tex->texture)))
+            return nullptr;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc =
+        {
+            .Format = format,
+            .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
+            .Texture2D =
+            {
+                .MostDetailedMip = 0,
+                .MipLevels = 1,
+            },
+        };
+        Engine.rctx.device->CreateShaderResourceView(tex->texture.ptr(), &srvDesc, &tex->srvLinear);
+        srvDesc.Format = LinearToSRGB(format);
+        Engine.rctx.device->CreateShaderResourceView(tex->texture.ptr(), &srvDesc, &tex->srvSRGB);
+        return tex;
+    }
+
+    // Same lookup the VMT loader does for $basetexture
+    static std::string TexturePath(std::string_view name)
+    {
+        std::string path = std::string(name);
+        if (!path.starts_with("materials"))
+            path = "materials/" + path;
+        if (!path.ends_with(".vtf"))
+            path += ".vtf";
+        return path;
+    }
+
+    static std::string ParseBaseTexture(std::span<const byte> data)
+    {
+        auto r_kv = kv::KeyValues::ParseFromUTF8(chisel::StringView((const char*)data.data(), data.size()));
+        if (!r_kv || r_kv->begin() == r_kv->end())
+            return {};
+
+        kv::KeyValues& kv = r_kv->begin()->second;
+        if (auto& basetexture = kv["$basetexture"])
+            return std::string((std::string_view)basetexture);
+        return {};
+    }
+
+// Lookup //
+
+    Texture* ThumbnailCache::Find(const PathKey& material) const
+    {
+        auto it = m_textures.find(material);
+        return it != m_textures.end() ? it->second.tex.ptr() : nullptr;
+    }
+
+    bool ThumbnailCache::Request(const PathKey& key, Priority priority)
+    {
+        if (!m_opened)
+            Open();
+
+        if (auto it = m_textures.find(key); it != m_textures.end())
+        {
+            it->second.lastUsed = Time.frameCount;
+            return true;
+        }
+        if (m_failed.contains(key))
+            return false;
+
+        // Already queued, keep it alive
+        if (auto it = m_wanted.find(key); it != m_wanted.end())
+        {
+            Wanted& wanted = it->second;
+            wanted.priority = std::min(wanted.priority, priority);
+            wanted.frame = Time.frameCount;
+            return false;
+        }
+
+        // Built earlier and released since, but not saved yet
+        if (auto it = m_built.find(key); it != m_built.end())
+        {
+            const Thumbnail& thumb = it->second.thumbnail;
+            if (MakeResident(key, thumb.width, thumb.height, thumb.format, thumb.data))
+                return true;
+        }
+
+        // Hit in the pack?
+        if (auto it = m_packIndex.find(key); it != m_packIndex.end())
+        {
+            const PackRecord& record = m_records[it->second];
+            std::string_view texture = m_strings.substr(record.texture, record.textureLength);
+
+            if (record.materialStamp == Assets.FileStamp(key.str()) && record.textureStamp == Assets.FileStamp(texture))
+            {
+                auto data = m_pack.Data().subspan(record.dataOffset, record.dataSize);
+                if (MakeResident(key, record.width, record.height, DXGI_FORMAT(record.format), data))
+                    return true;
+            }
+        }
+
+        // Miss, wait for a turn on the workers.
+        m_wanted.emplace(key, Wanted{ priority, m_nextOrder++, Time.frameCount });
+        return false;
+    }
+
+    bool ThumbnailCache::IsStale(const Wanted& wanted) const
+    {
+        // Requested either this frame or the last, depending on when Update runs.
+        return wanted.frame + 1 < Time.frameCount;
+    }
+
+    void ThumbnailCache::Update()
+    {
+        // Cancel whatever is no longer being asked for
+        std::erase_if(m_wanted, [this](const auto& pair) { return !pair.second.started && IsStale(pair.second); });
+
+        // Few enough in flight that a newly visible thumbnail never waits long behind old ones
+        const uint maxStarted = std::max(Jobs.ThreadCount(), 1u) * 2;
+        while (m_started < maxStarted)
+        {
+            auto next = m_wanted.end();
+            for (auto it = m_wanted.begin(); it != m_wanted.end(); ++it)
+            {
+                const Wanted& wanted = it->second;
+                if (wanted.started)
+                    continue;
+
+                if (next == m_wanted.end()
+                    || wanted.priority < next->second.priority
+                    || (wanted.priority == next->second.priority && wanted.order < next->second.order))
+                    next = it;
+            }
+
+            if (next == m_wanted.end())
+                break;
+
+            Start(next->first);
+        }
+
+        EvictToBudget();
+    }
+
+    bool ThumbnailCache::MakeResident(const PathKey& key, uint width, uint height, DXGI_FORMAT format, std::span<const byte> data)
+    {
+        auto tex = Upload(width, height, format, data);
+        if (!tex)
+            return false;
+
+        Resident& resident = m_textures[key];
+        m_residentBytes -= resident.bytes;
+        resident = Resident{ std::move(tex), data.size(), Time.frameCount };
+        m_residentBytes += resident.bytes;
+        return true;
+    }
+
+    void ThumbnailCache::EvictToBudget()
+    {
+        const size_t budget = size_t(std::max(thumbnail_budget.value, 0)) * 1024 * 1024;
+        if (m_residentBytes <= budget)
+            return;
+
+        // Anything still being requested stays, even over budget
+        std::vector<std::pair<Time::Frames, PathKey>> unused;
+        for (const auto& [key, resident] : m_textures)
+        {
+            if (resident.lastUsed + 1 < Time.frameCount)
+                unused.emplace_back(resident.lastUsed, key);
+        }
+        std::sort(unused.begin(), unused.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (const auto& [lastUsed, key] : unused)
+        {
+            if (m_residentBytes <= budget)
+                break;
+
+            auto it = m_textures.find(key);
+            m_residentBytes -= it->second.bytes;
+            m_textures.erase(it);
+        }
+    }
+
+    void ThumbnailCache::Start(PathKey key)
+    {
+        Wanted& wanted = m_wanted.at(key);
+        wanted.started = true;
+        m_started++;
+
+        uint64 materialStamp = Assets.FileStamp(key.str());
+        bool queued = Assets.ReadAsync(key.str(), [this, key, materialStamp](std::span<const byte> data) -> std::function<void()>
+        {
+            std::string basetexture = ParseBaseTexture(data);
+            return [this, key, materialStamp, basetexture]
+            {
+                BuildFromTexture(key, materialStamp, basetexture);
+            };
+        }, [this, key] { Fail(key); });
+
+        if (!queued)
+            Fail(key);
+    }
+
+    void ThumbnailCache::BuildFromTexture(PathKey key, uint64 materialStamp, std::string_view basetexture)
+    {
+        if (basetexture.empty())
+            return Fail(key);
+
+        // Scrolled away while the material was read, skip the expensive part.
+        auto it = m_wanted.find(key);
+        if (it != m_wanted.end() && IsStale(it->second))
+        {
+            m_wanted.erase(it);
+            m_started--;
+            return;
+        }
+
+        auto built = std::make_shared<BuiltThumbnail>();
+        built->material      = std::string(key.str());
+        built->texture       = TexturePath(basetexture);
+        built->materialStamp = materialStamp;
+        built->textureStamp  = Assets.FileStamp(built->texture);
+
+        bool queued = Assets.ReadAsync(built->texture, [this, key, built](std::span<const byte> data) -> std::function<void()>
+        {
+            built->thumbnail = DecodeThumbnail(data, fs::Path(built->texture).ext(), MaxSize);
+            return [this, key, built] { Store(key, std::move(*built)); };
+        }, [this, key] { Fail(key); });
+
+        if (!queued)
+            Fail(key);
+    }
+
+    void ThumbnailCache::Store(PathKey key, BuiltThumbnail built)
+    {
+        if (m_wanted.erase(key))
+            m_started--;
+
+        const Thumbnail& thumb = built.thumbnail;
+        if (!MakeResident(key, thumb.width, thumb.height, thumb.format, thumb.data))
+            return Fail(key);
+
+        m_built.insert_or_assign(key, std::move(built));
+        m_dirty = true;
+    }
+
+    void ThumbnailCache::Fail(PathKey key)
+    {
+        if (m_wanted.erase(key))
+            m_started--;
+        m_failed.insert(key);
+    }
+
+// Pack File //
+
+    void ThumbnailCache::Open()
+    {
+        m_opened = true;
+        if (!m_pack.Open(PackPath))
+            return;
+
+        std::span<const byte> file = m_pack.Data();
+
+        PackHeader header;
+        if (file.size() < sizeof(header))
+            return m_pack.Close();
+
+        memcpy(&header, file.data(), sizeof(header));
+        const size_t recordsEnd = sizeof(header) + size_t(header.count) * sizeof(PackRecord);
+        if (header.magic != PackMagic || header.version != PackVersion
+            || recordsEnd > file.size() || file.size() - recordsEnd < header.stringsSize)
+        {
+            Console.Warn("[Thumbnails] Ignoring invalid cache '{}'", PackPath);
+            return m_pack.Close();
+        }
+
+        m_records = { reinterpret_cast<const PackRecord*>(file.data() + sizeof(header)), header.count };
+        m_strings = { reinterpret_cast<const char*>(file.data() + recordsEnd), header.stringsSize };
+
+        for (uint32 i = 0; i < header.count; i++)
+        {
+            const PackRecord& record = m_records[i];
+            if (size_t(record.material) + record.materialLength > m_strings.size()
+                || size_t(record.texture) + record.textureLength > m_strings.size()
+                || size_t(record.dataOffset) + record.dataSize > file.size())
+                continue;
+
+            m_packIndex.try_emplace(PathKey(m_strings.substr(record.material, record.materialLength)), i);
+        }
+    }
+
+    void ThumbnailCache::Save()
+    {
+        if (!m_dirty)
+            return;
+
+        struct Entry
+        {
+            std::string_view material, texture;
+            uint64 materialStamp, textureStamp;
+            uint16 width, height;
+            DXGI_FORMAT format;
+            std::span<const byte> data;
+        };
+        std::vector<Entry> entries;
+        entries.reserve(m_built.size() + m_packIndex.size());
+
+        // Fresh thumbnails, plus whatever in the old pack they didn't replace
+        for (const auto& [key, built] : m_built)
+        {
+            const Thumbnail& thumb = built.thumbnail;
+            entries.push_back({ built.material, built.texture, built.materialStamp, built.textureStamp,
+                thumb.width, thumb.height, thumb.format, thumb.data });
+        }
+
+        for (const auto& [key, index] : m_packIndex)
+        {
+            if (m_built.contains(key))
+                continue;
+
+            const PackRecord& record = m_records[index];
+            entries.push_back({
+                m_strings.substr(record.material, record.materialLength),
+                m_strings.substr(record.texture, record.textureLength),
+                record.materialStamp, record.textureStamp,
+                record.width, record.height, DXGI_FORMAT(record.format),
+                m_pack.Data().subspan(record.dataOffset, record.dataSize) });
+        }
+
+        // Lay out the string table and data
+        std::vector<PackRecord> records(entries.size());
+        std::string strings;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const Entry& entry = entries[i];
+            PackRecord& record = records[i];
+            record.materialStamp  = entry.materialStamp;
+            record.textureStamp   = entry.textureStamp;
+            record.material       = uint32(strings.size());
+            record.materialLength = uint32(entry.material.size());
+            strings += entry.material;
+            record.texture        = uint32(strings.size());
+            record.textureLength  = uint32(entry.texture.size());
+            strings += entry.texture;
+            record.width          = entry.width;
+            record.height         = entry.height;
+            record.format         = uint32(entry.format);
+            record.dataSize       = uint32(entry.data.size());
+        }
+
+        size_t offset = align(sizeof(PackHeader) + records.size() * sizeof(PackRecord) + strings.size(), DataAlignment);
+        const size_t dataStart = offset;
+        for (PackRecord& record : records)
+        {
+            record.dataOffset = uint32(offset);
+            offset = align(offset + record.dataSize, DataAlignment);
+        }
+
+        PackHeader header = { PackMagic, PackVersion, uint32(records.size()), uint32(strings.size()) };
+
+        // Write next to the old pack, it's still mapped and being read from.
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(PackPath).parent_path(), ec);
+
+        std::string tempPath = std::string(PackPath) + ".tmp";
+        FILE* file = std::fopen(tempPath.c_str(), "wb");
+        if (!file)
+            return Console.Error("[Thumbnails] Failed to write '{}'", tempPath);
+
+        static const byte padding[DataAlignment] = {};
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+               && (records.empty() || std::fwrite(records.data(), sizeof(PackRecord), records.size(), file) == records.size())
+               && std::fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+
+        size_t written = sizeof(header) + records.size() * sizeof(PackRecord) + strings.size();
+        ok = ok && std::fwrite(padding, 1, dataStart - written, file) == dataStart - written;
+        written = dataStart;
+
+        for (size_t i = 0; ok && i < entries.size(); i++)
+        {
+            const PackRecord& record = records[i];
+            ok = std::fwrite(padding, 1, record.dataOffset - written, file) == record.dataOffset - written
+              && std::fwrite(entries[i].data.data(), 1, record.dataSize, file) == record.dataSize;
+            written = size_t(record.dataOffset) + record.dataSize;
+        }
+        ok = (std::fclose(file) == 0) && ok;
+
+        if (!ok)
+        {
+            std::filesystem::remove(tempPath, ec);
+            return Console.Error("[Thumbnails] Failed to write '{}'", tempPath);
+        }
+
+        // Swap the new pack in. Windows won't replace a file that's still mapped,
+        // so only let go of the old pack if that's what stopped the rename.
+        std::filesystem::rename(tempPath, PackPath, ec);
+        if (ec && m_pack.IsOpen())
+        {
+            m_pack.Close();
+            std::filesystem::rename(tempPath, PackPath, ec);
+            if (ec)
+            {
+                // Still the old pack, map it again so its thumbnails aren't lost
+                m_packIndex.clear();
+                m_records = {};
+                m_strings = {};
+                Open();
+            }
+        }
+
+        if (ec)
+        {
+            Console.Error("[Thumbnails] Failed to replace '{}': {}", PackPath, ec.message());
+            std::filesystem::remove(tempPath, ec);
+            return;
+        }
+
+        // It's opened again on the next request.
+        m_packIndex.clear();
+        m_records = {};
+        m_strings = {};
+        m_pack.Close();
+
+        m_dirty = false;
+        m_opened = false;
+        m_built.clear();
+        Console.Log("[Thumbnails] Saved {} thumbnails", records.size());
+    }
+}
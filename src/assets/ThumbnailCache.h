@@ -0,0 +1,146 @@
+#pragma once
+
+#include "assets/Assets.h"
+#include "common/PathKey.h"
+#include "platform/MappedFile.h"
+#include "render/Render.h"
+#include "common/Time.h"
+
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace chisel
+{
+    // One small mip in a format the GPU samples directly. VTF thumbnails keep
+    // their block compression by reusing one of the file's own mips.
+    struct Thumbnail
+    {
+        uint16 width = 0;
+        uint16 height = 0;
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+        Buffer data;
+    };
+
+    // Implemented next to the texture loaders. Throws if the image can't be decoded.
+    Thumbnail DecodeThumbnail(std::span<const byte> data, std::string_view ext, uint maxSize);
+
+    /**
+     * Persistent cache of material thumbnails for the asset picker.
+     *
+     * Thumbnails live in one pack file that is memory mapped on first use.
+     * Entries are keyed by material path and stamped with the material's and
+     * its $basetexture's FileStamp, so edited or repacked files are rebuilt.
+     * Only misses go through the real file reads and decoding, in the
+     * background, and are written back to the pack by Save().
+     *
+     * Misses wait in a queue, most urgent first, with only a few of them
+     * in flight on the workers at a time. Requests have to be repeated
+     * every frame; ones that stop are cancelled before their texture is read.
+     *
+     * Uploaded thumbnails that stop being requested are released again,
+     * least recently requested first, to stay under thumbnail_budget.
+     * They come back from the pack, or from what's waiting for Save().
+     */
+    inline class ThumbnailCache
+    {
+    public:
+        static constexpr uint MaxSize = 128;
+        static constexpr const char* PackPath = "cache/thumbnails.pack";
+
+        enum Priority : uint
+        {
+            Visible,
+            NearlyVisible,
+        };
+
+        // The thumbnail if it's ready. Never starts any work.
+        Texture* Find(const PathKey& material) const;
+
+        // Makes a material's thumbnail available. Up to date pack entries are
+        // uploaded immediately and return true, anything else is queued to be
+        // built in the background and shows up in Find() later.
+        bool Request(const PathKey& material, Priority priority);
+
+        // Drops requests that weren't repeated and starts the most urgent ones.
+        void Update();
+
+        // Number of thumbnails ready to draw, and the GPU memory they hold
+        size_t Count() const { return m_textures.size(); }
+        size_t ResidentBytes() const { return m_residentBytes; }
+
+        // Writes the pack back out if any thumbnails were built.
+        void Save();
+
+    private:
+        struct PackHeader
+        {
+            uint32 magic;
+            uint32 version;
+            uint32 count;
+            uint32 stringsSize;
+        };
+
+        struct PackRecord
+        {
+            uint64 materialStamp;
+            uint64 textureStamp;
+            uint32 material, materialLength;    // Into the string table
+            uint32 texture, textureLength;
+            uint32 dataOffset, dataSize;        // From the start of the file
+            uint16 width, height;
+            uint32 format;                      // DXGI_FORMAT
+        };
+
+        struct BuiltThumbnail
+        {
+            std::string material;
+            std::string texture;
+            uint64 materialStamp;
+            uint64 textureStamp;
+            Thumbnail thumbnail;
+        };
+
+        struct Resident
+        {
+            Rc<Texture> tex;
+            size_t bytes;
+            Time::Frames lastUsed;
+        };
+
+        // A thumbnail that was requested and isn't ready yet
+        struct Wanted
+        {
+            Priority priority;
+            uint64 order;           // Older requests go first within a priority
+            Time::Frames frame;     // Last requested
+            bool started = false;   // On the workers, can only be cancelled between reads
+        };
+
+        void Open();
+        void Start(PathKey key);
+        bool IsStale(const Wanted& wanted) const;
+        void BuildFromTexture(PathKey key, uint64 materialStamp, std::string_view basetexture);
+        void Store(PathKey key, BuiltThumbnail built);
+        void Fail(PathKey key);
+        bool MakeResident(const PathKey& key, uint width, uint height, DXGI_FORMAT format, std::span<const byte> data);
+        void EvictToBudget();
+
+        bool m_opened = false;
+        bool m_dirty = false;
+
+        MappedFile m_pack;
+        std::span<const PackRecord> m_records;
+        std::string_view m_strings;
+        std::unordered_map<PathKey, uint32> m_packIndex;
+
+        std::unordered_map<PathKey, BuiltThumbnail> m_built;
+        std::unordered_map<PathKey, Resident> m_textures;
+        size_t m_residentBytes = 0;
+        std::unordered_map<PathKey, Wanted> m_wanted;
+        std::unordered_set<PathKey> m_failed;
+        uint m_started = 0;
+        uint64 m_nextOrder = 0;
+    } ThumbnailCache;
+}
@@ -14,29 +14,43 @@ namespace chisel
         if (!val.ends_with(".vtf"))
             val += ".vtf";
 
-        return Assets.Load<Texture>(val);
+        // Textures stream in behind the material, however it was loaded.
+        return Assets.LoadAsync<Texture>(PathKey(val));
     }
 
-    static AssetLoader <Material> VMTLoader = { ".VMT", [](Material& mat, const Buffer& data)
+    static AssetLoader <Material> VMTLoader = { ".VMT", [](std::span<const byte> data) -> AssetLoader<Material>::AssetFinishFn
     {
-        auto r_kv = kv::KeyValues::ParseFromUTF8(chisel::StringView(data));
+        auto r_kv = kv::KeyValues::ParseFromUTF8(chisel::StringView((const char*)data.data(), data.size()));
         if (!r_kv)
-            return;
+            return [](Material&) {};
 
         if (r_kv->begin() == r_kv->end())
-            return;
+            return [](Material&) {};
 
         // Get past the root member.
         kv::KeyValues &kv = r_kv->begin()->second;
 
-        if (auto& basetexture = kv["$basetexture"])
-            mat.baseTexture = LoadVTF((std::string_view)basetexture);
+        // Copy out what we need, textures can only be requested from the main thread.
+        std::string basetexture, basetexture2;
+        if (auto& value = kv["$basetexture"])
+            basetexture = (std::string_view)value;
+        if (auto& value = kv["$basetexture2"])
+            basetexture2 = (std::string_view)value;
 
-        if (auto& basetexture2 = kv["$basetexture2"])
-            mat.baseTextures[0] = LoadVTF((std::string_view)basetexture2);
+        bool translucent = kv["$translucent"];
+        bool alphatest = kv["$alphatest"];
 
-        mat.translucent = kv["$translucent"];
-        mat.alphatest = kv["$alphatest"];
+        return [=](Material& mat)
+        {
+            if (!basetexture.empty())
+                mat.baseTexture = LoadVTF(basetexture);
+
+            if (!basetexture2.empty())
+                mat.baseTextures[0] = LoadVTF(basetexture2);
+
+            mat.translucent = translucent;
+            mat.alphatest = alphatest;
+        };
     }};
 
 }
@@ -56,7 +56,7 @@ namespace chisel
 
                 if (Assets.FileExists(path.str()))
                 {
-                    mesh.materials.push_back(Assets.Load<Material>(path.str()));
+                    mesh.materials.push_back(Assets.LoadAsync<Material>(path.str()));
                     break;
                 }
 
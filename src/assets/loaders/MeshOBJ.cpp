@@ -18,9 +18,9 @@ namespace chisel
     // 1 hu = 1/16 ft, 1 ft = 30.48 cm, 1 m = 100 cm
     static constexpr float OBJ_MODEL_SCALE = float(100 * (16 / 30.48));
 
-    AssetLoader<Mesh> OBJLoader = { ".OBJ", [](Mesh& mesh, const Buffer& file_data)
+    AssetLoader<Mesh> OBJLoader = { ".OBJ", [](Mesh& mesh, std::span<const byte> file_data)
     {
-        std::string string(&file_data.front(), &file_data.back() + 1);
+        std::string string((const char*)file_data.data(), file_data.size());
 
         ObjReader obj;
 
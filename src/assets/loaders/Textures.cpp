@@ -5,48 +5,47 @@
 #include "stb/stb_image_write.h"
 
 #include "assets/Assets.h"
+#include "assets/ThumbnailCache.h"
+#include "assets/TextureStreamer.h"
+#include "assets/BlockCompression.h"
+#include "console/ConVar.h"
 #include "render/Render.h"
 #include "render/TextureFormat.h"
 #include "common/Bit.h"
+#include "common/String.h"
+#include "common/Filesystem.h"
+#include "common/Hash.h"
 #include "chisel/Engine.h"
 #include "libvtf-plusplus/libvtf++.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
 #include <span>
+#include <thread>
+#include <vector>
 
 namespace chisel
 {
-    static void LoadTexture(Texture& tex, const Buffer& data)
-    {
-        int width, height, channels;
-
-        // 8 bits per channel
-        std::unique_ptr<uint8_t[]> owned_data;
-        owned_data.reset(stbi_load_from_memory(data.data(), int(data.size()), &width, &height, &channels, STBI_rgb_alpha));
+    using TextureFinishFn = AssetLoader<Texture>::AssetFinishFn;
 
-        if (!owned_data)
-            throw std::runtime_error("STB failed to load texture.");
+    static size_t MipBytes(DXGI_FORMAT format, uint width, uint height)
+    {
+        const auto [blockWidth, blockHeight] = GetBlockSize(format);
+        return size_t((width + blockWidth - 1) / blockWidth) * ((height + blockHeight - 1) / blockHeight) * GetElementSize(format);
+    }
 
-        D3D11_TEXTURE2D_DESC desc =
-        {
-            .Width = UINT(width),
-            .Height = UINT(height),
-            .MipLevels = 1,
-            .ArraySize = 1,
-            .Format = DXGI_FORMAT_R8G8B8A8_TYPELESS,
-            .SampleDesc = { 1, 0 },
-            .Usage = D3D11_USAGE_IMMUTABLE,
-            .BindFlags = D3D11_BIND_SHADER_RESOURCE,
-        };
-        D3D11_SUBRESOURCE_DATA initialData =
-        {
-            .pSysMem = owned_data.get(),
-            .SysMemPitch = UINT(width) * 4u,
-            .SysMemSlicePitch = 0,
-        };
-        Engine.rctx.device->CreateTexture2D(&desc, &initialData, &tex.texture);
+    static void CreateViews(Texture& tex, DXGI_FORMAT format)
+    {
         D3D11_SHADER_RESOURCE_VIEW_DESC srvDescLinear =
         {
-            .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+            .Format = format,
             .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
             .Texture2D =
             {
@@ -54,22 +53,326 @@ namespace chisel
                 .MipLevels = UINT(-1),
             },
         };
-        D3D11_SHADER_RESOURCE_VIEW_DESC srvDescSRGB =
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDescSRGB = srvDescLinear;
+        srvDescSRGB.Format = LinearToSRGB(format);
+
+        // Replaces any old views, the context keeps bound ones alive until they're unbound.
+        tex.srvLinear = nullptr;
+        tex.srvSRGB = nullptr;
+        Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescLinear, &tex.srvLinear);
+        Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescSRGB, &tex.srvSRGB);
+    }
+
+    // Halves an RGBA8 image with a 2x2 box filter. Odd edges repeat the last texel.
+    static void HalveRGBA8(Buffer& pixels, uint& width, uint& height)
+    {
+        const uint newWidth  = std::max(width / 2, 1u);
+        const uint newHeight = std::max(height / 2, 1u);
+
+        Buffer halved(size_t(newWidth) * newHeight * 4);
+        for (uint y = 0; y < newHeight; y++)
         {
-            .Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
-            .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
-            .Texture2D =
+            const uint y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (uint x = 0; x < newWidth; x++)
             {
-                .MostDetailedMip = 0,
-                .MipLevels = UINT(-1),
-            },
+                const uint x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (uint c = 0; c < 4; c++)
+                {
+                    uint sum = pixels[(size_t(y0) * width + x0) * 4 + c] + pixels[(size_t(y0) * width + x1) * 4 + c]
+                             + pixels[(size_t(y1) * width + x0) * 4 + c] + pixels[(size_t(y1) * width + x1) * 4 + c];
+                    halved[(size_t(y) * newWidth + x) * 4 + c] = byte((sum + 2) / 4);
+                }
+            }
+        }
+
+        pixels = std::move(halved);
+        width = newWidth;
+        height = newHeight;
+    }
+
+// Block Compression //
+
+    // Read from the loader threads, which mustn't touch the console.
+    static std::atomic<bool> s_CompressTextures = true;
+
+    static ConVar<bool> tex_compress("tex_compress", true,
+        "Block compress PNG and TGA textures with a full mip chain. Results are cached in cache/textures.",
+        [](bool& value) { s_CompressTextures = value; });
+
+    static constexpr const char* CompressedCachePath = "cache/textures";
+    static constexpr uint32 CompressedMagic   = 'C' | ('B' << 8) | ('C' << 16) | ('T' << 24);
+    static constexpr uint32 CompressedVersion = 1;
+
+    struct CompressedHeader
+    {
+        uint32 magic;
+        uint32 version;
+        uint32 format;      // DXGI_FORMAT
+        uint32 width;
+        uint32 height;
+        uint32 mipCount;
+    };
+
+    // Every mip, largest first, tightly packed
+    struct CompressedTexture
+    {
+        DXGI_FORMAT format;
+        uint width, height, mipCount;
+        Buffer data;
+    };
+
+    // D3D11 wants the top mip of a BC texture in whole 4x4 blocks, the smaller mips below it can be anything.
+    static bool CanBlockCompress(uint width, uint height)
+    {
+        return width != 0 && height != 0 && width % 4 == 0 && height % 4 == 0;
+    }
+
+    static size_t CompressedSize(DXGI_FORMAT format, uint width, uint height, uint mipCount)
+    {
+        size_t size = 0;
+        for (uint mip = 0; mip < mipCount; mip++)
+            size += MipBytes(format, std::max(width >> mip, 1u), std::max(height >> mip, 1u));
+        return size;
+    }
+
+    // Keyed by the source file's contents, so edits and renames just work.
+    static fs::Path CompressedCacheFile(std::span<const byte> source)
+    {
+        uint64 hash = FNV_1a<uint64>::offset;
+        for (byte b : source)
+            hash = (hash ^ b) * FNV_1a<uint64>::prime;
+        return fs::Path(CompressedCachePath) / fmt::format("{:016x}-{}.bct", hash, source.size());
+    }
+
+    static std::optional<CompressedTexture> ReadCompressed(const fs::Path& path)
+    {
+        auto file = fs::readFile(path);
+        if (!file)
+            return std::nullopt;
+
+        CompressedHeader header;
+        if (file->size() < sizeof(header))
+            return std::nullopt;
+        memcpy(&header, file->data(), sizeof(header));
+
+        if (header.magic != CompressedMagic || header.version != CompressedVersion)
+            return std::nullopt;
+
+        const DXGI_FORMAT format = DXGI_FORMAT(header.format);
+        if (format != DXGI_FORMAT_BC1_UNORM && format != DXGI_FORMAT_BC3_UNORM)
+            return std::nullopt;
+        if (!CanBlockCompress(header.width, header.height))
+            return std::nullopt;
+        if (header.mipCount == 0 || header.mipCount > 16 || (std::max(header.width, header.height) >> (header.mipCount - 1)) == 0)
+            return std::nullopt;
+        if (file->size() - sizeof(header) != CompressedSize(format, header.width, header.height, header.mipCount))
+            return std::nullopt;
+
+        return CompressedTexture
+        {
+            .format   = format,
+            .width    = header.width,
+            .height   = header.height,
+            .mipCount = header.mipCount,
+            .data     = Buffer(file->begin() + sizeof(header), file->end()),
         };
-        Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescLinear, &tex.srvLinear);
-        Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescSRGB, &tex.srvSRGB);
     }
 
-    static AssetLoader<Texture> PNGLoader = { ".PNG", &LoadTexture };
-    static AssetLoader<Texture> TGALoader = { ".TGA", &LoadTexture };
+    static void WriteCompressed(const fs::Path& path, const CompressedTexture& texture)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(CompressedCachePath, ec);
+
+        // Written aside and renamed, another thread may be reading or writing the same file.
+        std::string temp = fmt::format("{}.{:x}.tmp", std::string_view(path), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+        CompressedHeader header = { CompressedMagic, CompressedVersion, uint32(texture.format), texture.width, texture.height, texture.mipCount };
+        {
+            std::ofstream file(std::filesystem::path(temp), std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(texture.data.data()), std::streamsize(texture.data.size()));
+            if (!file)
+            {
+                file.close();
+                std::filesystem::remove(temp, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(temp, std::filesystem::path(path), ec);
+        if (ec)
+            std::filesystem::remove(temp, ec);
+    }
+
+    // BC3 if anything isn't fully opaque, BC1 otherwise
+    static DXGI_FORMAT ChooseBlockFormat(const byte* pixels, uint width, uint height)
+    {
+        for (size_t i = 3; i < size_t(width) * height * 4; i += 4)
+        {
+            if (pixels[i] != 255)
+                return DXGI_FORMAT_BC3_UNORM;
+        }
+        return DXGI_FORMAT_BC1_UNORM;
+    }
+
+    // Mips are box filtered. Only for sizes CanBlockCompress allows.
+    static CompressedTexture Compress(const byte* pixels, uint width, uint height)
+    {
+        CompressedTexture texture =
+        {
+            .format   = ChooseBlockFormat(pixels, width, height),
+            .width    = width,
+            .height   = height,
+            .mipCount = uint(std::bit_width(std::max(width, height))),
+        };
+        texture.data.reserve(CompressedSize(texture.format, width, height, texture.mipCount));
+
+        Buffer mip(pixels, pixels + size_t(width) * height * 4);
+        for (uint i = 0; i < texture.mipCount; i++)
+        {
+            if (i != 0)
+                HalveRGBA8(mip, width, height);
+
+            Buffer blocks = CompressBlocks(mip, width, height, texture.format);
+            texture.data.insert(texture.data.end(), blocks.begin(), blocks.end());
+        }
+        return texture;
+    }
+
+    static TextureFinishFn UploadCompressed(std::shared_ptr<CompressedTexture> compressed)
+    {
+        return [compressed](Texture& tex)
+        {
+            const DXGI_FORMAT format = compressed->format;
+            D3D11_TEXTURE2D_DESC desc =
+            {
+                .Width      = compressed->width,
+                .Height     = compressed->height,
+                .MipLevels  = compressed->mipCount,
+                .ArraySize  = 1,
+                .Format     = LinearToTypeless(format),
+                .SampleDesc = { 1, 0 },
+                .Usage      = D3D11_USAGE_IMMUTABLE,
+                .BindFlags  = D3D11_BIND_SHADER_RESOURCE,
+            };
+
+            std::vector<D3D11_SUBRESOURCE_DATA> mipData;
+            size_t offset = 0;
+            for (uint i = 0; i < compressed->mipCount; i++)
+            {
+                const uint width  = std::max(compressed->width >> i, 1u);
+                const uint height = std::max(compressed->height >> i, 1u);
+                mipData.push_back(
+                {
+                    .pSysMem          = compressed->data.data() + offset,
+                    .SysMemPitch      = UINT((width + 3) / 4) * GetElementSize(format),
+                    .SysMemSlicePitch = 0,
+                });
+                offset += MipBytes(format, width, height);
+            }
+
+            Com<ID3D11Texture2D> texture;
+            if (FAILED(Engine.rctx.device->CreateTexture2D(&desc, mipData.data(), &texture)))
+                throw std::runtime_error("Failed to create compressed texture.");
+
+            tex.texture = texture;
+            CreateViews(tex, format);
+        };
+    }
+
+// PNG / TGA //
+
+    static TextureFinishFn UploadRGBA8(std::shared_ptr<stbi_uc> pixels, int width, int height)
+    {
+        return [pixels, width, height](Texture& tex)
+        {
+            D3D11_TEXTURE2D_DESC desc =
+            {
+                .Width = UINT(width),
+                .Height = UINT(height),
+                .MipLevels = 1,
+                .ArraySize = 1,
+                .Format = DXGI_FORMAT_R8G8B8A8_TYPELESS,
+                .SampleDesc = { 1, 0 },
+                .Usage = D3D11_USAGE_IMMUTABLE,
+                .BindFlags = D3D11_BIND_SHADER_RESOURCE,
+            };
+            D3D11_SUBRESOURCE_DATA initialData =
+            {
+                .pSysMem = pixels.get(),
+                .SysMemPitch = UINT(width) * 4u,
+                .SysMemSlicePitch = 0,
+            };
+            if (FAILED(Engine.rctx.device->CreateTexture2D(&desc, &initialData, &tex.texture)))
+                throw std::runtime_error("Failed to create texture.");
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDescLinear =
+            {
+                .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+                .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
+                .Texture2D =
+                {
+                    .MostDetailedMip = 0,
+                    .MipLevels = UINT(-1),
+                },
+            };
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDescSRGB =
+            {
+                .Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+                .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
+                .Texture2D =
+                {
+                    .MostDetailedMip = 0,
+                    .MipLevels = UINT(-1),
+                },
+            };
+            Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescLinear, &tex.srvLinear);
+            Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescSRGB, &tex.srvSRGB);
+        };
+    }
+
+    static std::shared_ptr<stbi_uc> LoadRGBA8(std::span<const byte> data, int& width, int& height)
+    {
+        int channels;
+
+        // 8 bits per channel
+        std::shared_ptr<stbi_uc> pixels(
+            stbi_load_from_memory(data.data(), int(data.size()), &width, &height, &channels, STBI_rgb_alpha),
+            stbi_image_free);
+
+        if (!pixels)
+            throw std::runtime_error("STB failed to load texture.");
+
+        return pixels;
+    }
+
+    static TextureFinishFn DecodeTexture(std::span<const byte> data)
+    {
+        if (!s_CompressTextures)
+        {
+            int width, height;
+            std::shared_ptr<stbi_uc> pixels = LoadRGBA8(data, width, height);
+            return UploadRGBA8(std::move(pixels), width, height);
+        }
+
+        // Compressing is slow, but only has to happen once per texture.
+        fs::Path cacheFile = CompressedCacheFile(data);
+        std::optional<CompressedTexture> compressed = ReadCompressed(cacheFile);
+        if (!compressed)
+        {
+            int width, height;
+            std::shared_ptr<stbi_uc> pixels = LoadRGBA8(data, width, height);
+
+            // Odd sizes, like 1x1 and 2x2 placeholders, stay uncompressed
+            if (!CanBlockCompress(uint(width), uint(height)))
+                return UploadRGBA8(std::move(pixels), width, height);
+
+            compressed = Compress(pixels.get(), uint(width), uint(height));
+            WriteCompressed(cacheFile, *compressed);
+        }
+        return UploadCompressed(std::make_shared<CompressedTexture>(std::move(*compressed)));
+    }
+
+    static AssetLoader<Texture> PNGLoader = { ".PNG", &DecodeTexture };
+    static AssetLoader<Texture> TGALoader = { ".TGA", &DecodeTexture };
 
     inline DXGI_FORMAT RemapVTFImageFormat(libvtf::ImageFormat format)
     {
@@ -77,78 +380,419 @@ namespace chisel
         {
         case libvtf::ImageFormats::RGBA8888:       return DXGI_FORMAT_R8G8B8A8_UNORM;
         case libvtf::ImageFormats::BGRA8888:       return DXGI_FORMAT_B8G8R8A8_UNORM;
+        case libvtf::ImageFormats::BGRX8888:       return DXGI_FORMAT_B8G8R8X8_UNORM;
         case libvtf::ImageFormats::BGR565:         return DXGI_FORMAT_B5G6R5_UNORM;
         case libvtf::ImageFormats::DXT1_RUNTIME: [[fallthrough]];
+        case libvtf::ImageFormats::DXT1_ONEBITALPHA: [[fallthrough]];
         case libvtf::ImageFormats::DXT1:           return DXGI_FORMAT_BC1_UNORM;
         case libvtf::ImageFormats::DXT3:           return DXGI_FORMAT_BC2_UNORM;
         case libvtf::ImageFormats::DXT5:           return DXGI_FORMAT_BC3_UNORM;
         case libvtf::ImageFormats::R32F:           return DXGI_FORMAT_R32_FLOAT;
         case libvtf::ImageFormats::RG3232F:        return DXGI_FORMAT_R32G32_FLOAT;
+        case libvtf::ImageFormats::RGBA16161616F:  return DXGI_FORMAT_R16G16B16A16_FLOAT;
         case libvtf::ImageFormats::RGBA32323232F:  return DXGI_FORMAT_R32G32B32A32_FLOAT;
         default: throw std::runtime_error("Cannot remap format!");
         }
     }
 
-    static AssetLoader<Texture> VTFLoader = { ".VTF", [](Texture& tex, const Buffer& data)
+    // Mips [firstMip, numMipLevels) of a VTF, pointing into its image data.
+    struct VTFMips
     {
-        // TODO: Make copy-less.
-        libvtf::VTFData vtfData(data);
+        D3D11_TEXTURE2D_DESC desc;
+        DXGI_FORMAT format;
+        std::vector<D3D11_SUBRESOURCE_DATA> data;
+    };
 
-        const auto& header = vtfData.getHeader();
+    static VTFMips GetVTFMips(libvtf::VTFData& vtf, uint firstMip)
+    {
+        const auto& header = vtf.getHeader();
 
-        DXGI_FORMAT format = RemapVTFImageFormat(header.format);
+        VTFMips mips;
+        mips.format = RemapVTFImageFormat(header.format);
 
-        D3D11_TEXTURE2D_DESC desc =
+        auto [width, height, _] = libvtf::adjustImageSizeByMip(header.width, header.height, 1u, firstMip);
+        mips.desc =
         {
-            .Width      = header.width,
-            .Height     = header.height,
-            .MipLevels  = header.numMipLevels,
+            .Width      = UINT(width),
+            .Height     = UINT(height),
+            .MipLevels  = UINT(header.numMipLevels - firstMip),
             .ArraySize  = 1,//header.depth,
-            .Format     = LinearToTypeless(format),
+            .Format     = LinearToTypeless(mips.format),
             .SampleDesc = { 1, 0 },
             .Usage      = D3D11_USAGE_IMMUTABLE,
             .BindFlags  = D3D11_BIND_SHADER_RESOURCE,
         };
-        std::vector<D3D11_SUBRESOURCE_DATA> mipData;
-        for (uint8_t i = 0; i < header.numMipLevels; i++)
-        {
-            const uint32_t blockSize = GetBlockSize(desc.Format).first;
 
-            std::span<const uint8_t> data = vtfData.imageData(0, 0, i);
+        const uint32_t blockSize = GetBlockSize(mips.desc.Format).first;
+        for (uint i = firstMip; i < header.numMipLevels; i++)
+        {
+            std::span<const uint8_t> data = vtf.imageData(0, 0, i);
 
-            auto [width, _, __] = libvtf::adjustImageSizeByMip(header.width, header.height, 1u, i);
-            width = align(width, blockSize);
+            auto [mipWidth, __, ___] = libvtf::adjustImageSizeByMip(header.width, header.height, 1u, i);
+            mipWidth = align(mipWidth, blockSize);
 
             D3D11_SUBRESOURCE_DATA initialData =
             {
                 .pSysMem          = data.data(),
-                .SysMemPitch      = (width / blockSize) * GetElementSize(desc.Format),
+                .SysMemPitch      = UINT(mipWidth / blockSize) * GetElementSize(mips.desc.Format),
                 .SysMemSlicePitch = 0,
             };
-            mipData.push_back(initialData);
+            mips.data.push_back(initialData);
         }
-        Engine.rctx.device->CreateTexture2D(&desc, mipData.data(), &tex.texture);
-        D3D11_SHADER_RESOURCE_VIEW_DESC srvDescLinear =
+        return mips;
+    }
+
+    static bool CreateVTFTexture(Texture& tex, const VTFMips& mips)
+    {
+        Com<ID3D11Texture2D> texture;
+        if (FAILED(Engine.rctx.device->CreateTexture2D(&mips.desc, mips.data.data(), &texture)))
+            return false;
+
+        tex.texture = texture;
+        CreateViews(tex, mips.format);
+        return true;
+    }
+
+    static AssetLoader<Texture> VTFLoader = { ".VTF", [](std::span<const byte> data) -> TextureFinishFn
+    {
+        // TODO: Make copy-less. VTFData wants to own its buffer, this is the one copy
+        // left between the pak mapping and the texture upload.
+        auto vtfData = std::make_shared<libvtf::VTFData>(Buffer(data.begin(), data.end()));
+
+        // Fail here rather than on the main thread
+        RemapVTFImageFormat(vtfData->getHeader().format);
+
+        // The upload points into vtfData, which it keeps alive.
+        return [vtfData](Texture& tex)
         {
-            .Format = format,
-            .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
-            .Texture2D =
-            {
-                .MostDetailedMip = 0,
-                .MipLevels = UINT(-1),
-            },
+            const auto& header = vtfData->getHeader();
+            const uint2 size = uint2(header.width, header.height);
+
+            // Start with the small mips, the rest stream in once the texture is seen up close.
+            const uint firstMip = TextureStreamer.InitialMip(size, header.numMipLevels);
+            if (!CreateVTFTexture(tex, GetVTFMips(*vtfData, firstMip)))
+                throw std::runtime_error("Failed to create VTF texture.");
+
+            tex.mipCount    = uint8(header.numMipLevels);
+            tex.residentMip = uint8(firstMip);
+            tex.fullSize    = size;
         };
-        D3D11_SHADER_RESOURCE_VIEW_DESC srvDescSRGB =
+    }};
+
+// Mip Streaming //
+
+    static ConVar<bool> tex_streaming("tex_streaming", true, "Load only the small mips of VTFs up front, and stream the rest in when they're seen up close.");
+    static ConVar<int>  tex_stream_min_size("tex_stream_min_size", 128, "Size in texels of the largest mip VTFs are first loaded with.");
+    static ConVar<int>  tex_stream_budget("tex_stream_budget", 512, "Megabytes of streamed in mips before the least recently drawn textures drop theirs.");
+
+    // Few enough that a texture coming into view never waits behind many others
+    static constexpr uint MaxStreamsInFlight = 4;
+
+    static uint32 RefCount(Texture* tex)
+    {
+        return (tex->incRef(), tex->decRef());
+    }
+
+    // Bytes of mips [firstMip, mipCount) of a texture this size
+    static size_t ChainBytes(DXGI_FORMAT format, uint2 size, uint firstMip, uint mipCount)
+    {
+        size_t bytes = 0;
+        for (uint mip = firstMip; mip < mipCount; mip++)
+            bytes += MipBytes(format, std::max(size.x >> mip, 1u), std::max(size.y >> mip, 1u));
+        return bytes;
+    }
+
+    // The most detailed mip at or above 'mip' that can be the top of a chain. Block compressed
+    // ones need it in whole 4x4 blocks, the rest are held to the same so any format is safe.
+    static uint TopMipAtOrAbove(uint2 size, uint mip)
+    {
+        while (mip > 0 && !CanBlockCompress(std::max(size.x >> mip, 1u), std::max(size.y >> mip, 1u)))
+            mip--;
+        return mip;
+    }
+
+    uint TextureStreamer::InitialMip(uint2 size, uint mipCount) const
+    {
+        if (!tex_streaming || mipCount <= 1)
+            return 0;
+
+        const uint minSize = uint(std::max(tex_stream_min_size.value, 1));
+        uint mip = 0;
+        while (mip + 1 < mipCount && std::max(size.x >> mip, size.y >> mip) > minSize)
+            mip++;
+        return TopMipAtOrAbove(size, mip);
+    }
+
+    void TextureStreamer::Touch(Texture* tex, float texelsPerPixel, float pixels)
+    {
+        if (!tex || !tex->mipCount || !*tex)
+            return;
+
+        // Enough detail for one texel per pixel
+        uint wantedMip = texelsPerPixel > 1.0f ? uint(std::log2(texelsPerPixel)) : 0u;
+        wantedMip = TopMipAtOrAbove(tex->fullSize, std::min(wantedMip, uint(tex->mipCount - 1)));
+
+        // Fully resident textures only need tracking once they have something to give back.
+        if (wantedMip >= tex->residentMip && !m_streamed.contains(tex))
+            return;
+
+        if (auto it = m_touched.find(tex); it != m_touched.end())
         {
-            .Format = LinearToSRGB(format),
-            .ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D,
-            .Texture2D =
+            it->second.wantedMip = std::min(it->second.wantedMip, wantedMip);
+            it->second.pixels = std::max(it->second.pixels, pixels);
+        }
+        else
+        {
+            m_touched.emplace(tex, Touched{ tex, wantedMip, pixels });
+        }
+    }
+
+    size_t TextureStreamer::StreamedBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& [tex, entry] : m_streamed)
+        {
+            if (tex->residentMip < InitialMip(tex->fullSize, tex->mipCount))
+                bytes += tex->GetMemoryUsage();
+        }
+        return bytes;
+    }
+
+    void TextureStreamer::Update()
+    {
+        const Time::Frames frame = Time.frameCount;
+
+        // Forget textures nobody else uses any more, Assets' retained list doesn't count
+        std::erase_if(m_streamed, [](const auto& pair)
+        {
+            Texture* tex = pair.second.tex.ptr();
+            return !pair.second.loading && RefCount(tex) == 1 + Assets.IsRetained(tex);
+        });
+
+        // Largest on screen first
+        std::vector<Touched*> wanted;
+        for (auto& [tex, touched] : m_touched)
+        {
+            if (auto it = m_streamed.find(tex); it != m_streamed.end())
+                it->second.lastUsed = frame;
+            if (touched.wantedMip < tex->residentMip)
+                wanted.push_back(&touched);
+        }
+        std::sort(wanted.begin(), wanted.end(), [](const Touched* a, const Touched* b) { return a->pixels > b->pixels; });
+
+        const size_t budget = size_t(std::max(tex_stream_budget.value, 0)) * 1024 * 1024;
+        size_t used = StreamedBytes();
+
+        for (Touched* touched : wanted)
+        {
+            if (m_inFlight >= MaxStreamsInFlight)
+                break;
+
+            Texture* tex = touched->tex.ptr();
+            auto [it, inserted] = m_streamed.try_emplace(tex, Streamed{ touched->tex, frame });
+            Streamed& entry = it->second;
+            if (entry.loading || entry.failed)
+                continue;
+
+            D3D11_TEXTURE2D_DESC desc;
+            tex->texture->GetDesc(&desc);
+            const size_t needed = ChainBytes(desc.Format, tex->fullSize, touched->wantedMip, tex->mipCount);
+            const size_t extra = needed - std::min(needed, tex->GetMemoryUsage());
+
+            // Make room by dropping what hasn't been drawn lately, oldest first.
+            while (used + extra > budget)
             {
-                .MostDetailedMip = 0,
-                .MipLevels = UINT(-1),
-            },
+                Streamed* victim = nullptr;
+                for (auto& [other, candidate] : m_streamed)
+                {
+                    if (candidate.loading || candidate.lastUsed + 1 >= frame)
+                        continue;
+                    if (other->residentMip >= InitialMip(other->fullSize, other->mipCount))
+                        continue;
+                    if (!victim || candidate.lastUsed < victim->lastUsed)
+                        victim = &candidate;
+                }
+
+                if (!victim)
+                    break;
+
+                Texture* other = victim->tex.ptr();
+                const size_t before = other->GetMemoryUsage();
+                DropMips(other, InitialMip(other->fullSize, other->mipCount));
+                used -= std::min(used, before - std::min(before, other->GetMemoryUsage()));
+            }
+
+            // Smaller textures further down may still fit
+            if (used + extra > budget)
+                continue;
+
+            used += extra;
+            StreamIn(entry, touched->wantedMip);
+        }
+
+        m_touched.clear();
+    }
+
+    void TextureStreamer::StreamIn(Streamed& entry, uint mip)
+    {
+        // The entry keeps the texture alive while loading, so the jobs never hold the last reference.
+        Texture* tex = entry.tex.ptr();
+        entry.loading = true;
+        m_inFlight++;
+
+        auto done = [this, tex](bool failed)
+        {
+            m_inFlight--;
+            if (auto it = m_streamed.find(tex); it != m_streamed.end())
+            {
+                it->second.loading = false;
+                it->second.failed |= failed;
+            }
         };
-        Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescLinear, &tex.srvLinear);
-        Engine.rctx.device->CreateShaderResourceView(tex.texture.ptr(), &srvDescSRGB, &tex.srvSRGB);
-    }};
+
+        // Only what the worker compares against, the texture itself changes on the main thread.
+        const uint mipCount = tex->mipCount;
+        const uint2 fullSize = tex->fullSize;
+
+        bool queued = Assets.ReadAsync(tex->GetPath(), [tex, mip, mipCount, fullSize, done](std::span<const byte> data) -> std::function<void()>
+        {
+            auto vtfData = std::make_shared<libvtf::VTFData>(Buffer(data.begin(), data.end()));
+
+            const auto& header = vtfData->getHeader();
+            if (header.numMipLevels != mipCount || header.width != fullSize.x || header.height != fullSize.y)
+                throw std::runtime_error("VTF changed since it was loaded");
+            RemapVTFImageFormat(header.format);
+
+            return [tex, mip, vtfData, done]
+            {
+                bool created = CreateVTFTexture(*tex, GetVTFMips(*vtfData, mip));
+                if (created)
+                {
+                    tex->residentMip = uint8(mip);
+                    Assets.Account(tex);
+                }
+                done(!created);
+            };
+        }, [done] { done(true); });
+
+        if (!queued)
+            done(true);
+    }
+
+    void TextureStreamer::DropMips(Texture* tex, uint mip)
+    {
+        if (mip <= tex->residentMip)
+            return;
+
+        // Copied down on the GPU, the file doesn't need reading again.
+        D3D11_TEXTURE2D_DESC desc;
+        tex->texture->GetDesc(&desc);
+
+        const uint skip = mip - tex->residentMip;
+        if (skip >= desc.MipLevels)
+            return;
+
+        desc.Width     = std::max(desc.Width >> skip, 1u);
+        desc.Height    = std::max(desc.Height >> skip, 1u);
+        desc.MipLevels = desc.MipLevels - skip;
+        desc.Usage     = D3D11_USAGE_DEFAULT;
+
+        Com<ID3D11Texture2D> smaller;
+        if (FAILED(Engine.rctx.device->CreateTexture2D(&desc, nullptr, &smaller)))
+            return;
+
+        for (uint i = 0; i < desc.MipLevels; i++)
+            Engine.rctx.ctx->CopySubresourceRegion(smaller.ptr(), i, 0, 0, 0, tex->texture.ptr(), i + skip, nullptr);
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        tex->srvLinear->GetDesc(&srvDesc);
+
+        tex->texture = smaller;
+        CreateViews(*tex, srvDesc.Format);
+        tex->residentMip = uint8(mip);
+        Assets.Account(tex);
+    }
+
+// Thumbnails //
+
+    // Block compresses an RGBA8 thumbnail in place. Left alone if the size doesn't allow it.
+    static void CompressThumbnail(Thumbnail& thumb)
+    {
+        if (!CanBlockCompress(thumb.width, thumb.height))
+            return;
+
+        thumb.format = ChooseBlockFormat(thumb.data.data(), thumb.width, thumb.height);
+        thumb.data   = CompressBlocks(thumb.data, thumb.width, thumb.height, thumb.format);
+    }
+
+    Thumbnail DecodeThumbnail(std::span<const byte> data, std::string_view ext, uint maxSize)
+    {
+        Thumbnail thumb;
+
+        if (str::toLower(ext) == ".vtf")
+        {
+            // Take the largest mip that fits as-is, so compressed textures stay compressed.
+            libvtf::VTFData vtf(Buffer(data.begin(), data.end()));
+            const auto& header = vtf.getHeader();
+
+            thumb.format = RemapVTFImageFormat(header.format);
+            const uint32_t blockSize = GetBlockSize(thumb.format).first;
+
+            uint8_t mip = 0;
+            for (; mip + 1 < header.numMipLevels; mip++)
+            {
+                auto [width, height, _] = libvtf::adjustImageSizeByMip(header.width, header.height, 1u, mip);
+                if (width <= maxSize && height <= maxSize)
+                    break;
+
+                // Don't go below a whole block
+                auto [nextWidth, nextHeight, __] = libvtf::adjustImageSizeByMip(header.width, header.height, 1u, mip + 1);
+                if (nextWidth < blockSize || nextHeight < blockSize)
+                    break;
+            }
+
+            auto [width, height, _] = libvtf::adjustImageSizeByMip(header.width, header.height, 1u, mip);
+            std::span<const uint8_t> image = vtf.imageData(0, 0, mip);
+
+            thumb.width  = uint16(width);
+            thumb.height = uint16(height);
+            thumb.data   = Buffer(image.begin(), image.end());
+
+            // Uncompressed VTFs get compressed like PNG and TGA
+            if (thumb.format == DXGI_FORMAT_B8G8R8A8_UNORM || thumb.format == DXGI_FORMAT_B8G8R8X8_UNORM)
+            {
+                const bool opaque = thumb.format == DXGI_FORMAT_B8G8R8X8_UNORM;
+                for (size_t i = 0; i + 3 < thumb.data.size(); i += 4)
+                {
+                    std::swap(thumb.data[i], thumb.data[i + 2]);
+                    if (opaque)
+                        thumb.data[i + 3] = 255;
+                }
+                thumb.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            }
+            if (thumb.format == DXGI_FORMAT_R8G8B8A8_UNORM)
+                CompressThumbnail(thumb);
+            return thumb;
+        }
+
+        int width, height, channels;
+        std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels(
+            stbi_load_from_memory(data.data(), int(data.size()), &width, &height, &channels, STBI_rgb_alpha),
+            stbi_image_free);
+
+        if (!pixels)
+            throw std::runtime_error("STB failed to load texture.");
+
+        uint w = uint(width), h = uint(height);
+        Buffer rgba(pixels.get(), pixels.get() + size_t(w) * h * 4);
+        while (w > maxSize || h > maxSize)
+            HalveRGBA8(rgba, w, h);
+
+        thumb.width  = uint16(w);
+        thumb.height = uint16(h);
+        thumb.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        thumb.data   = std::move(rgba);
+        CompressThumbnail(thumb);
+        return thumb;
+    }
 }
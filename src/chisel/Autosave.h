@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common/System.h"
+#include "common/Time.h"
+#include "console/ConVar.h"
+#include "chisel/Chisel.h"
+
+namespace chisel
+{
+    inline ConVar<float> autosave_interval("autosave_interval", 300.0f, "Seconds between autosaves. 0 disables autosave.");
+
+    /**
+     * Finishes off background saves and periodically autosaves the map.
+     * Autosaves go through the same snapshot + worker path as a regular save.
+     */
+    struct Autosave : System
+    {
+        static constexpr const char* Path = "autosave.box";
+
+        void Start() override
+        {
+            lastSave = Time.unscaled.time;
+        }
+
+        void Update() override
+        {
+            Chisel.PollSave();
+
+            if (autosave_interval.value <= 0.0f)
+                return;
+
+            if (Time.unscaled.time - lastSave < autosave_interval.value)
+                return;
+
+            // Don't stall the frame waiting on a save that's still running.
+            if (Chisel.IsSaving())
+                return;
+
+            lastSave = Time.unscaled.time;
+            if (Chisel.HasUnsavedChanges() && Map::EditGeneration() != lastGeneration)
+            {
+                lastGeneration = Map::EditGeneration();
+                Chisel.Save(Path, true);
+            }
+        }
+
+    private:
+        Time::Seconds lastSave = 0;
+        uint64 lastGeneration = 0;
+    };
+}
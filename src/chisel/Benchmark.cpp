@@ -0,0 +1,238 @@
+#include "chisel/Benchmark.h"
+#include "chisel/Chisel.h"
+#include "chisel/FGD/FGD.h"
+#include "chisel/formats/Formats.h"
+#include "common/Filesystem.h"
+#include "common/Time.h"
+#include "console/Console.h"
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+
+namespace chisel
+{
+    struct Summary
+    {
+        double min, median, mean, stddev, max;
+    };
+
+    static Summary Summarise(std::vector<double> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+
+        const size_t n = samples.size();
+        Summary summary;
+        summary.min    = samples.front();
+        summary.max    = samples.back();
+        summary.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+        summary.mean   = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+
+        double variance = 0;
+        for (double sample : samples)
+            variance += (sample - summary.mean) * (sample - summary.mean);
+        summary.stddev = n > 1 ? std::sqrt(variance / (n - 1)) : 0;
+
+        return summary;
+    }
+
+    // Times fn() after one warm up run, with setup() untimed before every run.
+    // Empty if fn() fails.
+    static std::vector<double> Measure(uint iterations, auto setup, auto fn)
+    {
+        std::vector<double> samples;
+        samples.reserve(iterations);
+
+        for (uint i = 0; i <= iterations; i++)
+        {
+            setup();
+
+            Time::Seconds start = Time::GetTime();
+            if (!fn())
+                return {};
+            Time::Seconds end = Time::GetTime();
+
+            if (i != 0)
+                samples.push_back((end - start) * 1000.0);
+        }
+        return samples;
+    }
+
+    static fs::Path TempPath(std::string_view name)
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "chisel-benchmark";
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        return fs::Path(dir / name);
+    }
+
+    void Benchmark::Run(std::string_view map, const BenchmarkOptions& options)
+    {
+        // The VMF importer needs to know which classes are props.
+        if (!Chisel.fgd)
+            Chisel.fgd = new FGD("core/test.fgd");
+
+        std::string name = std::filesystem::path(map).stem().string();
+        RunStages(map, name, 1, options);
+
+        if (options.tile > 1)
+        {
+            uint scale = options.tile * options.tile;
+            fs::Path tiled = TempPath(fmt::format("{}_x{}.vmf", name, scale));
+            if (WriteTiled(map, tiled, options.tile))
+                RunStages(tiled, name, scale, options);
+            else
+                Console.Error("[Benchmark] Failed to tile '{}'", map);
+        }
+
+        Chisel.CloseMap();
+    }
+
+    void Benchmark::RunStages(std::string_view path, std::string_view name, uint scale, const BenchmarkOptions& options)
+    {
+        auto text = fs::readTextFile(path);
+        if (!text)
+        {
+            Console.Error("[Benchmark] Can't read '{}'", path);
+            return;
+        }
+
+        Chisel.CloseMap();
+        if (!ImportVMF(path, Chisel.map))
+        {
+            Console.Error("[Benchmark] Failed to import '{}'", path);
+            return;
+        }
+
+        size_t brushes = 0;
+        Chisel.map.ForEachBrush([&](Solid&) { brushes++; });
+
+        const uint n = options.iterations;
+        auto record = [&](std::string_view stage, std::vector<double> samples)
+        {
+            if (samples.empty())
+            {
+                Console.Error("[Benchmark] {} x{}: {} failed", name, scale, stage);
+                return false;
+            }
+
+            Summary s = Summarise(samples);
+            Console.Log("[Benchmark] {} x{} {:<10} median {:8.2f}ms  min {:8.2f}ms  max {:8.2f}ms  stddev {:6.2f}ms",
+                name, scale, stage, s.median, s.min, s.max, s.stddev);
+
+            m_results.push_back(Result{ std::string(name), scale, brushes, std::string(stage), std::move(samples) });
+            return true;
+        };
+
+        // Parsing alone, VMF import includes it
+        std::unique_ptr<kv::KeyValues> kv;
+        record("kv_parse", Measure(n, [&] { kv.reset(); }, [&]
+        {
+            kv = kv::KeyValues::ParseFromUTF8(StringView{ *text });
+            return kv != nullptr;
+        }));
+        kv.reset();
+
+        // Leaves the map loaded for the stages below
+        if (!record("vmf_import", Measure(n, [] { Chisel.CloseMap(); }, [&] { return ImportVMF(path, Chisel.map); })))
+            return;
+
+        record("mesh", Measure(n, [] {}, []
+        {
+            BrushUploadScope upload(Chisel.brushAllocator.get());
+            Chisel.map.ForEachBrush([](Solid& solid) { solid.UpdateMesh(); });
+            return true;
+        }));
+
+        MapSnapshot snapshot = Chisel.map.Snapshot();
+        fs::Path vmfPath = TempPath(fmt::format("{}_x{}_out.vmf", name, scale));
+        fs::Path boxPath = TempPath(fmt::format("{}_x{}_out.box", name, scale));
+        fs::Path mapPath = TempPath(fmt::format("{}_x{}_out.map", name, scale));
+
+        record("vmf_export", Measure(n, [] {}, [&] { return ExportVMF(vmfPath, snapshot); }));
+        record("map_export", Measure(n, [] {}, [&] { return ExportMap(mapPath, snapshot); }));
+        if (record("box_export", Measure(n, [] {}, [&] { return ExportBox(boxPath, snapshot); })))
+            record("box_import", Measure(n, [] { Chisel.CloseMap(); }, [&] { return ImportBox(boxPath, Chisel.map); }));
+    }
+
+    bool Benchmark::WriteTiled(std::string_view path, std::string_view out, uint tile)
+    {
+        Chisel.CloseMap();
+        if (!ImportVMF(path, Chisel.map))
+            return false;
+
+        std::optional<AABB> bounds;
+        std::vector<std::vector<Side>> brushes;
+        Chisel.map.ForEachBrush([&](Solid& solid)
+        {
+            brushes.push_back(solid.GetSides());
+            if (auto brushBounds = solid.GetBounds())
+                bounds = bounds ? AABB::Extend(*bounds, *brushBounds) : *brushBounds;
+        });
+
+        if (!bounds)
+            return false;
+
+        // Copies of the world brushes go side by side with a gap, entities aren't copied.
+        vec3 step = bounds->max - bounds->min + vec3(256.0f);
+        {
+            BrushUploadScope upload(Chisel.brushAllocator.get());
+            for (uint y = 0; y < tile; y++)
+            {
+                for (uint x = 0; x < tile; x++)
+                {
+                    if (x == 0 && y == 0)
+                        continue;
+
+                    mat4x4 offset = glm::translate(glm::identity<mat4x4>(), vec3(step.x * x, step.y * y, 0.0f));
+                    for (const std::vector<Side>& sides : brushes)
+                        Chisel.map.AddBrush(sides).Transform(offset);
+                }
+            }
+        }
+
+        return ExportVMF(out, Chisel.map.Snapshot());
+    }
+
+    bool Benchmark::WriteJSON(std::string_view path) const
+    {
+        json results = json::array();
+        for (const Result& result : m_results)
+        {
+            Summary s = Summarise(result.samples);
+            results.push_back({
+                { "map",        result.map },
+                { "scale",      result.scale },
+                { "brushes",    result.brushes },
+                { "stage",      result.stage },
+                { "iterations", result.samples.size() },
+                { "min",        s.min },
+                { "median",     s.median },
+                { "mean",       s.mean },
+                { "stddev",     s.stddev },
+                { "max",        s.max },
+                { "samples",    result.samples },
+            });
+        }
+
+        json j = {
+            { "version", 1 },
+            { "unit",    "ms" },
+            { "results", results },
+        };
+
+        if (!fs::writeFile(path, j.dump(4)))
+        {
+            Console.Error("[Benchmark] Failed to write '{}'", path);
+            return false;
+        }
+
+        Console.Log("[Benchmark] Wrote '{}'", path);
+        return true;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common/Common.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chisel
+{
+    struct BenchmarkOptions
+    {
+        uint iterations = 10;   // Timed runs of each stage, after one untimed warm up
+        uint tile = 3;          // Also runs each map tiled tile x tile times, 1 to skip that
+    };
+
+    /**
+     * Map I/O benchmarks, run headless with --benchmark.
+     *
+     * Every map is put through KeyValues parsing, VMF import, brush meshing,
+     * and VMF, Box and MAP export, then Box import of what was exported.
+     * Each stage is timed over a number of iterations and summarised with
+     * min, median, mean, standard deviation and max, so runs can be compared
+     * across builds. Larger maps are made by tiling the world brushes of
+     * the input side by side and exporting that as a VMF first.
+     */
+    class Benchmark
+    {
+    public:
+        void Run(std::string_view map, const BenchmarkOptions& options);
+
+        // Writes every result so far as JSON. Times are in milliseconds.
+        bool WriteJSON(std::string_view path) const;
+
+        bool Empty() const { return m_results.empty(); }
+
+    private:
+        struct Result
+        {
+            std::string map;
+            uint scale;
+            size_t brushes;
+            std::string stage;
+            std::vector<double> samples;    // Milliseconds
+        };
+
+        void RunStages(std::string_view path, std::string_view name, uint scale, const BenchmarkOptions& options);
+        bool WriteTiled(std::string_view path, std::string_view out, uint tile);
+
+        std::vector<Result> m_results;
+    };
+}
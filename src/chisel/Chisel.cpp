@@ -8,11 +8,13 @@
 #include "console/Console.h"
 #include "gui/ConsoleWindow.h"
 #include "gui/AssetPicker.h"
+#include "assets/ThumbnailCache.h"
 #include "gui/Layout.h"
 #include "gui/Inspector.h"
 #include "gui/Viewport.h"
 #include "gui/Keybinds.h"
 #include "gui/SettingsWindow.h"
+#include "gui/ProfilerWindow.h"
 
 #include "common/Filesystem.h"
 #include "render/Render.h"
@@ -20,6 +22,8 @@
 #include "formats/Formats.h"
 #include "tools/Tool.h"
 #include "chisel/Settings.h"
+#include "common/Time.h"
+#include "chisel/Autosave.h"
 
 #include <cstring>
 #include <vector>
@@ -47,9 +51,17 @@ namespace chisel
         Engine.systems.AddSystem<Inspector>();
         mainAssetPicker = &Engine.systems.AddSystem<AssetPicker>();
         settingsWindow = &Engine.systems.AddSystem<SettingsWindow>();
+        profilerWindow = &Engine.systems.AddSystem<ProfilerWindow>();
         Engine.systems.AddSystem<Viewport>();
+        Engine.systems.AddSystem<Autosave>();
 
+        // Brush UVs are scaled by texture size, remap faces whose textures just streamed in.
+        Assets.OnLoaded += [](std::span<Asset* const> assets) { Solid::AssetsLoaded(assets); };
+
+        m_savedGeneration = Map::EditGeneration();
         Engine.Loop();
+        WaitForSave();
+        ThumbnailCache.Save();
         Engine.Shutdown();
     }
 
@@ -58,35 +70,115 @@ namespace chisel
         delete fgd;
     }
 
-    void Chisel::Save(std::string_view path)
+    bool ExportSnapshot(std::string_view path, const MapSnapshot& snapshot)
     {
         if (path.ends_with("vmf"))
-            ExportVMF(path, map);
+            return ExportVMF(path, snapshot);
         else if (path.ends_with("box"))
-            ExportBox(path, map);
+            return ExportBox(path, snapshot);
         else if (path.ends_with("map"))
-            ExportMap(path, map);
+            return ExportMap(path, snapshot);
+
+        return false;
+    }
+
+    void Chisel::Save(std::string_view path, bool autosave)
+    {
+        // One save at a time, the exporters aren't reentrant. Rather than
+        // stall the frame on the one in flight, queue this one behind it.
+        if (IsSaving())
+        {
+            if (!autosave)
+                m_queuedSave = std::string(path);
+            return;
+        }
+
+        StartSave(path, autosave);
+    }
 
-        // TODO error handling
+    void Chisel::StartSave(std::string_view path, bool autosave)
+    {
+        m_save.path       = path;
+        m_save.startTime  = Time.GetTime();
+        m_save.generation = Map::EditGeneration();
+        m_save.autosave   = autosave;
+        m_save.snapshot   = std::make_unique<MapSnapshot>(map.Snapshot());
+
+        // Formatting, compression and disk I/O all happen on the worker.
+        // The snapshot stays owned by us and is released in FinishSave.
+        m_save.result = std::async(std::launch::async,
+            [path = m_save.path, snapshot = m_save.snapshot.get()]
+            {
+                return ExportSnapshot(path, *snapshot);
+            });
+    }
+
+    void Chisel::PollSave()
+    {
+        if (!IsSaving())
+            return;
+
+        if (m_save.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            FinishSave();
+    }
+
+    void Chisel::WaitForSave()
+    {
+        // Finishing one can start the queued one
+        while (IsSaving())
+            FinishSave();
+    }
+
+    void Chisel::FinishSave()
+    {
+        bool success = m_save.result.get();
+
+        if (success)
+        {
+            Console.Log("[Save] Saved '{}' in {:.2f}s", m_save.path, Time.GetTime() - m_save.startTime);
+            if (!m_save.autosave)
+                m_savedGeneration = m_save.generation;
+        }
+        else
+        {
+            Console.Error("[Save] Failed to save '{}'", m_save.path);
+        }
+
+        // Drop material references here rather than on the worker.
+        m_save.snapshot.reset();
+
+        if (m_queuedSave)
+        {
+            std::string path = std::move(*m_queuedSave);
+            m_queuedSave.reset();
+            StartSave(path, false);
+        }
     }
 
     void Chisel::CloseMap()
     {
         Selection.Clear();
         map.Clear();
+        m_savedGeneration = Map::EditGeneration();
     }
     
     bool Chisel::LoadMap(std::string_view path)
     {
+        // Loading into a map with edits of its own leaves those unsaved
+        const bool clean = !HasUnsavedChanges();
+
+        bool loaded = false;
         if (path.ends_with("vmf"))
         {
-            return ImportVMF(path, map);
+            loaded = ImportVMF(path, map);
         } else if (path.ends_with("box"))
         {
-            return ImportBox(path, map);
+            loaded = ImportBox(path, map);
         }
 
-        return false;
+        if (loaded && clean)
+            m_savedGeneration = Map::EditGeneration();
+        return loaded;
     }
 
     void Chisel::CreateEntityGallery()
@@ -114,6 +206,8 @@ namespace chisel
 namespace chisel::commands
 {
     static ConCommand quit("quit", "Quit the application", []() {
+        Chisel.WaitForSave();
+        ThumbnailCache.Save();
         Engine.Shutdown();
         exit(0);
     });
@@ -131,5 +225,11 @@ namespace chisel::commands
 int main(int argc, char* argv[])
 {
     using namespace chisel;
+
+    // Any --option means a batch job, see Headless.cpp
+    std::vector<std::string_view> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0].starts_with("--"))
+        return Chisel.RunHeadless(args);
+
     Chisel.Run();
 }
@@ -6,6 +6,12 @@
 #include "chisel/Chisel.h"
 #include "chisel/map/Map.h"
 
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
 namespace chisel
 {
     struct MapRender;
@@ -45,8 +51,19 @@ namespace chisel
         */
 
     // File I/O //
-        bool HasUnsavedChanges() { return !map.Empty(); }
-        void Save(std::string_view path);
+        // Edited since it was last saved, opened or closed. Autosaves don't count.
+        bool HasUnsavedChanges() const { return Map::EditGeneration() != m_savedGeneration; }
+
+        // Snapshots the map and writes it out on a worker thread.
+        // If a save is still in flight, this one starts once it's done.
+        // Autosaves are skipped instead.
+        void Save(std::string_view path, bool autosave = false);
+        bool IsSaving() const { return m_save.result.valid(); }
+        // Reports a finished background save. Called every frame.
+        void PollSave();
+        // Blocks until the background save (if any) has finished.
+        void WaitForSave();
+
         void CloseMap();
         bool LoadMap(std::string_view path);
         void CreateEntityGallery();
@@ -58,11 +75,33 @@ namespace chisel
         GUI::Window* console;
         GUI::Window* mainAssetPicker;
         GUI::Window* settingsWindow;
+        GUI::Window* profilerWindow;
 
     // Chisel Engine Loop //
 
         void Run();
 
+        // Batch tools for the command line: no window, no GPU. Returns the exit code.
+        int RunHeadless(std::span<const std::string_view> args);
+
         ~Chisel();
+
+    private:
+        void StartSave(std::string_view path, bool autosave);
+        void FinishSave();
+
+        struct PendingSave
+        {
+            std::string path;
+            std::unique_ptr<MapSnapshot> snapshot;
+            std::future<bool> result;
+            double startTime = 0;
+            uint64 generation = 0;      // Map::EditGeneration when snapshotted
+            bool autosave = false;
+        } m_save;
+
+        // Latest save asked for while another was in flight
+        std::optional<std::string> m_queuedSave;
+        uint64 m_savedGeneration = 0;
     } Chisel;
 }
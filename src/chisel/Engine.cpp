@@ -6,7 +6,10 @@
 #include "chisel/Selection.h"
 #include "gui/Common.h"
 #include "assets/Assets.h"
+#include "assets/TextureStreamer.h"
 #include "core/Primitives.h"
+#include "common/Jobs.h"
+#include "common/Profiler.h"
 
 #include <bit>
 
@@ -45,6 +48,8 @@ namespace chisel
 
         while (!window->ShouldClose())
         {
+            Profiler.BeginFrame();
+
             auto currentTime = Time::GetTime();
             auto deltaTime   = currentTime - lastTime;
             lastTime = currentTime;
@@ -58,6 +63,8 @@ namespace chisel
 
             while (accumulator >= Time.fixed.deltaTime)
             {
+                PROFILE_SCOPE("Tick");
+
                 // Perform fixed updates
                 systems.Tick();
 
@@ -69,27 +76,60 @@ namespace chisel
             // Amount to lerp between physics steps
             [[maybe_unused]] double alpha = accumulator / Time.fixed.deltaTime;
 
-            // Clear buffered input
-            Input.Update();
+            {
+                PROFILE_SCOPE("Input");
+
+                // Clear buffered input
+                Input.Update();
 
-            // Process input
-            window->PreUpdate();
+                // Process input
+                window->PreUpdate();
+            }
+
+            {
+                PROFILE_SCOPE("Texture Streaming");
+
+                // Stream in texture mips for what was drawn last frame
+                TextureStreamer.Update();
+            }
+
+            {
+                PROFILE_SCOPE("Assets");
+
+                // Upload assets finished by the loader threads
+                Assets.Update();
+            }
 
             // Setup to render
             rctx.BeginFrame();
 
-            // Perform system updates
-            systems.Update();
+            {
+                PROFILE_SCOPE("Systems");
+
+                // Perform system updates
+                systems.Update();
+            }
+
+            {
+                PROFILE_SCOPE("End Frame");
+                PROFILE_GPU_SCOPE("GUI");
+
+                // Finish rendering
+                rctx.EndFrame();
+                OnEndFrame(rctx);
+            }
+
+            {
+                PROFILE_SCOPE("Present");
 
-            // Finish rendering
-            rctx.EndFrame();
-            OnEndFrame(rctx);
-            
-            // Present to non-main windows
-            GUI::Present();
+                // Present to non-main windows
+                GUI::Present();
 
-            // Present to main window
-            window->Update();
+                // Present to main window
+                window->Update();
+            }
+
+            Profiler.EndFrame();
 
             Time.frameCount++;
         }
@@ -97,6 +137,9 @@ namespace chisel
 
     void Engine::Shutdown()
     {
+        // Loader threads may still be decoding, stop them before the device goes away
+        Jobs.Stop();
+
         window->OnDetach();
         rctx.Shutdown();
         delete window;
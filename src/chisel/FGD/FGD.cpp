@@ -150,10 +150,10 @@ namespace chisel
                         Expect('(');
                         fs::Path path = fs::Path("materials") / ParseString();
                         path.setExt(".png");
-                        cls.texture = Assets.Load<Texture>(path);
+                        cls.texture = Assets.LoadAsync<Texture>(PathKey(path));
                         if (cls.texture == nullptr) {
                             path.setExt(".vtf");
-                            cls.texture = Assets.Load<Texture>(path);
+                            cls.texture = Assets.LoadAsync<Texture>(PathKey(path));
                         }
                         Expect(')');
                         break;
@@ -170,7 +170,7 @@ namespace chisel
                     {
                         Expect('(');
                         if (cur->type != Tokens.RightParen)
-                            cls.model = Assets.Load<Mesh>(ParseString());
+                            cls.model = Assets.Load<Mesh>(PathKey(ParseString()));
                         else
                             cls.isProp = true;
                         Expect(')');
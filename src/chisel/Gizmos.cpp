@@ -3,6 +3,7 @@
 #include "chisel/Engine.h"
 #include "render/CBuffers.h"
 #include "core/Primitives.h"
+#include <array>
 #include <vector>
 #include <glm/gtx/vector_angle.hpp>
 #include "math/Winding.h"
@@ -13,33 +14,245 @@ namespace chisel
 {
     render::RenderContext& Gizmos::r = Engine.rctx;
 
+// Batching //
+
+    enum class GizmoKind
+    {
+        Lines,      // sh_Color
+        Triangles,  // sh_Color
+        Solid,      // Brush shader
+        Icons,      // Instanced sprites
+    };
+
+    struct GizmoBatch
+    {
+        GizmoKind kind;
+        bool depthTest;
+        SelectionID id;
+        vec4 color;                     // Icons have theirs per instance
+        Texture* icon;
+        const render::Shader* shader;   // Icons only
+        uint first;                     // Into the queue for this kind
+        uint count;
+
+        bool SameState(const GizmoBatch& other) const
+        {
+            if (kind != other.kind || depthTest != other.depthTest)
+                return false;
+            if (kind == GizmoKind::Icons)
+                return icon == other.icon && shader == other.shader && (id == 0) == (other.id == 0);
+            return id == other.id && color == other.color;
+        }
+    };
+
+    template <typename T, uint Capacity>
+    struct GizmoQueue
+    {
+        std::array<T, Capacity> items;
+        uint count = 0;
+        Com<ID3D11Buffer> buffer;
+
+        bool Fits(uint n) const { return count + n <= Capacity; }
+
+        void Create(ID3D11Device1* device)
+        {
+            D3D11_BUFFER_DESC desc = {
+                .ByteWidth      = uint(sizeof(T) * Capacity),
+                .Usage          = D3D11_USAGE_DYNAMIC,
+                .BindFlags      = D3D11_BIND_VERTEX_BUFFER,
+                .CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+            };
+            device->CreateBuffer(&desc, nullptr, &buffer);
+        }
+
+        void Upload(render::RenderContext& r)
+        {
+            if (count)
+                r.UpdateDynamicBuffer(buffer.ptr(), items.data(), sizeof(T) * count);
+        }
+    };
+
+    static GizmoQueue<Primitives::Vertex, 16384> s_colorVertices;
+    static GizmoQueue<VertexSolid, 8192>         s_solidVertices;
+    static GizmoQueue<PointInstance, 4096>       s_icons;
+
+    static std::array<GizmoBatch, 1024> s_batches;
+    static uint s_batchCount = 0;
+
+    // Room for 'n' more of something in 'queue', in a batch like 'batch'.
+    // Returns where to write them.
+    template <typename T, uint Capacity>
+    static T* Queue(GizmoQueue<T, Capacity>& queue, const GizmoBatch& batch, uint n)
+    {
+        if (!queue.Fits(n) || s_batchCount == s_batches.size())
+            Gizmos::Flush();
+
+        // Only the last batch can grow, so everything draws in the order it was queued
+        GizmoBatch* last = s_batchCount ? &s_batches[s_batchCount - 1] : nullptr;
+        if (last && last->SameState(batch) && last->first + last->count == queue.count)
+        {
+            last->count += n;
+        }
+        else
+        {
+            last = &s_batches[s_batchCount++];
+            *last = batch;
+            last->first = queue.count;
+            last->count = n;
+        }
+
+        T* items = &queue.items[queue.count];
+        queue.count += n;
+        return items;
+    }
+
+    void Gizmos::Flush()
+    {
+        if (s_batchCount == 0)
+            return;
+
+        s_colorVertices.Upload(r);
+        s_solidVertices.Upload(r);
+        s_icons.Upload(r);
+
+        for (uint i = 0; i < s_batchCount; i++)
+        {
+            const GizmoBatch& batch = s_batches[i];
+
+            r.SetDepthStencilState(batch.depthTest ? r.Depth.Default.ptr() : r.Depth.Ignore.ptr());
+            r.SetBlendState(batch.id == 0 ? render::BlendFuncs::AlphaNoSelection : render::BlendFuncs::Alpha);
+
+            switch (batch.kind)
+            {
+                case GizmoKind::Lines:
+                case GizmoKind::Triangles:
+                {
+                    const bool lines = batch.kind == GizmoKind::Lines;
+
+                    cbuffers::ObjectState data;
+                    data.model = glm::identity<mat4x4>();
+                    data.color = batch.color;
+                    data.id = 0;
+
+                    r.SetShader(sh_Color);
+                    r.UploadConstBuffer(1, r.cbuffers.object, data);
+                    r.SetRasterState(lines ? r.Raster.SmoothLines.ptr() : r.Raster.Default.ptr());
+                    r.SetPrimitiveTopology(lines ? D3D11_PRIMITIVE_TOPOLOGY_LINELIST : D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                    r.SetVertexBuffer(s_colorVertices.buffer.ptr(), sizeof(Primitives::Vertex));
+                    r.Draw(batch.count, batch.first);
+                    break;
+                }
+                case GizmoKind::Solid:
+                {
+                    cbuffers::BrushState data;
+                    data.color = batch.color;
+                    data.id = batch.id;
+
+                    r.SetShader(Chisel.Renderer->Shaders.Brush);
+                    r.UploadConstBuffer(1, r.cbuffers.brush, data);
+                    r.SetShaderResource(0, Chisel.Renderer->Textures.White->srvSRGB.ptr());
+                    r.SetRasterState(r.Raster.DepthBiased.ptr());
+                    r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                    r.SetVertexBuffer(s_solidVertices.buffer.ptr(), sizeof(VertexSolid));
+                    r.Draw(batch.count, batch.first);
+                    break;
+                }
+                case GizmoKind::Icons:
+                {
+                    // Icons are pixel art
+                    r.SetShader(*batch.shader);
+                    r.SetShaderResource(0, batch.icon->srvSRGB.ptr());
+                    r.SetSampler(0, r.Sample.Point);
+                    r.SetRasterState(r.Raster.Default.ptr());
+                    r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                    r.SetVertexBuffer(Primitives.Quad.ptr(), sizeof(Primitives::Vertex));
+                    r.SetVertexBuffer(s_icons.buffer.ptr(), sizeof(PointInstance), 0, 1);
+                    r.DrawInstanced(6, batch.count, 0, batch.first);
+                    break;
+                }
+            }
+        }
+
+        r.SetSampler(0, r.Sample.Default);
+        r.SetRasterState(r.Raster.Default.ptr());
+        r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        r.SetDepthStencilState(r.Depth.Default.ptr());
+        r.SetBlendState(render::BlendFuncs::Normal);
+
+        Discard();
+    }
+
+    void Gizmos::Discard()
+    {
+        s_colorVertices.count = 0;
+        s_solidVertices.count = 0;
+        s_icons.count = 0;
+        s_batchCount = 0;
+    }
+
+// Gizmos //
+
     void Gizmos::Init()
     {
         icnObsolete = Assets.Load<Texture>("textures/ui/obsolete.png");
         icnHandle   = Assets.Load<Texture>("textures/ui/handle.png");
         sh_Color    = render::Shader(Engine.rctx.device.ptr(), Primitives::Vertex::Layout, "color");
         sh_Sprite   = render::Shader(Engine.rctx.device.ptr(), Primitives::Vertex::Layout, "sprite");
+
+        s_colorVertices.Create(Engine.rctx.device.ptr());
+        s_solidVertices.Create(Engine.rctx.device.ptr());
+        s_icons.Create(Engine.rctx.device.ptr());
     }
 
     void Gizmos::DrawIcon(vec3 pos, Texture* icon, vec3 size, const render::Shader& shader)
     {
-        PreDraw();
+        // Only the stock sprite shaders have instanced versions
+        auto& shaders = Chisel.Renderer->Shaders;
+        const render::Shader* instanced = nullptr;
+        if (&shader == &sh_Sprite)
+            instanced = &shaders.SpriteInstanced;
+        else if (&shader == &shaders.SpriteDebugID)
+            instanced = &shaders.SpriteInstancedDebugID;
+
+        if (!instanced || !instanced->vs)
+        {
+            // Draw what's queued first, so this doesn't land in front of it
+            Flush();
+            DrawIconImmediate(pos, icon, size, shader);
+            return;
+        }
+
+        GizmoBatch batch = { GizmoKind::Icons, depthTest, id, vec4(1), icon, instanced };
+        PointInstance* instance = Queue(s_icons, batch, 1);
+        instance->origin = pos;
+        instance->size   = size.x;
+        instance->color  = color;
+        instance->id     = id;
+    }
+
+    void Gizmos::DrawIconImmediate(vec3 pos, Texture* icon, vec3 size, const render::Shader& shader)
+    {
+        r.SetDepthStencilState(depthTest ? r.Depth.Default.ptr() : r.Depth.Ignore.ptr());
+        r.SetBlendState(id == 0 ? render::BlendFuncs::AlphaNoSelection : render::BlendFuncs::Alpha);
         r.SetShader(shader);
-        r.ctx->PSSetShaderResources(0, 1, &icon->srvSRGB);
+        r.SetShaderResource(0, icon->srvSRGB.ptr());
+        r.SetSampler(0, r.Sample.Point);
 
         cbuffers::ObjectState data;
         data.model = glm::scale(glm::translate(mat4x4(1.0f), pos), size);
         data.color = color;
         data.id = id;
         r.UploadConstBuffer(1, r.cbuffers.object, data);
-        
+
         uint stride = sizeof(Primitives::Vertex);
         uint offset = 0;
-        r.ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        r.ctx->IASetVertexBuffers(0, 1, &Primitives.Quad, &stride, &offset);
-        r.ctx->Draw(6, 0);
+        r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        r.SetVertexBuffer(Primitives.Quad.ptr(), stride, offset);
+        r.Draw(6, 0);
 
-        PostDraw();
+        r.SetSampler(0, r.Sample.Default);
+        r.SetDepthStencilState(r.Depth.Default.ptr());
+        r.SetBlendState(render::BlendFuncs::Normal);
     }
 
     void Gizmos::DrawPoint(vec3 pos)
@@ -47,32 +260,12 @@ namespace chisel
         DrawIcon(pos, icnHandle.ptr(), vec3(16.f));
     }
 
-    // TODO: These should be batched.
     void Gizmos::DrawLine(vec3 start, vec3 end)
     {
-        PreDraw();
-        r.SetShader(sh_Color);
-
-        mat4x4 mtx = glm::translate(mat4x4(1), start);
-        mtx = glm::rotate(mtx, glm::orientedAngle(glm::vec3(1, 0, 0), glm::normalize(end - start), Vectors.Up), glm::vec3(0, 0, 1));
-        mtx = glm::scale(mtx, glm::vec3(glm::distance(start, end), 1.0f, 1.0f));
-
-        cbuffers::ObjectState data;
-        data.model = mtx;
-        data.color = color;
-        data.id = 0;
-        r.UploadConstBuffer(1, r.cbuffers.object, data);
-
-        uint stride = sizeof(Primitives::Vertex);
-        uint offset = 0;
-        r.ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
-        r.ctx->IASetVertexBuffers(0, 1, &Primitives.Line, &stride, &offset);
-        r.SetRasterState(r.Raster.SmoothLines.ptr());
-        r.ctx->Draw(2, 0);
-
-        r.SetRasterState(r.Raster.Default.ptr());
-        r.ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        PostDraw();
+        GizmoBatch batch = { GizmoKind::Lines, depthTest, id, color };
+        Primitives::Vertex* vertices = Queue(s_colorVertices, batch, 2);
+        vertices[0] = { start, vec2(0.0f) };
+        vertices[1] = { end, vec2(0.0f) };
     }
 
     void Gizmos::DrawPlane(const Plane& plane, bool backFace)
@@ -81,16 +274,8 @@ namespace chisel
         if (!PlaneWinding::CreateFromPlane(plane, winding))
             return;
 
-        PreDraw();
-
-        r.SetShader(sh_Color);
-
-        cbuffers::ObjectState data;
-        data.model = glm::identity<mat4x4>();
-        data.color = color;
-        data.id = 0;
-
-        Primitives::Vertex vertices[6];
+        GizmoBatch batch = { GizmoKind::Triangles, depthTest, id, color };
+        Primitives::Vertex* vertices = Queue(s_colorVertices, batch, 6);
         vertices[0].pos = winding.points[backFace ? 2 : 0];
         vertices[0].uv = vec2(0.0f);
         vertices[1].pos = winding.points[1];
@@ -103,18 +288,6 @@ namespace chisel
         vertices[4].uv = vec2(0.0f);
         vertices[5].pos = winding.points[backFace ? 0 : 3];
         vertices[5].uv = vec2(0.0f);
-
-        ID3D11Buffer* buffer = r.scratchVertex.ptr();
-
-        r.UpdateDynamicBuffer(buffer, vertices, sizeof(vertices));
-        r.UploadConstBuffer(1, r.cbuffers.object, data);
-
-        uint stride = sizeof(Primitives::Vertex);
-        uint offset = 0;
-        r.ctx->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
-        r.ctx->Draw(6, 0);
-
-        PostDraw();
     }
 
     void Gizmos::DrawAABB(const AABB& aabb)
@@ -125,7 +298,6 @@ namespace chisel
 
     void Gizmos::DrawBox(std::span<vec3, 8> corners)
     {
-        PreDraw();
         static constexpr std::array<std::array<uint32_t, 4>, 8> CornerIndices =
         {{
             { 5,4,6,7 },
@@ -136,13 +308,8 @@ namespace chisel
             { 2,6,4,0 },
         }};
 
-        r.SetShader(Chisel.Renderer->Shaders.Brush);
-
-        cbuffers::BrushState data;
-        data.color = this->color;
-        data.id = this->id;
-
-        VertexSolid vertices[6 * 6];
+        GizmoBatch batch = { GizmoKind::Solid, depthTest, id, color };
+        VertexSolid* vertices = Queue(s_solidVertices, batch, 6 * 6);
         for (uint32_t i = 0; i < 6; i++)
         {
             vec3 v0 = corners[CornerIndices[i][0]];
@@ -159,21 +326,6 @@ namespace chisel
             vertices[6 * i + 4] = { v2, normal };
             vertices[6 * i + 5] = { v3, normal };
         }
-
-        ID3D11Buffer* buffer = r.scratchVertex.ptr();
-
-        r.SetRasterState(r.Raster.DepthBiased.ptr());
-        r.UpdateDynamicBuffer(buffer, vertices, sizeof(vertices));
-        r.UploadConstBuffer(1, r.cbuffers.brush, data);
-        r.ctx->PSSetShaderResources(0, 1, &Chisel.Renderer->Textures.White->srvSRGB);
-
-        uint stride = sizeof(VertexSolid);
-        uint offset = 0;
-        r.ctx->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
-        r.ctx->Draw(6 * 6, 0);
-
-        r.SetRasterState(r.Raster.Default.ptr());
-        PostDraw();
     }
 
     void Gizmos::DrawBox(vec3 origin, float radius)
@@ -200,8 +352,6 @@ namespace chisel
 
     void Gizmos::DrawWireBox(std::span<vec3, 8> corners)
     {
-        // TODO: Use batched DrawLine instead of this nonsense
-        PreDraw();
         static constexpr std::array<uint, 24> CornerIndices =
         {{
             0, 1,
@@ -221,35 +371,12 @@ namespace chisel
             2, 6,
         }};
 
-        r.SetShader(sh_Color);
-
-        cbuffers::ObjectState data;
-        data.model = glm::identity<mat4x4>();
-        data.color = color;
-        data.id = 0;
-
-        Primitives::Vertex vertices[24];
+        GizmoBatch batch = { GizmoKind::Lines, depthTest, id, color };
+        Primitives::Vertex* vertices = Queue(s_colorVertices, batch, 24);
         for (uint32_t i = 0; i < 24; i++)
         {
             vertices[i] = { corners[CornerIndices[i]], vec2(0.0f) };
         }
-
-        ID3D11Buffer* buffer = r.scratchVertex.ptr();
-
-        r.SetRasterState(r.Raster.SmoothLines.ptr());
-        
-        r.UpdateDynamicBuffer(buffer, vertices, sizeof(vertices));
-        r.UploadConstBuffer(1, r.cbuffers.object, data);
-
-        uint stride = sizeof(Primitives::Vertex);
-        uint offset = 0;
-        r.ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
-        r.ctx->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
-        r.ctx->Draw(24, 0);
-
-        r.SetRasterState(r.Raster.Default.ptr());
-        r.ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        PostDraw();
     }
 
     void Gizmos::Reset()
@@ -257,21 +384,4 @@ namespace chisel
         struct Gizmos g;
         *this = g;
     }
-    
-    void Gizmos::PreDraw()
-    {
-        r.SetDepthStencilState(depthTest ? r.Depth.Default.ptr() : r.Depth.Ignore.ptr());
-
-        if (id == 0)
-            r.SetBlendState(render::BlendFuncs::AlphaNoSelection);
-        else
-            r.SetBlendState(render::BlendFuncs::Alpha);
-    }
-
-    void Gizmos::PostDraw()
-    {
-        r.SetDepthStencilState(r.Depth.Default.ptr());
-
-        r.SetBlendState(render::BlendFuncs::Normal);
-    }
 }
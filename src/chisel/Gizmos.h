@@ -10,6 +10,13 @@
 
 namespace chisel
 {
+    /**
+     * Immediate mode debug drawing for tools and the map view.
+     *
+     * Draw calls are queued and drawn together by Flush, which the views call
+     * once they're done. Consecutive gizmos of the same kind and state share a
+     * batch, and the queue is a fixed size, so nothing is allocated per frame.
+     */
     inline struct Gizmos
     {
         static inline Rc<Texture> icnObsolete;
@@ -36,9 +43,13 @@ namespace chisel
         void DrawWireAABB(const AABB& aabb);
 
         static void Init();
+
+        // Draws everything queued so far into the bound render targets.
+        static void Flush();
+        // Drops everything queued so far without drawing it.
+        static void Discard();
     protected:
-        void PreDraw();
-        void PostDraw();
+        void DrawIconImmediate(vec3 pos, Texture* icon, vec3 size, const render::Shader& shader);
 
         static render::RenderContext& r;
     } Gizmos;
@@ -168,7 +168,7 @@ namespace chisel
         auto& r = Engine.rctx;
         r.SetBlendState(render::BlendFuncs::Alpha);
         r.SetDepthStencilState(r.Depth.LessEqual.ptr());
-        r.ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+        r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
         r.SetRasterState(r.Raster.SmoothLines.ptr());
         r.SetShader(sh_Grid);
 
@@ -194,7 +194,7 @@ namespace chisel
         camState.viewProj = proj * view;
         camState.view = view;
         camState.farZ = glm::min(farZ.x, farZ.y);
-        r.UploadConstBuffer(0, r.cbuffers.camera, camState, render::VertexShader);
+        r.UploadConstBufferDirect(0, r.cbuffers.camera, camState, render::VertexShader);
 
         // Draw each cell
         for (int x = -radius.x; x <= radius.x; x++)
@@ -214,7 +214,7 @@ namespace chisel
         }
 
         r.SetRasterState(r.Raster.Default.ptr());
-        r.ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
         r.SetDepthStencilState(r.Depth.Default.ptr());
         r.SetBlendState(nullptr);
     }
@@ -0,0 +1,469 @@
+#include "chisel/Chisel.h"
+#include "chisel/Benchmark.h"
+#include "chisel/MapGenerator.h"
+#include "chisel/FGD/FGD.h"
+#include "chisel/formats/Formats.h"
+#include "assets/Assets.h"
+#include "console/Console.h"
+#include "common/Jobs.h"
+#include "common/Time.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <unordered_set>
+
+namespace chisel
+{
+    static void PrintUsage()
+    {
+        Console.Log("Usage: chisel [options]");
+        Console.Log("  --convert <in> <out>   Load a .vmf or .box and save it as .vmf, .box or .map");
+        Console.Log("  --validate <map>...    Check maps for broken brushes, exits with 1 if any are found");
+        Console.Log("  --stats <map>...       Print entity, brush and geometry counts");
+        Console.Log("  --roundtrip <map>...   Save and reload maps, exits with 1 if any displacement data changed");
+        Console.Log("  --benchmark <vmf>...   Time parsing, importing, meshing and exporting each map");
+        Console.Log("  --iterations <n>       Timed runs per benchmark stage (default 10)");
+        Console.Log("  --tile <n>             Also benchmark maps tiled n x n times, 1 to skip (default 3)");
+        Console.Log("  --json <path>          Write benchmark results to a JSON file");
+        Console.Log("  --generate <out>...    Write a synthetic map for scaling tests, using these options:");
+        Console.Log("    --brushes <n>        Number of brushes (default 1000)");
+        Console.Log("    --sides <n>          Sides per brush, at least 5 (default 6)");
+        Console.Log("    --displacements <f>  Fraction of brushes with a displacement, VMF only (default 0)");
+        Console.Log("    --entities <n>       Number of point entities (default 0)");
+        Console.Log("    --materials <n>      Number of distinct materials (default 16)");
+        Console.Log("    --seed <n>           Random seed (default 1)");
+        Console.Log("Options can be repeated, eg. --convert a.vmf a.box --convert b.vmf b.box");
+        Console.Log("Settings apply to the jobs after them, eg. --brushes 10 --generate a.vmf --brushes 20 --generate b.vmf");
+    }
+
+    static bool LoadMap(std::string_view path)
+    {
+        Chisel.CloseMap();
+
+        // The VMF importer needs to know which classes are props.
+        if (path.ends_with("vmf") && !Chisel.fgd)
+            Chisel.fgd = new FGD("core/test.fgd");
+
+        Time::Seconds start = Time::GetTime();
+        if (!Chisel.LoadMap(path))
+        {
+            Console.Error("[Headless] Failed to load '{}'", path);
+            return false;
+        }
+
+        Console.Log("[Headless] Loaded '{}' in {:.2f}s", path, Time::GetTime() - start);
+        return true;
+    }
+
+    static bool Convert(std::string_view in, std::string_view out)
+    {
+        if (!LoadMap(in))
+            return false;
+
+        Time::Seconds start = Time::GetTime();
+        if (!ExportSnapshot(out, Chisel.map.Snapshot()))
+        {
+            Console.Error("[Headless] Failed to save '{}'", out);
+            return false;
+        }
+
+        Console.Log("[Headless] Saved '{}' in {:.2f}s", out, Time::GetTime() - start);
+        return true;
+    }
+
+    static bool Validate(std::string_view path)
+    {
+        if (!LoadMap(path))
+            return false;
+
+        // Only the first few of each are listed, broken maps tend to be broken everywhere.
+        static constexpr uint MaxReported = 16;
+        uint problems = 0;
+        auto report = [&](auto format, auto... args)
+        {
+            if (problems++ < MaxReported)
+                Console.Warn(format, args...);
+        };
+
+        uint brushIndex = 0;
+        Chisel.map.ForEachBrush([&](Solid& solid)
+        {
+            for (uint i = 0; i < solid.GetSides().size(); i++)
+            {
+                const Side& side = solid.GetSides()[i];
+                if (side.plane.normal == vec3(0.0f))
+                    report("  Brush {}: side {} has no plane", brushIndex, i);
+                if (side.material == nullptr)
+                    report("  Brush {}: side {} has no material", brushIndex, i);
+            }
+
+            // Sides that clip away to nothing leave fewer faces than a closed convex needs.
+            if (solid.GetFaces().size() < 4)
+                report("  Brush {}: only {} of {} sides have any area", brushIndex, solid.GetFaces().size(), solid.GetSides().size());
+            else if (!solid.GetBounds())
+                report("  Brush {}: has no geometry", brushIndex);
+
+            brushIndex++;
+        });
+
+        for (Entity* entity : Chisel.map.Entities())
+        {
+            if (!entity->IsBrushEntity())
+                continue;
+
+            auto brushes = static_cast<BrushEntity*>(entity)->Brushes();
+            if (brushes.begin() == brushes.end())
+                report("  Brush entity '{}' has no brushes", entity->classname);
+        }
+
+        if (problems > MaxReported)
+            Console.Warn("  ...and {} more", problems - MaxReported);
+
+        if (problems)
+            Console.Error("[Headless] '{}': {} problems", path, problems);
+        else
+            Console.Log("[Headless] '{}': OK", path);
+
+        return problems == 0;
+    }
+
+    static bool Stats(std::string_view path)
+    {
+        if (!LoadMap(path))
+            return false;
+
+        size_t pointEntities = 0, brushEntities = 0;
+        for (Entity* entity : Chisel.map.Entities())
+            (entity->IsBrushEntity() ? brushEntities : pointEntities)++;
+
+        size_t brushes = 0, sides = 0, faces = 0, displacements = 0, vertices = 0, triangles = 0;
+        std::unordered_set<const Material*> materials;
+        std::optional<AABB> bounds;
+        Chisel.map.ForEachBrush([&](Solid& solid)
+        {
+            brushes++;
+            sides += solid.GetSides().size();
+            faces += solid.GetFaces().size();
+
+            for (const Side& side : solid.GetSides())
+            {
+                materials.insert(side.material.ptr());
+                if (side.disp)
+                    displacements++;
+            }
+
+            for (BrushMesh& mesh : solid.GetMeshes())
+            {
+                vertices  += mesh.vertices.size();
+                triangles += mesh.indices.size() / 3;
+            }
+
+            if (auto brushBounds = solid.GetBounds())
+                bounds = bounds ? AABB::Extend(*bounds, *brushBounds) : *brushBounds;
+        });
+
+        Console.Log("[Headless] '{}'", path);
+        Console.Log("  Entities:      {} ({} point, {} brush)", pointEntities + brushEntities, pointEntities, brushEntities);
+        Console.Log("  Brushes:       {}", brushes);
+        Console.Log("  Sides:         {} ({} faces, {} displacements)", sides, faces, displacements);
+        Console.Log("  Materials:     {}", materials.size());
+        Console.Log("  Vertices:      {}", vertices);
+        Console.Log("  Triangles:     {}", triangles);
+        if (bounds)
+        {
+            vec3 size = bounds->max - bounds->min;
+            Console.Log("  Size:          {:g} x {:g} x {:g}", size.x, size.y, size.z);
+        }
+
+        return true;
+    }
+
+    static std::vector<DispInfo> CollectDisplacements()
+    {
+        std::vector<DispInfo> disps;
+        Chisel.map.ForEachBrush([&](Solid& solid)
+        {
+            for (const Side& side : solid.GetSides())
+            {
+                if (side.disp)
+                    disps.push_back(*side.disp);
+            }
+        });
+        return disps;
+    }
+
+    static bool RoundTrip(std::string_view path)
+    {
+        if (!LoadMap(path))
+            return false;
+
+        std::vector<DispInfo> before = CollectDisplacements();
+
+        // Same format as the source, so it's the writer and reader for that format being tested.
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "chisel-roundtrip";
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        std::string saved = (dir / std::filesystem::path(path).filename()).string();
+
+        if (!ExportSnapshot(saved, Chisel.map.Snapshot()))
+        {
+            Console.Error("[Headless] Failed to save '{}'", saved);
+            return false;
+        }
+        if (!LoadMap(saved))
+            return false;
+
+        std::vector<DispInfo> after = CollectDisplacements();
+
+        static constexpr uint MaxReported = 16;
+        uint problems = 0;
+        auto report = [&](auto format, auto... args)
+        {
+            if (problems++ < MaxReported)
+                Console.Warn(format, args...);
+        };
+
+        // Floats are written as text, allow for the last digit
+        static constexpr float Tolerance = 1e-4f;
+        auto same = [](float a, float b) { return std::abs(a - b) <= Tolerance * std::max({ 1.0f, std::abs(a), std::abs(b) }); };
+        auto same3 = [&](vec3 a, vec3 b) { return same(a.x, b.x) && same(a.y, b.y) && same(a.z, b.z); };
+
+        if (before.size() != after.size())
+            report("  {} displacements before saving, {} after", before.size(), after.size());
+
+        for (size_t i = 0; i < std::min(before.size(), after.size()); i++)
+        {
+            const DispInfo& a = before[i];
+            const DispInfo& b = after[i];
+            if (a.power != b.power)
+            {
+                report("  Displacement {}: power {} became {}", i, a.power, b.power);
+                continue;
+            }
+
+            if (!same3(a.startPos, b.startPos))
+                report("  Displacement {}: startposition differs", i);
+            if (!same(a.elevation, b.elevation))
+                report("  Displacement {}: elevation {} became {}", i, a.elevation, b.elevation);
+            if (a.subdiv != b.subdiv || a.flags != b.flags)
+                report("  Displacement {}: subdiv or flags differ", i);
+            if (a.triangleTags != b.triangleTags)
+                report("  Displacement {}: triangle_tags differ", i);
+            if (a.allowedVerts != b.allowedVerts)
+                report("  Displacement {}: allowed_verts differ", i);
+
+            for (size_t v = 0; v < a.verts.size(); v++)
+            {
+                const DispVert& va = a.verts[v];
+                const DispVert& vb = b.verts[v];
+                if (!same3(va.normal, vb.normal) || !same(va.dist, vb.dist) || !same3(va.offset, vb.offset)
+                    || !same3(va.offsetNormal, vb.offsetNormal) || !same(va.alpha, vb.alpha))
+                {
+                    report("  Displacement {}: vertex {} differs", i, v);
+                    break;
+                }
+            }
+        }
+
+        std::filesystem::remove(saved, ec);
+
+        if (problems > MaxReported)
+            Console.Warn("  ...and {} more", problems - MaxReported);
+
+        if (problems)
+            Console.Error("[Headless] '{}': {} displacement differences after saving", path, problems);
+        else
+            Console.Log("[Headless] '{}': {} displacements survived saving", path, before.size());
+
+        return problems == 0;
+    }
+
+    static bool Generate(std::span<const std::string_view> outs, const MapGeneratorOptions& options)
+    {
+        Chisel.CloseMap();
+
+        Time::Seconds start = Time::GetTime();
+        GenerateMap(Chisel.map, options);
+        Console.Log("[Headless] Generated {} brushes in {:.2f}s", options.brushes, Time::GetTime() - start);
+
+        MapSnapshot snapshot = Chisel.map.Snapshot();
+        bool success = true;
+        for (std::string_view out : outs)
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(std::filesystem::path(out).parent_path(), ec);
+
+            start = Time::GetTime();
+            if (!ExportSnapshot(out, snapshot))
+            {
+                Console.Error("[Headless] Failed to save '{}'", out);
+                success = false;
+                continue;
+            }
+            Console.Log("[Headless] Saved '{}' in {:.2f}s", out, Time::GetTime() - start);
+        }
+        return success;
+    }
+
+    static constexpr std::string_view GeneratorSettings[] = { "--brushes", "--sides", "--displacements", "--entities", "--materials", "--seed" };
+    static constexpr std::string_view BenchmarkSettings[] = { "--iterations", "--tile" };
+
+    // Settings only apply to the jobs after them. True if one comes after the last
+    // job it could apply to, and would be silently ignored.
+    static bool SettingAfterJob(std::span<const std::string_view> args, std::span<const std::string_view> settings, std::string_view job)
+    {
+        auto lastJob = std::find(args.rbegin(), args.rend(), job);
+        auto setting = std::find_first_of(args.rbegin(), lastJob, settings.begin(), settings.end());
+        if (setting == lastJob)
+            return false;
+
+        Console.Error("[Headless] {} has to come before the {} it applies to", *setting, job);
+        return true;
+    }
+
+    int Chisel::RunHeadless(std::span<const std::string_view> args)
+    {
+        // Assets are only passed through by path, nothing is read or uploaded.
+        Assets.referencesOnly = true;
+
+        Benchmark benchmark;
+        BenchmarkOptions benchmarkOptions;
+        std::string_view benchmarkJSON;
+        MapGeneratorOptions generatorOptions;
+
+        // Checked up front, so a mistake doesn't show only after every job has run.
+        if (SettingAfterJob(args, GeneratorSettings, "--generate") || SettingAfterJob(args, BenchmarkSettings, "--benchmark"))
+        {
+            PrintUsage();
+            return 2;
+        }
+
+        int result = 0;
+        size_t i = 0;
+        auto files = [&](size_t count)
+        {
+            size_t start = i;
+            while (i < args.size() && !args[i].starts_with("--") && (count == 0 || i - start < count))
+                i++;
+            return args.subspan(start, i - start);
+        };
+
+        // Reads the value after an option into 'setting'
+        auto value = [&](auto& setting)
+        {
+            auto text = files(1);
+            return !text.empty() && std::from_chars(text[0].data(), text[0].data() + text[0].size(), setting).ec == std::errc();
+        };
+
+        while (i < args.size())
+        {
+            std::string_view option = args[i++];
+            if (option == "--convert")
+            {
+                auto paths = files(2);
+                if (paths.size() != 2)
+                {
+                    PrintUsage();
+                    return 2;
+                }
+                if (!Convert(paths[0], paths[1]))
+                    result = 1;
+            }
+            else if (option == "--validate" || option == "--stats" || option == "--roundtrip")
+            {
+                auto paths = files(0);
+                if (paths.empty())
+                {
+                    PrintUsage();
+                    return 2;
+                }
+                for (std::string_view path : paths)
+                {
+                    bool ok = option == "--validate" ? Validate(path)
+                            : option == "--stats"    ? Stats(path)
+                            : RoundTrip(path);
+                    if (!ok)
+                        result = 1;
+                }
+            }
+            else if (option == "--benchmark")
+            {
+                auto paths = files(0);
+                if (paths.empty())
+                {
+                    PrintUsage();
+                    return 2;
+                }
+                for (std::string_view path : paths)
+                    benchmark.Run(path, benchmarkOptions);
+            }
+            else if (option == "--iterations" || option == "--tile")
+            {
+                uint& setting = option == "--tile" ? benchmarkOptions.tile : benchmarkOptions.iterations;
+                if (!value(setting) || setting == 0)
+                {
+                    PrintUsage();
+                    return 2;
+                }
+            }
+            else if (option == "--generate")
+            {
+                auto paths = files(0);
+                if (paths.empty())
+                {
+                    PrintUsage();
+                    return 2;
+                }
+                if (!Generate(paths, generatorOptions))
+                    result = 1;
+            }
+            else if (option == "--brushes" || option == "--sides" || option == "--entities" || option == "--materials" || option == "--seed")
+            {
+                uint& setting = option == "--brushes"  ? generatorOptions.brushes
+                              : option == "--sides"    ? generatorOptions.sides
+                              : option == "--entities" ? generatorOptions.entities
+                              : option == "--materials" ? generatorOptions.materials
+                              : generatorOptions.seed;
+                if (!value(setting) || (option == "--sides" && setting < 5))
+                {
+                    PrintUsage();
+                    return 2;
+                }
+            }
+            else if (option == "--displacements")
+            {
+                if (!value(generatorOptions.displacements) || generatorOptions.displacements < 0 || generatorOptions.displacements > 1)
+                {
+                    PrintUsage();
+                    return 2;
+                }
+            }
+            else if (option == "--json")
+            {
+                auto path = files(1);
+                if (path.empty())
+                {
+                    PrintUsage();
+                    return 2;
+                }
+                benchmarkJSON = path[0];
+            }
+            else
+            {
+                if (option != "--help")
+                    Console.Error("Unknown option '{}'", option);
+                PrintUsage();
+                return option == "--help" ? 0 : 2;
+            }
+        }
+
+        if (!benchmarkJSON.empty() && !benchmark.Empty() && !benchmark.WriteJSON(benchmarkJSON))
+            result = 1;
+
+        CloseMap();
+        Jobs.Stop();
+        return result;
+    }
+}
@@ -0,0 +1,134 @@
+#include "chisel/MapGenerator.h"
+#include "chisel/map/Map.h"
+#include "chisel/Chisel.h"
+#include "assets/Assets.h"
+
+#include <cmath>
+
+namespace chisel
+{
+    // SplitMix64. Unlike the <random> distributions, gives the same numbers everywhere.
+    struct GeneratorRandom
+    {
+        uint64 state;
+
+        uint64 Next()
+        {
+            uint64 z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // [0, 1)
+        float Float() { return float(Next() >> 40) / float(1 << 24); }
+
+        // [0, count)
+        uint Range(uint count) { return uint(Next() % count); }
+    };
+
+    static constexpr float BrushSize = 64.0f;
+    static constexpr float BrushSpacing = 128.0f;
+
+    // Box with a displacement on its top side, the way Hammer makes them
+    static std::vector<Side> CreateDisplacementBrush(Material* material, vec3 center, GeneratorRandom& random)
+    {
+        mat4x4 transform = glm::translate(glm::identity<mat4x4>(), center);
+        std::vector<Side> sides = CreateCubeBrush(material, vec3(BrushSize / 2), transform);
+
+        // CreateCubeBrush's order is +X -X +Y -Y +Z -Z
+        Side& top = sides[4];
+
+        DispInfo& disp = top.disp.emplace(3);
+        disp.startPos  = center + vec3(-BrushSize / 2, -BrushSize / 2, BrushSize / 2);
+        disp.elevation = 0;
+        disp.subdiv    = false;
+        disp.flags     = 0;
+
+        // A couple of waves with random phases, so every displacement is different
+        const float phaseX = random.Float() * 6.2831853f;
+        const float phaseY = random.Float() * 6.2831853f;
+        for (int y = 0; y < disp.length; y++)
+        {
+            for (int x = 0; x < disp.length; x++)
+            {
+                DispVert& vert = disp[y][x];
+                vert.normal       = vec3(0, 0, 1);
+                vert.dist         = 8.0f * std::sin(phaseX + x * 0.8f) * std::cos(phaseY + y * 0.8f);
+                vert.offset       = vec3(0);
+                vert.offsetNormal = vec3(0, 0, 1);
+                vert.alpha        = float((x + y) * 255 / (2 * (disp.length - 1)));
+            }
+        }
+
+        return sides;
+    }
+
+    // Prism with 'count - 2' sides around and a top and bottom
+    static std::vector<Side> CreatePrismBrush(Material* material, vec3 center, uint count, float rotation)
+    {
+        const uint around = count - 2;
+        const float radius = BrushSize / 2;
+
+        std::vector<Side> sides;
+        sides.reserve(count);
+        for (uint i = 0; i < around; i++)
+        {
+            float angle = rotation + 6.2831853f * float(i) / float(around);
+            vec3 normal = vec3(std::cos(angle), std::sin(angle), 0);
+            sides.emplace_back(Plane(center + normal * radius, normal), material, 0.25f);
+        }
+        sides.emplace_back(Plane(center + vec3(0, 0, radius), vec3(0, 0, 1)), material, 0.25f);
+        sides.emplace_back(Plane(center - vec3(0, 0, radius), vec3(0, 0, -1)), material, 0.25f);
+
+        return sides;
+    }
+
+    void GenerateMap(Map& map, const MapGeneratorOptions& options)
+    {
+        GeneratorRandom random = { options.seed };
+
+        std::vector<Rc<Material>> materials;
+        for (uint i = 0; i < std::max(options.materials, 1u); i++)
+            materials.push_back(Assets.LoadAsync<Material>(fmt::format("materials/chisel/generated/generated{:03}.vmt", i)));
+
+        // Square grid centered on the origin, each brush at a random height
+        const uint columns = std::max(uint(std::ceil(std::sqrt(double(options.brushes)))), 1u);
+        const float extent = float(columns) * BrushSpacing / 2;
+        const uint sideCount = std::max(options.sides, 5u);
+
+        {
+            BrushUploadScope upload(Chisel.brushAllocator.get());
+            std::vector<Side> sides;
+            for (uint i = 0; i < options.brushes; i++)
+            {
+                vec3 center = vec3(
+                    float(i % columns) * BrushSpacing - extent,
+                    float(i / columns) * BrushSpacing - extent,
+                    std::floor(random.Float() * 8.0f) * BrushSize);
+
+                Material* material = materials[random.Range(uint(materials.size()))].ptr();
+
+                if (random.Float() < options.displacements)
+                    sides = CreateDisplacementBrush(material, center, random);
+                else if (sideCount == 6)
+                    sides = CreateCubeBrush(material, vec3(BrushSize / 2), glm::translate(glm::identity<mat4x4>(), center));
+                else
+                    sides = CreatePrismBrush(material, center, sideCount, random.Float() * 6.2831853f);
+
+                map.AddBrush(std::move(sides));
+            }
+        }
+
+        static constexpr const char* Classnames[] = { "info_target", "light", "info_null", "env_sprite" };
+        for (uint i = 0; i < options.entities; i++)
+        {
+            PointEntity* entity = map.AddPointEntity(Classnames[random.Range(uint(std::size(Classnames)))]);
+            entity->targetname = fmt::format("generated{}", i);
+            entity->origin = vec3(
+                (random.Float() * 2 - 1) * extent,
+                (random.Float() * 2 - 1) * extent,
+                std::floor(random.Float() * 8.0f) * BrushSize + BrushSize);
+        }
+    }
+}
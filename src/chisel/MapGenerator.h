@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common/Common.h"
+
+namespace chisel
+{
+    class Map;
+
+    struct MapGeneratorOptions
+    {
+        uint brushes = 1000;
+        uint sides = 6;             // Per brush. 6 makes boxes, more makes prisms with that many sides in total
+        float displacements = 0;    // Fraction of brushes that get a displacement on top, these are always boxes
+        uint entities = 0;          // Point entities scattered over the brushes
+        uint materials = 16;        // Distinct material names to cycle through
+        uint seed = 1;
+    };
+
+    /**
+     * Fills a map with a deterministic grid of brushes and entities for
+     * scaling tests. The same options always give the same map, so
+     * results from different builds can be compared.
+     * Materials are only referenced by name and don't need to exist.
+     */
+    void GenerateMap(Map& map, const MapGeneratorOptions& options);
+}
@@ -5,8 +5,12 @@
 #include "FGD/FGD.h"
 #include "gui/Viewport.h"
 #include "render/CBuffers.h"
+#include "assets/TextureStreamer.h"
 #include <glm/gtx/normal.hpp>
 
+#include <algorithm>
+#include <array>
+
 namespace chisel
 {
     static ConVar<bool> r_drawbrushes("r_drawbrushes", true, "Draw brushes");
@@ -18,6 +22,30 @@ namespace chisel
     static ConVar<vec4> color_selection_outline = ConVar<vec4>("color_selection_outline", vec4(0.95, 0.59, 0.19, 1), "Selection outline color");
     static ConVar<vec4> color_preview = ConVar<vec4>("color_preview", vec4(1, 1, 1, 0.5), "Placement preview color");
 
+    static ConCommand render_stats("render_stats", "Print the last frame's render counters, needs r_stats 1", []()
+    {
+        if (!Engine.rctx.countStats)
+        {
+            Console.Warn("[Render] Counters are off, set 'r_stats 1' first");
+            return;
+        }
+
+        Console.Log("[Render] Last frame:\n{}", Engine.rctx.lastStats.ToString());
+    });
+
+    // A vertex layout followed by PointInstance::Layout
+    template <size_t VertexCount>
+    static constexpr auto InstancedLayout(const D3D11_INPUT_ELEMENT_DESC (&vertex)[VertexCount])
+    {
+        std::array<D3D11_INPUT_ELEMENT_DESC, VertexCount + std::size(PointInstance::Layout)> layout = {};
+        std::copy(std::begin(vertex), std::end(vertex), layout.begin());
+        std::copy(std::begin(PointInstance::Layout), std::end(PointInstance::Layout), layout.begin() + VertexCount);
+        return layout;
+    }
+
+    static constexpr auto SpriteInstancedLayout = InstancedLayout(Primitives::Vertex::Layout);
+    static constexpr auto ModelInstancedLayout  = InstancedLayout(VertexSolid::InputLayout);
+
     MapRender::MapRender()
         : System()
     {
@@ -30,6 +58,9 @@ namespace chisel
         Shaders.BrushDebugID = render::Shader(r.device.ptr(), VertexSolid::InputLayout, "debug_id_brush");
         Shaders.SpriteDebugID = render::Shader(r.device.ptr(), Primitives::Vertex::Layout, "debug_id_sprite");
         Shaders.Model = render::Shader(r.device.ptr(), VertexSolid::InputLayout, "model");
+        Shaders.SpriteInstanced = render::Shader(r.device.ptr(), { SpriteInstancedLayout.data(), SpriteInstancedLayout.size() }, "sprite_instanced");
+        Shaders.SpriteInstancedDebugID = render::Shader(r.device.ptr(), { SpriteInstancedLayout.data(), SpriteInstancedLayout.size() }, "debug_id_sprite_instanced");
+        Shaders.ModelInstanced = render::Shader(r.device.ptr(), { ModelInstancedLayout.data(), ModelInstancedLayout.size() }, "model_instanced");
 
         // Load builtin textures
         Textures.Missing = Assets.Load<Texture>("textures/error.png");
@@ -40,6 +71,9 @@ namespace chisel
 
     void MapRender::DrawViewport(Viewport& viewport)
     {
+        PROFILE_SCOPE("DrawViewport");
+        PROFILE_GPU_SCOPE("Viewport");
+
         // Get camera matrices
         Camera& camera = viewport.GetCamera();
         mat4x4 view = camera.ViewMatrix();
@@ -50,10 +84,10 @@ namespace chisel
         data.viewProj = proj * view;
         data.view = view;
 
-        r.UploadConstBuffer(0, r.cbuffers.camera, data, render::VertexShader);
+        r.UploadConstBufferDirect(0, r.cbuffers.camera, data, render::VertexShader);
 
         ID3D11RenderTargetView* rts[] = {viewport.rt_SceneView->rtv.ptr(), viewport.rt_ObjectID->rtv.ptr()};
-        r.ctx->OMSetRenderTargets(2, rts, viewport.ds_SceneView->dsv.ptr());
+        r.SetRenderTargets(2, rts, viewport.ds_SceneView->dsv.ptr());
 
         float2 size = viewport.rt_SceneView->GetSize();
         D3D11_VIEWPORT viewrect = { 0, 0, size.x, size.y, 0.0f, 1.0f };
@@ -64,6 +98,11 @@ namespace chisel
         r.ctx->ClearDepthStencilView(viewport.ds_SceneView->dsv.ptr(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 
         drawMode = viewport.drawMode;
+
+        // For estimating how much texture detail each brush needs
+        cameraPosition = camera.position;
+        pixelsPerUnit = proj[1][1] * size.y * 0.5f;
+        orthographic = proj[2][3] == 0.0f;
         if (wireframe = drawMode == Viewport::DrawMode::Wireframe)
             r.SetRasterState(r.Raster.Wireframe.ptr());
         else
@@ -85,15 +124,173 @@ namespace chisel
         if (wireframe)
             r.SetRasterState(r.Raster.Default.ptr());
 
+        DrawPointEntities();
+
+        r.SetRasterState(r.Raster.Default.ptr());
+    }
+
+    void MapRender::DrawPointEntities()
+    {
+        // Without the instanced shaders, draw them one at a time
+        if (!Shaders.SpriteInstanced.vs || !Shaders.SpriteInstancedDebugID.vs || !Shaders.ModelInstanced.vs)
+        {
+            for (const auto* entity : map.Entities())
+            {
+                const PointEntity* point = dynamic_cast<const PointEntity*>(entity);
+                if (!point) continue;
+
+                r.CountStat(&render::RenderStats::pointEntities);
+                DrawPointEntity(entity->classname, false, point->origin, vec3(0), point->IsSelected(), point->GetSelectionID(), point);
+            }
+            return;
+        }
+
+        // Same as DrawObsolete
+        auto obsolete = [&](PointInstance instance)
+        {
+            if (r_drawsprites)
+                pointDraws.push_back({ nullptr, Gizmos.icnObsolete.ptr(), instance });
+            else
+            {
+                instance.size = 16.0f;
+                pointDraws.push_back({ nullptr, Gizmos.icnHandle.ptr(), instance });
+            }
+        };
+
+        // Same choices as DrawPointEntity, but collected to be drawn together
+        pointDraws.clear();
         for (const auto* entity : map.Entities())
         {
             const PointEntity* point = dynamic_cast<const PointEntity*>(entity);
             if (!point) continue;
 
-            DrawPointEntity(entity->classname, false, point->origin, vec3(0), point->IsSelected(), point->GetSelectionID(), point);
+            r.CountStat(&render::RenderStats::pointEntities);
+
+            PointInstance instance;
+            instance.origin = point->origin;
+            instance.size   = 32.0f;
+            instance.color  = point->IsSelected() ? Color(color_selection) : Colors.White;
+            instance.id     = point->GetSelectionID();
+
+            auto cls = Chisel.fgd->classes.find(point->classname);
+            if (cls == Chisel.fgd->classes.end())
+            {
+                obsolete(instance);
+                continue;
+            }
+
+            bool drew = false;
+            if (cls->second.model != nullptr || cls->second.isProp)
+            {
+                Rc<Mesh> model = cls->second.isProp ? point->GetModel() : cls->second.model;
+                if (model != nullptr)
+                {
+                    // Just upload it if it's not uploaded
+                    if (!model->uploaded) [[unlikely]]
+                        r.UploadMesh(model.ptr());
+
+                    pointDraws.push_back({ model.ptr(), nullptr, instance });
+                    drew = true;
+                }
+            }
+
+            if (r_drawsprites && cls->second.texture != nullptr && *cls->second.texture)
+            {
+                pointDraws.push_back({ nullptr, cls->second.texture.ptr(), instance });
+                drew = true;
+            }
+
+            if (!drew)
+                obsolete(instance);
         }
 
-        r.SetRasterState(r.Raster.Default.ptr());
+        if (pointDraws.empty())
+            return;
+
+        // Models first, then sprites, each grouped by model or texture
+        std::sort(pointDraws.begin(), pointDraws.end(), [](const PointDraw& a, const PointDraw& b)
+        {
+            if ((a.model != nullptr) != (b.model != nullptr))
+                return a.model != nullptr;
+            return a.model != b.model ? std::less<>()(a.model, b.model) : std::less<>()(a.sprite, b.sprite);
+        });
+
+        // Every instance goes in one buffer, each group draws its range of it
+        const uint count = uint(pointDraws.size());
+        if (count > instanceCapacity)
+        {
+            instanceCapacity = std::max(count, instanceCapacity * 2);
+            D3D11_BUFFER_DESC desc = {
+                .ByteWidth      = uint(instanceCapacity * sizeof(PointInstance)),
+                .Usage          = D3D11_USAGE_DYNAMIC,
+                .BindFlags      = D3D11_BIND_VERTEX_BUFFER,
+                .CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+            };
+            instanceBuffer = nullptr;
+            if (FAILED(r.device->CreateBuffer(&desc, nullptr, &instanceBuffer)))
+            {
+                Console.Error("[MapRender] Failed to create point entity instance buffer");
+                instanceCapacity = 0;
+                return;
+            }
+        }
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (FAILED(r.ctx->Map(instanceBuffer.ptr(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+            return;
+        PointInstance* instances = static_cast<PointInstance*>(mapped.pData);
+        for (uint i = 0; i < count; i++)
+            instances[i] = pointDraws[i].instance;
+        r.ctx->Unmap(instanceBuffer.ptr(), 0);
+
+        r.SetVertexBuffer(instanceBuffer.ptr(), sizeof(PointInstance), 0, 1);
+        r.SetDepthStencilState(r.Depth.Default);
+        r.SetRasterState(r.Raster.Default);
+        r.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+        uint start = 0;
+        if (pointDraws[0].model)
+        {
+            r.SetShader(Shaders.ModelInstanced);
+            r.SetBlendState(render::BlendFuncs::Normal);
+            r.SetSampler(0, r.Sample.Default);
+        }
+
+        while (start < count && pointDraws[start].model)
+        {
+            Mesh* model = pointDraws[start].model;
+            uint end = start + 1;
+            while (end < count && pointDraws[end].model == model)
+                end++;
+
+            r.SetShaderResource(0, Textures.White->srvSRGB.ptr());
+            r.DrawMesh(model, end - start, start);
+            start = end;
+        }
+
+        if (start < count)
+        {
+            // Sprites are drawn like Gizmos.DrawIcon
+            r.SetShader(drawMode == Viewport::DrawMode::ObjectID ? Shaders.SpriteInstancedDebugID : Shaders.SpriteInstanced);
+            r.SetBlendState(render::BlendFuncs::Alpha);
+            r.SetSampler(0, r.Sample.Point);
+            r.SetVertexBuffer(Primitives.Quad.ptr(), sizeof(Primitives::Vertex));
+
+            while (start < count)
+            {
+                Texture* sprite = pointDraws[start].sprite;
+                uint end = start + 1;
+                while (end < count && pointDraws[end].sprite == sprite)
+                    end++;
+
+                r.SetShaderResource(0, sprite->srvSRGB.ptr());
+                r.DrawInstanced(6, end - start, 0, start);
+                start = end;
+            }
+
+            r.SetSampler(0, r.Sample.Default);
+            r.SetBlendState(render::BlendFuncs::Normal);
+        }
     }
 
     void MapRender::DrawPointEntity(const std::string& classname, bool preview, vec3 origin, vec3 angles, bool selected, SelectionID id, const PointEntity* ent)
@@ -129,7 +326,7 @@ namespace chisel
                     r.UploadMesh(model.ptr());
 
                 r.SetShader(Shaders.Model);
-                r.ctx->PSSetShaderResources(0, 1, &Textures.White->srvSRGB);
+                r.SetShaderResource(0, Textures.White->srvSRGB.ptr());
 
                 cbuffers::ObjectState data;
                 data.color = color;
@@ -148,7 +345,7 @@ namespace chisel
         }
 
         // Draw sprites
-        if (r_drawsprites && cls.texture != nullptr)
+        if (r_drawsprites && cls.texture != nullptr && *cls.texture)
         {
             DrawPixelSprite(origin, cls.texture.ptr());
             drew = true;
@@ -163,13 +360,10 @@ namespace chisel
 
     inline void MapRender::DrawPixelSprite(vec3 pos, Texture* tex)
     {
-        r.SetSampler(0, r.Sample.Point);
         if (this->drawMode == Viewport::DrawMode::ObjectID)
             Gizmos.DrawIcon(pos, tex != nullptr ? tex : Gizmos.icnObsolete.ptr(), vec3(32.0f), Shaders.SpriteDebugID);
         else
             Gizmos.DrawIcon(pos, tex != nullptr ? tex : Gizmos.icnObsolete.ptr(), vec3(32.0f));
-        r.SetSampler(0, r.Sample.Default);
-
     }
     
     inline void MapRender::DrawObsolete(vec3 pos)
@@ -220,10 +414,11 @@ namespace chisel
             // Bind additional $basetexture2+ layers
             for (uint i = 0; i < std::size(material->baseTextures); i++)
             {
-                if (Texture* layer = material->baseTextures[i].ptr())
+                Texture* layer = material->baseTextures[i].ptr();
+                if (layer && *layer)
                 {
                     numLayers++;
-                    r.ctx->PSSetShaderResources(i+1, 1, pass.texOverride ? &pass.texOverride->srvSRGB : &layer->srvSRGB);
+                    r.SetShaderResource(i+1, pass.texOverride ? pass.texOverride->srvSRGB.ptr() : layer->srvSRGB.ptr());
                 }
             }
         }
@@ -236,11 +431,10 @@ namespace chisel
             srv = Textures.Missing->srvSRGB.ptr();
             pointSample = true;
         }
-        if (pointSample)
-        {
-            r.ctx->PSSetSamplers(0, 1, &r.Sample.Point);
-        }
-        r.ctx->PSSetShaderResources(0, 1, &srv);
+
+        // Left bound for the next pass, callers put the default back when they're done
+        r.SetSampler(0, pointSample ? r.Sample.Point : r.Sample.Default);
+        r.SetShaderResource(0, srv);
 
         // Choose shader variant
         if (numLayers > 1)
@@ -251,13 +445,9 @@ namespace chisel
         if (this->drawMode == Viewport::DrawMode::ObjectID)
             r.SetShader(Shaders.BrushDebugID);
 
-        r.ctx->IASetVertexBuffers(0, 1, &buffer, &stride, &vertexOffset);
-        r.ctx->IASetIndexBuffer(buffer, DXGI_FORMAT_R32_UINT, indexOffset);
-        r.ctx->DrawIndexed(pass.indices, pass.startIndex, 0);
-        if (pointSample)
-        {
-            r.ctx->PSSetSamplers(0, 1, &r.Sample.Default);
-        }
+        r.SetVertexBuffer(buffer, stride, vertexOffset);
+        r.SetIndexBuffer(buffer, DXGI_FORMAT_R32_UINT, indexOffset);
+        r.DrawIndexed(pass.indices, pass.startIndex, 0);
     }
 
     inline void MapRender::DrawSelectionOutline(BrushPass pass)
@@ -275,6 +465,8 @@ namespace chisel
 
     inline void MapRender::DrawMesh(BrushMesh* mesh)
     {
+        r.CountStat(&render::RenderStats::brushMeshes);
+
         BrushPass pass = BrushPass(mesh);
 
         if (Chisel.selectMode == SelectMode::Faces)
@@ -305,6 +497,36 @@ namespace chisel
         }
     }
 
+    // Hammer's default texture scale, 0.25 units per texel
+    static constexpr float TexelsPerUnit = 4.0f;
+
+    inline void MapRender::TouchTextures(Solid& brush)
+    {
+        auto bounds = brush.GetBounds();
+        if (!bounds)
+            return;
+
+        // Detail needed at the nearest point of the brush
+        vec3 closest = glm::clamp(cameraPosition, bounds->min, bounds->max);
+        float scale = orthographic ? pixelsPerUnit : pixelsPerUnit / std::max(glm::distance(cameraPosition, closest), 1.0f);
+        if (scale <= 0.0f)
+            return;
+
+        float texelsPerPixel = TexelsPerUnit / scale;
+        float pixels = glm::length(bounds->Dimensions()) * scale;
+
+        for (auto& mesh : brush.GetMeshes())
+        {
+            Material* material = mesh.material;
+            if (!material)
+                continue;
+
+            TextureStreamer.Touch(material->baseTexture.ptr(), texelsPerPixel, pixels);
+            for (auto& layer : material->baseTextures)
+                TextureStreamer.Touch(layer.ptr(), texelsPerPixel, pixels);
+        }
+    }
+
     void MapRender::DrawBrushEntity(BrushEntity& ent)
     {
         static std::vector<BrushMesh*> opaqueMeshes;
@@ -312,8 +534,15 @@ namespace chisel
         opaqueMeshes.clear();
         transMeshes.clear();
 
+        const bool streamTextures = drawMode == Viewport::DrawMode::Shaded;
+
         for (Solid& brush : ent.Brushes())
         {
+            r.CountStat(&render::RenderStats::brushes);
+
+            if (streamTextures)
+                TouchTextures(brush);
+
             for (auto& mesh : brush.GetMeshes())
             {
                 assert(mesh.alloc);
@@ -338,6 +567,7 @@ namespace chisel
             DrawMesh(mesh);
         
         r.SetBlendState(render::BlendFuncs::Normal);
+        r.SetSampler(0, r.Sample.Default);
     }
 
     void MapRender::DrawHandles(mat4x4& view, mat4x4& proj)
@@ -370,6 +600,8 @@ namespace chisel
                     }
                 }
             }
+
+            r.SetSampler(0, r.Sample.Default);
         }
     }
 
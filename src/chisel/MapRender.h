@@ -18,6 +18,25 @@ namespace chisel
     struct Camera;
     struct BrushPass;
 
+    // Per instance vertex data for point entity sprites and models,
+    // matches the INSTANCE inputs of the *_instanced shaders.
+    struct PointInstance
+    {
+        vec3 origin;
+        float size;     // Sprites only
+        vec4 color;
+        uint id;
+
+        static constexpr D3D11_INPUT_ELEMENT_DESC Layout[] =
+        {
+            { "INSTANCE", 0, DXGI_FORMAT_R32G32B32_FLOAT,    1, 0,                            D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "INSTANCE", 1, DXGI_FORMAT_R32_FLOAT,          1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "INSTANCE", 3, DXGI_FORMAT_R32_UINT,           1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        };
+    };
+    static_assert(sizeof(PointInstance) == sizeof(float) * 9);
+
     struct MapRender : public System
     {
     private:
@@ -31,6 +50,9 @@ namespace chisel
             render::Shader BrushDebugID;
             render::Shader SpriteDebugID;
             render::Shader Model;
+            render::Shader SpriteInstanced;
+            render::Shader SpriteInstancedDebugID;
+            render::Shader ModelInstanced;
         } Shaders;
 
         struct DefaultTextures {
@@ -55,8 +77,25 @@ namespace chisel
         inline void DrawMesh(BrushMesh* mesh);
         inline void DrawPixelSprite(vec3 pos, Texture* tex);
         inline void DrawObsolete(vec3 pos);
+        inline void TouchTextures(Solid& brush);
+        void DrawPointEntities();
 
         bool wireframe = false;
         Viewport::DrawMode drawMode = Viewport::DrawMode::Shaded;
+
+        vec3 cameraPosition = vec3(0);
+        float pixelsPerUnit = 0.0f;     // At a distance of one unit, or anywhere for orthographic views
+        bool orthographic = false;
+
+        // Point entities grouped by what they look like, see DrawPointEntities
+        struct PointDraw
+        {
+            Mesh* model;        // One of these
+            Texture* sprite;
+            PointInstance instance;
+        };
+        std::vector<PointDraw> pointDraws;
+        Com<ID3D11Buffer> instanceBuffer;
+        uint instanceCapacity = 0;
     };
 }
@@ -0,0 +1,281 @@
+#include "common/Profiler.h"
+#include "common/Filesystem.h"
+#include "chisel/Engine.h"
+#include "console/ConVar.h"
+#include "console/Console.h"
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <algorithm>
+
+namespace chisel
+{
+    ConVar<bool> profile("profile", false, "Record frame timings for the profiler window");
+
+// GPU Queries //
+
+    // Timestamps are read back this many frames late, so reading never stalls.
+    static constexpr uint GPUFramesInFlight = 4;
+
+    struct GPUFrameQueries
+    {
+        Com<ID3D11Query> disjoint;
+        Com<ID3D11Query> begin;
+        Com<ID3D11Query> end;
+        std::vector<Com<ID3D11Query>> timestamps;   // Two per scope
+        std::vector<Profiler::Scope> scopes;
+        Time::Frames frame = 0;
+        bool pending = false;
+    };
+
+    static GPUFrameQueries s_gpuFrames[GPUFramesInFlight];
+    static uint s_gpuCurrent = 0;
+
+    static Com<ID3D11Query> CreateQuery(D3D11_QUERY type)
+    {
+        Com<ID3D11Query> query;
+        D3D11_QUERY_DESC desc = { type, 0 };
+        Engine.rctx.device->CreateQuery(&desc, &query);
+        return query;
+    }
+
+    static ID3D11Query* GetTimestamp(GPUFrameQueries& queries, uint index)
+    {
+        while (queries.timestamps.size() <= index)
+            queries.timestamps.push_back(CreateQuery(D3D11_QUERY_TIMESTAMP));
+        return queries.timestamps[index].ptr();
+    }
+
+    static bool GetData(ID3D11Query* query, auto& data)
+    {
+        return Engine.rctx.ctx->GetData(query, &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+    }
+
+    void Profiler::ReadGPUQueries()
+    {
+        for (uint i = 0; i < GPUFramesInFlight; i++)
+        {
+            GPUFrameQueries& queries = s_gpuFrames[(s_gpuCurrent + 1 + i) % GPUFramesInFlight];
+            if (!queries.pending)
+                continue;
+
+            D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+            uint64 begin, end;
+            if (!GetData(queries.disjoint.ptr(), disjoint) || !GetData(queries.begin.ptr(), begin) || !GetData(queries.end.ptr(), end))
+                continue;
+
+            queries.pending = false;
+
+            // Find the frame these belong to, it may have already left the ring.
+            Frame* frame = nullptr;
+            for (uint j = 0; j < m_count; j++)
+            {
+                Frame& candidate = m_frames[(m_next + MaxFrames - 1 - j) % MaxFrames];
+                if (candidate.number == queries.frame)
+                {
+                    frame = &candidate;
+                    break;
+                }
+            }
+
+            if (!frame || disjoint.Disjoint || disjoint.Frequency == 0)
+                continue;
+
+            const double frequency = double(disjoint.Frequency);
+            frame->gpuTime = double(end - begin) / frequency;
+            frame->gpu.clear();
+            for (uint s = 0; s < queries.scopes.size(); s++)
+            {
+                uint64 scopeBegin, scopeEnd;
+                if (!GetData(queries.timestamps[s * 2].ptr(), scopeBegin) || !GetData(queries.timestamps[s * 2 + 1].ptr(), scopeEnd))
+                    continue;
+
+                Scope scope = queries.scopes[s];
+                scope.start = double(scopeBegin - begin) / frequency;
+                scope.end   = double(scopeEnd - begin) / frequency;
+                frame->gpu.push_back(scope);
+            }
+        }
+
+        // The slot about to be reused has to be given up on if it's still not ready.
+        s_gpuCurrent = (s_gpuCurrent + 1) % GPUFramesInFlight;
+        s_gpuFrames[s_gpuCurrent].pending = false;
+    }
+
+// Frames //
+
+    void Profiler::BeginFrame()
+    {
+        m_mainThread = std::this_thread::get_id();
+
+        if (Engine.rctx.ctx)
+            ReadGPUQueries();
+
+        m_recording = profile && !paused;
+        m_depth = 0;
+        m_gpuDepth = 0;
+        if (!m_recording)
+            return;
+
+        Frame& frame = m_frames[m_next];
+        frame.number  = Time.frameCount;
+        frame.start   = Time::GetTime();
+        frame.cpuTime = 0;
+        frame.gpuTime = 0;
+        frame.cpu.clear();
+        frame.gpu.clear();
+
+        if (!Engine.rctx.ctx)
+            return;
+
+        GPUFrameQueries& queries = s_gpuFrames[s_gpuCurrent];
+        if (!queries.disjoint)
+        {
+            queries.disjoint = CreateQuery(D3D11_QUERY_TIMESTAMP_DISJOINT);
+            queries.begin    = CreateQuery(D3D11_QUERY_TIMESTAMP);
+            queries.end      = CreateQuery(D3D11_QUERY_TIMESTAMP);
+        }
+        queries.frame = frame.number;
+        queries.scopes.clear();
+
+        Engine.rctx.ctx->Begin(queries.disjoint.ptr());
+        Engine.rctx.ctx->End(queries.begin.ptr());
+    }
+
+    void Profiler::EndFrame()
+    {
+        if (!m_recording)
+            return;
+
+        Frame& frame = m_frames[m_next];
+        frame.cpuTime = Time::GetTime() - frame.start;
+
+        if (Engine.rctx.ctx)
+        {
+            GPUFrameQueries& queries = s_gpuFrames[s_gpuCurrent];
+            Engine.rctx.ctx->End(queries.end.ptr());
+            Engine.rctx.ctx->End(queries.disjoint.ptr());
+            queries.pending = true;
+        }
+
+        m_next  = (m_next + 1) % MaxFrames;
+        m_count = std::min(m_count + 1, MaxFrames);
+        m_recording = false;
+    }
+
+// Scopes //
+
+    uint Profiler::BeginScope(std::string_view name)
+    {
+        if (std::this_thread::get_id() != m_mainThread)
+            return ~0u;
+
+        Frame& frame = m_frames[m_next];
+        Time::Seconds now = Time::GetTime() - frame.start;
+        frame.cpu.push_back(Scope{ name, m_depth++, now, now });
+        return uint(frame.cpu.size() - 1);
+    }
+
+    void Profiler::EndScope(uint index)
+    {
+        Frame& frame = m_frames[m_next];
+        if (!m_recording || index >= frame.cpu.size())
+            return;
+
+        frame.cpu[index].end = Time::GetTime() - frame.start;
+        m_depth--;
+    }
+
+    uint Profiler::BeginGPUScope(std::string_view name)
+    {
+        if (std::this_thread::get_id() != m_mainThread || !Engine.rctx.ctx)
+            return ~0u;
+
+        GPUFrameQueries& queries = s_gpuFrames[s_gpuCurrent];
+        uint index = uint(queries.scopes.size());
+        queries.scopes.push_back(Scope{ name, m_gpuDepth++, 0, 0 });
+
+        Engine.rctx.ctx->End(GetTimestamp(queries, index * 2));
+        return index;
+    }
+
+    void Profiler::EndGPUScope(uint index)
+    {
+        GPUFrameQueries& queries = s_gpuFrames[s_gpuCurrent];
+        if (!m_recording || index >= queries.scopes.size())
+            return;
+
+        Engine.rctx.ctx->End(GetTimestamp(queries, index * 2 + 1));
+        m_gpuDepth--;
+    }
+
+// Export //
+
+    bool Profiler::ExportChromeTrace(std::string_view path) const
+    {
+        if (m_count == 0)
+        {
+            Console.Warn("[Profiler] Nothing recorded, set 'profile 1' first");
+            return false;
+        }
+
+        static constexpr int CPUThread = 1;
+        static constexpr int GPUThread = 2;
+
+        json events = json::array();
+        auto threadName = [&](int tid, std::string_view name)
+        {
+            events.push_back({ { "ph", "M" }, { "pid", 1 }, { "tid", tid }, { "name", "thread_name" }, { "args", { { "name", name } } } });
+        };
+        threadName(CPUThread, "CPU");
+        threadName(GPUThread, "GPU");
+
+        // Microseconds since the oldest frame. GPU scopes are lined up with the start of their CPU frame.
+        const Time::Seconds origin = GetFrame(0).start;
+        auto event = [&](int tid, std::string_view name, Time::Seconds start, Time::Seconds duration, Time::Frames number)
+        {
+            events.push_back({
+                { "ph",   "X" },
+                { "pid",  1 },
+                { "tid",  tid },
+                { "name", name },
+                { "ts",   (start - origin) * 1e6 },
+                { "dur",  duration * 1e6 },
+                { "args", { { "frame", number } } },
+            });
+        };
+
+        for (uint i = 0; i < m_count; i++)
+        {
+            const Frame& frame = GetFrame(i);
+            event(CPUThread, "Frame", frame.start, frame.cpuTime, frame.number);
+            for (const Scope& scope : frame.cpu)
+                event(CPUThread, scope.name, frame.start + scope.start, scope.end - scope.start, frame.number);
+
+            if (frame.gpuTime > 0)
+                event(GPUThread, "GPU Frame", frame.start, frame.gpuTime, frame.number);
+            for (const Scope& scope : frame.gpu)
+                event(GPUThread, scope.name, frame.start + scope.start, scope.end - scope.start, frame.number);
+        }
+
+        json j = {
+            { "traceEvents", events },
+            { "displayTimeUnit", "ms" },
+        };
+
+        if (!fs::writeFile(path, j.dump()))
+        {
+            Console.Error("[Profiler] Failed to write '{}'", path);
+            return false;
+        }
+
+        Console.Log("[Profiler] Wrote {} frames to '{}'", m_count, path);
+        return true;
+    }
+
+    static ConCommand profile_export("profile_export", "Write the recorded frames as a Chrome trace. Usage: profile_export [path]", [](ConCmd& cmd)
+    {
+        Profiler.ExportChromeTrace(cmd.argc > 0 ? cmd.argv[0] : "profile.json");
+    });
+}
@@ -60,6 +60,7 @@ namespace chisel
 
         ent->SetSelected(true);
         m_selection.emplace_back(ent);
+        m_generation++;
     }
 
     void Selection::Unselect(Selectable* ent)
@@ -74,6 +75,7 @@ namespace chisel
         ent->SetSelected(false);
         if (m_selection.size() > 0)
             std::erase(m_selection, ent);
+        m_generation++;
     }
 
     void Selection::Toggle(Selectable* ent)
@@ -89,6 +91,7 @@ namespace chisel
         for (const auto& selected : m_selection)
             selected->SetSelected(false);
         m_selection.clear();
+        m_generation++;
     }
 
     Selectable* Selection::Find(SelectionID id)
@@ -57,6 +57,9 @@ namespace chisel
         void Clear();
         Selectable* Find(SelectionID id);
 
+        // Bumped whenever anything is selected or unselected.
+        uint64 Generation() const { return m_generation; }
+
         Selectable** begin() { return m_selection.size() > 0 ? &m_selection.front() : nullptr; }
         Selectable** end()   { return m_selection.size() > 0 ? &m_selection.back() + 1 : nullptr; }
         Selectable* operator [](size_t index) { return m_selection[index]; }
@@ -72,5 +75,6 @@ namespace chisel
 
     private:
         std::vector<Selectable*> m_selection;
+        uint64 m_generation = 0;
     } Selection;
 }
\ No newline at end of file
@@ -6,6 +6,11 @@
 
 #include "zstd.h"
 
+#include <future>
+#include <memory>
+#include <span>
+#include <unordered_map>
+
 #include "../submodules/yyjson/src/yyjson.h"
 
 using namespace std::literals;
@@ -13,6 +18,7 @@ using namespace std::literals;
 namespace chisel
 {
     ConVar<int> box_compression_level("box_compression_level", 3, "Compression level when saving a box format. 1-9. Default is 3.");
+    ConVar<int> box_compression_threads("box_compression_threads", 4, "Number of zstd worker threads used when saving a box format. 0 compresses on the saving thread.");
 
     static vec2 YYJsonToVector2(yyjson_val* vec_val)
     {
@@ -89,7 +95,7 @@ namespace chisel
             {
                 Side thisSide{};
                 thisSide.plane = ReadPlane(yyjson_obj_get(side, "plane"));
-                thisSide.material = Assets.Load<Material>(yyjson_get_str(yyjson_obj_get(side, "material")));
+                thisSide.material = Assets.LoadAsync<Material>(PathKey(yyjson_get_str(yyjson_obj_get(side, "material"))));
                 thisSide.textureAxes = ReadTextureAxis(yyjson_obj_get(side, "texture_axis"));
                 thisSide.scale = ReadTextureScale(yyjson_obj_get(side, "scale"));
                 thisSide.rotate = yyjson_get_real(yyjson_obj_get(side, "rotate"));
@@ -109,17 +115,18 @@ namespace chisel
     {
         yyjson_val* solids = yyjson_obj_get(entity_val, "solids");
         bool point = solids == nullptr;
-        Entity* entity = nullptr;
+
+        // Owned here until the map takes it
+        std::unique_ptr<Entity> entity;
         if (point)
         {
-            PointEntity* point = new PointEntity(&map);
-            entity = point;
+            entity = std::make_unique<PointEntity>(&map);
         }
         else
         {
-            BrushEntity* brush = new BrushEntity(&map);
+            auto brush = std::make_unique<BrushEntity>(&map);
             AddSolid(*brush, entity_val);
-            entity = brush;
+            entity = std::move(brush);
         }
 
         entity->classname = GetStringSafe(entity_val, "classname");
@@ -174,288 +181,798 @@ namespace chisel
             }
         }
 
-        map.AddEntity(entity);
+        map.AddEntity(entity.release());
     }
 
-    bool ImportBox(std::string_view filepath, Map& map)
+    // Decompresses a frame that doesn't record its content size (eg. written by a stream),
+    // growing the output a chunk at a time.
+    static bool DecompressStream(const uint8_t* data, size_t size, Buffer& out)
     {
-        auto file = fs::readFile(filepath);
-        if (!file)
+        ZSTD_DCtx* dctx = ZSTD_createDCtx();
+        if (!dctx)
             return false;
 
-        std::unique_ptr<uint8_t[]> raw_data;
-        unsigned long long raw_size = ZSTD_getFrameContentSize(file->data(), file->size());
-        assert(raw_size != ZSTD_CONTENTSIZE_UNKNOWN);
-        if (raw_size != ZSTD_CONTENTSIZE_ERROR)
+        const size_t chunkSize = ZSTD_DStreamOutSize();
+        ZSTD_inBuffer in = { data, size, 0 };
+
+        // 0 once the frame is complete, otherwise a hint of how much input is left.
+        size_t remaining = 1;
+        bool outputFull = true;
+        while (remaining != 0 && (in.pos < in.size || outputFull))
         {
-            raw_data = std::make_unique<uint8_t[]>(size_t(raw_size));
-            size_t size = ZSTD_decompress(raw_data.get(), size_t(raw_size), file->data(), file->size());
-            if (size != raw_size)
-                return false;
-        }
+            size_t offset = out.size();
+            out.resize(offset + chunkSize);
 
-        const char* json = raw_data ? (const char*)raw_data.get() : (const char *) file->data();
-        size_t json_size = raw_data ? raw_size : file->size();
+            ZSTD_outBuffer output = { out.data() + offset, chunkSize, 0 };
+            remaining = ZSTD_decompressStream(dctx, &output, &in);
+            out.resize(offset + output.pos);
 
-        Chisel.brushAllocator->open();
+            if (ZSTD_isError(remaining))
+                break;
 
-        yyjson_doc* doc = yyjson_read(json, json_size, 0);
+            outputFull = output.pos == output.size;
+        }
 
-        yyjson_val* root = yyjson_doc_get_root(doc);
-        yyjson_val* world = yyjson_obj_get(root, "world");
-        AddSolid(map, world);
+        ZSTD_freeDCtx(dctx);
+        return remaining == 0;
+    }
 
-        yyjson_val* entities = yyjson_obj_get(world, "entities");
-        size_t entity_idx, entity_max;
-        yyjson_val* entity;
-        yyjson_arr_foreach(entities, entity_idx, entity_max, entity)
+    // Legacy box: a single JSON document, optionally compressed as one zstd frame.
+    static bool ImportBoxJSON(const uint8_t* data, size_t size, Map& map)
+    {
+        Buffer raw_data;
+        unsigned long long raw_size = ZSTD_getFrameContentSize(data, size);
+        if (raw_size == ZSTD_CONTENTSIZE_UNKNOWN)
         {
-            AddEntity(map, entity);
+            if (!DecompressStream(data, size, raw_data))
+                return false;
+        }
+        else if (raw_size != ZSTD_CONTENTSIZE_ERROR)
+        {
+            raw_data.resize(size_t(raw_size));
+            size_t decompressed = ZSTD_decompress(raw_data.data(), raw_data.size(), data, size);
+            if (decompressed != raw_size)
+                return false;
         }
 
-        Chisel.brushAllocator->close();
+        // Not a zstd frame, plain JSON.
+        const bool compressed = raw_size != ZSTD_CONTENTSIZE_ERROR;
+        const char* json = compressed ? (const char*)raw_data.data() : (const char *)data;
+        size_t json_size = compressed ? raw_data.size() : size;
+
+        yyjson_doc* doc = yyjson_read(json, json_size, 0);
+        if (!doc)
+            return false;
+
+        {
+            BrushUploadScope upload(Chisel.brushAllocator.get());
+
+            yyjson_val* root = yyjson_doc_get_root(doc);
+            yyjson_val* world = yyjson_obj_get(root, "world");
+            AddSolid(map, world);
+
+            yyjson_val* entities = yyjson_obj_get(world, "entities");
+            size_t entity_idx, entity_max;
+            yyjson_val* entity;
+            yyjson_arr_foreach(entities, entity_idx, entity_max, entity)
+            {
+                AddEntity(map, entity);
+            }
+        }
 
         yyjson_doc_free(doc);
         return true;
     }
 
-    static yyjson_mut_val* VectorToYYJson(yyjson_mut_doc* doc, const vec2& vec)
+//-----------------------------------------------------------------------------
+// Binary box
+//
+// [Header] [Section x sectionCount] [section data...]
+//
+// Each section is compressed on its own (its own zstd frame), so they can be
+// decompressed in parallel, and a reader only pays for the sections it asks for.
+// Fixed-size records are stored as flat arrays and can be copied straight out.
+// Everything is little endian.
+//-----------------------------------------------------------------------------
+
+    namespace box
     {
-        yyjson_mut_val* vec_arr = yyjson_mut_arr(doc);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[0]);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[1]);
-        return vec_arr;
-    }
+        constexpr uint32_t FourCC(const char (&str)[5])
+        {
+            return uint32_t(str[0]) | (uint32_t(str[1]) << 8) | (uint32_t(str[2]) << 16) | (uint32_t(str[3]) << 24);
+        }
 
-    static yyjson_mut_val* VectorToYYJson(yyjson_mut_doc* doc, const vec3& vec)
-    {
-        yyjson_mut_val* vec_arr = yyjson_mut_arr(doc);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[0]);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[1]);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[2]);
-        return vec_arr;
-    }
+        constexpr uint32_t Magic   = FourCC("CBOX");
+        constexpr uint32_t Version = 1;
 
-    static yyjson_mut_val* VectorToYYJson(yyjson_mut_doc* doc, const vec4& vec)
-    {
-        yyjson_mut_val* vec_arr = yyjson_mut_arr(doc);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[0]);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[1]);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[2]);
-        yyjson_mut_arr_add_real(doc, vec_arr, vec[3]);
-        return vec_arr;
-    }
+        // Old JSON boxes start with a zstd frame or a '{'. Neither collide with the magic.
+        static_assert(Magic != ZSTD_MAGICNUMBER);
 
-    static void WriteKVPair(yyjson_mut_doc* doc, yyjson_mut_val* val, const char *key, const kv::KeyValuesVariant& kv)
-    {
-        switch (kv.GetType())
+        enum class SectionID : uint32_t
+        {
+            Materials   = FourCC("MATL"),   // uint32 count, then length-prefixed material paths
+            Entities    = FourCC("ENTS"),   // uint32 count, then variable length entity records. First one is the world.
+            Solids      = FourCC("SOLD"),   // Solid[]
+            Planes      = FourCC("PLNS"),   // Plane[], one per side
+            Sides       = FourCC("SIDE"),   // Side[], texture axes + material, one per side
+        };
+
+        enum class Compression : uint32_t
+        {
+            None = 0,
+            Zstd = 1,
+        };
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t sectionCount;
+            uint32_t reserved;
+        };
+
+        struct Section
+        {
+            SectionID   id;
+            Compression compression;
+            uint64_t    offset;     // From the start of the file
+            uint64_t    size;       // Size on disk
+            uint64_t    rawSize;    // Size after decompression
+        };
+
+        struct Solid
         {
-            case kv::Types::None:
+            uint32_t firstSide;
+            uint32_t sideCount;
+        };
+
+        struct Side
+        {
+            vec4     textureAxes[2];
+            float    scale[2];
+            float    rotate;
+            float    lightmapScale;
+            uint32_t smoothing;
+            uint32_t material;      // Index into the material table or NoMaterial
+        };
+
+        constexpr uint32_t NoMaterial = ~0u;
+
+        static_assert(sizeof(Header)  == 16);
+        static_assert(sizeof(Section) == 32);
+        static_assert(sizeof(Solid)   == 8);
+        static_assert(sizeof(Side)    == 56);
+        static_assert(sizeof(Plane)   == 16 && std::is_trivially_copyable_v<Plane>);
+
+        // Appends POD values and length-prefixed strings to a section.
+        struct SectionWriter
+        {
+            std::vector<uint8_t> data;
+
+            template <typename T> requires std::is_trivially_copyable_v<T>
+            void Write(const T& value)
             {
-                return;
+                const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+                data.insert(data.end(), bytes, bytes + sizeof(T));
             }
-            case kv::Types::String:
+
+            void WriteString(std::string_view str)
             {
-                auto str = (std::string_view)kv;
-                yyjson_mut_obj_add_strn(doc, val, key, str.data(), str.length());
-                return;
+                Write(uint32_t(str.size()));
+                data.insert(data.end(), str.begin(), str.end());
             }
-            case kv::Types::Int:
+        };
+
+        // Bounds-checked reads from a decompressed section.
+        // Any overrun sets 'failed' and returns zeroed values from then on.
+        struct SectionReader
+        {
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+            size_t pos = 0;
+            bool failed = false;
+
+            template <typename T> requires std::is_trivially_copyable_v<T>
+            T Read()
             {
-                yyjson_mut_obj_add_int(doc, val, key, (int64_t)kv);
-                return;
+                T value{};
+                if (failed || size - pos < sizeof(T))
+                {
+                    failed = true;
+                    return value;
+                }
+                memcpy(&value, data + pos, sizeof(T));
+                pos += sizeof(T);
+                return value;
             }
-            case kv::Types::Float:
+
+            std::string_view ReadString()
             {
-                yyjson_mut_obj_add_real(doc, val, key, (double)kv);
-                return;
+                uint32_t length = Read<uint32_t>();
+                if (failed || size - pos < length)
+                {
+                    failed = true;
+                    return {};
+                }
+                std::string_view str((const char*)data + pos, length);
+                pos += length;
+                return str;
+            }
+
+            template <typename T> requires std::is_trivially_copyable_v<T>
+            std::vector<T> ReadArray() const
+            {
+                std::vector<T> values(size / sizeof(T));
+                memcpy(values.data(), data, values.size() * sizeof(T));
+                return values;
             }
-            case kv::Types::Ptr:
+        };
+
+        /**
+         * Random access to the sections of a binary box held in memory.
+         * Sections are decompressed on first use. Request() starts decompressing
+         * one on a worker ahead of time so several can be unpacked at once.
+         */
+        class Archive
+        {
+        public:
+            bool Open(const uint8_t* data, size_t size)
             {
+                m_data = data;
+                m_size = size;
 
-                Console.Log("wtf ptr!!!!");
-                abort();
-                return;
+                if (size < sizeof(Header))
+                    return false;
+
+                Header header;
+                memcpy(&header, data, sizeof(Header));
+                if (header.magic != Magic || header.version > Version)
+                    return false;
+
+                if ((size - sizeof(Header)) / sizeof(Section) < header.sectionCount)
+                    return false;
+
+                m_sections.resize(header.sectionCount);
+                memcpy(m_sections.data(), data + sizeof(Header), header.sectionCount * sizeof(Section));
+
+                for (const Section& section : m_sections)
+                {
+                    if (section.offset > size || section.size > size - section.offset)
+                        return false;
+                }
+
+                return true;
             }
-            case kv::Types::Vector2:
+
+            bool Contains(SectionID id) const
             {
-                yyjson_mut_obj_add_val(doc, val, key, VectorToYYJson(doc, (vec2)kv));
-                return;
+                return Find(id) != nullptr;
             }
-            case kv::Types::Vector3:
+
+            void Request(SectionID id)
             {
-                yyjson_mut_obj_add_val(doc, val, key, VectorToYYJson(doc, (vec3)kv));
-                return;
+                const Section* section = Find(id);
+                if (!section || m_pending.contains(id))
+                    return;
+
+                m_pending.emplace(id, std::async(std::launch::async, [this, section]() { return Decompress(*section); }));
             }
-            case kv::Types::Vector4:
+
+            // Waits for (or starts) decompression of a section.
+            // Missing or corrupt sections come back as an empty reader with 'failed' set.
+            SectionReader Get(SectionID id)
             {
-                yyjson_mut_obj_add_val(doc, val, key, VectorToYYJson(doc, (vec4)kv));
-                return;
+                Request(id);
+
+                auto it = m_pending.find(id);
+                if (it == m_pending.end())
+                    return SectionReader{ .failed = true };
+
+                if (it->second.valid())
+                    m_unpacked[id] = it->second.get();
+
+                const std::optional<Buffer>& buffer = m_unpacked[id];
+                if (!buffer)
+                    return SectionReader{ .failed = true };
+
+                return SectionReader{ .data = buffer->data(), .size = buffer->size() };
             }
-            case kv::Types::KeyValues:
+
+            ~Archive()
             {
-                Console.Log("wtf kv!!!!");
-                //abort();
-                return;
+                // Don't pull the file out from under a worker.
+                for (auto& [id, future] : m_pending)
+                {
+                    if (future.valid())
+                        future.wait();
+                }
             }
-        }
+
+        private:
+            const Section* Find(SectionID id) const
+            {
+                for (const Section& section : m_sections)
+                {
+                    if (section.id == id)
+                        return &section;
+                }
+                return nullptr;
+            }
+
+            // Runs on a worker, so it must not throw: Get would rethrow it on the loading thread.
+            std::optional<Buffer> Decompress(const Section& section) const
+            {
+                const uint8_t* src = m_data + section.offset;
+
+                // rawSize comes straight from the file, check it against the data before allocating for it.
+                switch (section.compression)
+                {
+                    case Compression::None:
+                        if (section.size != section.rawSize)
+                            return std::nullopt;
+                        break;
+                    case Compression::Zstd:
+                        if (ZSTD_getFrameContentSize(src, section.size) != section.rawSize)
+                            return std::nullopt;
+                        break;
+                    default:
+                        return std::nullopt;
+                }
+
+                try
+                {
+                    Buffer buffer(section.rawSize);
+                    if (section.compression == Compression::None)
+                    {
+                        memcpy(buffer.data(), src, section.size);
+                        return buffer;
+                    }
+
+                    size_t size = ZSTD_decompress(buffer.data(), buffer.size(), src, section.size);
+                    if (ZSTD_isError(size) || size != section.rawSize)
+                        return std::nullopt;
+                    return buffer;
+                }
+                catch (const std::exception&)
+                {
+                    // A frame header can still claim more than there is memory for
+                    return std::nullopt;
+                }
+            }
+
+            const uint8_t* m_data = nullptr;
+            size_t m_size = 0;
+
+            std::vector<Section> m_sections;
+            std::unordered_map<SectionID, std::future<std::optional<Buffer>>> m_pending;
+            std::unordered_map<SectionID, std::optional<Buffer>> m_unpacked;
+        };
     }
 
-    static void WriteEntityKVPairs(yyjson_mut_doc* doc, yyjson_mut_val* val, const Entity& entity)
+    static void ReadEntityKVPairs(box::SectionReader& reader, Entity& entity)
     {
-        // Write classname
-        if (entity.classname.empty())
+        uint32_t count = reader.Read<uint32_t>();
+        for (uint32_t i = 0; i < count && !reader.failed; i++)
         {
-            yyjson_mut_obj_add_str(doc, val, "classname", "worldspawn");  // TODO: worldspawn doesn't have a classname! should asset on no classname
-        }
-        else
-        {
-            yyjson_mut_obj_add_str(doc, val, "classname", entity.classname.c_str());
+            std::string_view key = reader.ReadString();
+            auto type = kv::KeyValuesType(reader.Read<uint8_t>());
+            switch (type)
+            {
+                case kv::Types::String:  entity.kv.CreateTypedChild(key, reader.ReadString()); break;
+                case kv::Types::Int:     entity.kv.CreateTypedChild(key, reader.Read<int64_t>()); break;
+                case kv::Types::Float:   entity.kv.CreateTypedChild(key, reader.Read<double>()); break;
+                case kv::Types::Vector2: entity.kv.CreateTypedChild(key, reader.Read<vec2>()); break;
+                case kv::Types::Vector3: entity.kv.CreateTypedChild(key, reader.Read<vec3>()); break;
+                case kv::Types::Vector4: entity.kv.CreateTypedChild(key, reader.Read<vec4>()); break;
+                default:
+                    reader.failed = true;
+                    break;
+            }
         }
+    }
 
-        // Write targetname
-        if (!entity.targetname.empty())
-        {
-            yyjson_mut_obj_add_str(doc, val, "targetname", entity.targetname.c_str());
-        }
+    static bool ImportBoxBinary(const uint8_t* data, size_t size, Map& map)
+    {
+        box::Archive archive;
+        if (!archive.Open(data, size))
+            return false;
 
-        // Write the origin
-        {
-            kv::KeyValuesVariant variant;
-            variant.Set(entity.origin);
-            WriteKVPair(doc, val, "origin", variant);
-        }
+        // Get everything decompressing at once, the material table is needed first.
+        archive.Request(box::SectionID::Materials);
+        archive.Request(box::SectionID::Entities);
+        archive.Request(box::SectionID::Solids);
+        archive.Request(box::SectionID::Planes);
+        archive.Request(box::SectionID::Sides);
 
-        yyjson_mut_val* kv_val = yyjson_mut_obj(doc);
-        // Write all keyvalues
-        for (const auto& pair : entity.kv)
+        // Materials are loaded once each, while the other sections unpack.
+        std::vector<Rc<Material>> materials;
         {
-            WriteKVPair(doc, kv_val, pair.first.c_str(), pair.second);
+            box::SectionReader reader = archive.Get(box::SectionID::Materials);
+            uint32_t count = reader.Read<uint32_t>();
+            for (uint32_t i = 0; i < count && !reader.failed; i++)
+                materials.push_back(Assets.LoadAsync<Material>(PathKey(reader.ReadString())));
+
+            if (reader.failed)
+                return false;
         }
-        yyjson_mut_obj_add_val(doc, val, "properties", kv_val);
-    }
 
-    static void WriteBrushEntity(yyjson_mut_doc* doc, yyjson_mut_val* val, BrushEntity& entity)
-    {
-        WriteEntityKVPairs(doc, val, entity);
+        box::SectionReader solidReader = archive.Get(box::SectionID::Solids);
+        box::SectionReader planeReader = archive.Get(box::SectionID::Planes);
+        box::SectionReader sideReader  = archive.Get(box::SectionID::Sides);
+        if (solidReader.failed || planeReader.failed || sideReader.failed)
+            return false;
 
-        yyjson_mut_val* solid_arr = yyjson_mut_arr(doc);
-        for (Solid& solid : entity.Brushes())
-        {
-            yyjson_mut_val* solid_val = yyjson_mut_arr_add_obj(doc, solid_arr);
+        std::vector<box::Solid> solids = solidReader.ReadArray<box::Solid>();
+        std::vector<Plane>      planes = planeReader.ReadArray<Plane>();
+        std::vector<box::Side>  sides  = sideReader.ReadArray<box::Side>();
+        if (planes.size() != sides.size())
+            return false;
 
-            yyjson_mut_val* side_arr = yyjson_mut_arr(doc);
-            for (const Side& side : solid.GetSides())
-            {
-                yyjson_mut_val* side_val = yyjson_mut_arr_add_obj(doc, side_arr);
+        box::SectionReader reader = archive.Get(box::SectionID::Entities);
+        uint32_t entityCount = reader.Read<uint32_t>();
 
-                const char* materialName = side.material != nullptr ? (const char*)side.material->GetPath() : "DEFAULT";
+        {
+            BrushUploadScope upload(Chisel.brushAllocator.get());
 
-                yyjson_mut_obj_add_str(doc, side_val, "material", materialName);
+            // Nothing goes into the map until every entity has been read, so a failed
+            // read leaves it as it was. The world is the map itself, so its fields
+            // and brushes are held here and added at the end.
+            PointEntity world(&map);
+            box::SectionReader worldKV;
+            std::vector<std::vector<Side>> worldBrushes;
+            std::vector<std::unique_ptr<Entity>> entities;
 
-                // Plane
+            std::vector<Side> sideData;
+            for (uint32_t i = 0; i < entityCount && !reader.failed; i++)
+            {
+                std::string_view classname  = reader.ReadString();
+                std::string_view targetname = reader.ReadString();
+                vec3 origin                 = reader.Read<vec3>();
+                bool brushEntity            = reader.Read<uint8_t>() != 0;
+                uint32_t firstSolid         = reader.Read<uint32_t>();
+                uint32_t solidCount         = reader.Read<uint32_t>();
+
+                if (firstSolid > solids.size() || solidCount > solids.size() - firstSolid)
                 {
-                    yyjson_mut_val* plane_val = yyjson_mut_obj(doc);
-                    yyjson_mut_obj_add_val(doc, plane_val, "normal", VectorToYYJson(doc, side.plane.normal));
-                    yyjson_mut_obj_add_real(doc, plane_val, "offset", side.plane.offset);
-                    yyjson_mut_obj_add_val(doc, side_val, "plane", plane_val);
+                    reader.failed = true;
+                    break;
                 }
 
-                // Texture Axes
+                // The first entity is always the world.
+                std::unique_ptr<Entity> owned;
+                if (i != 0 && brushEntity)
+                    owned = std::make_unique<BrushEntity>(&map);
+                else if (i != 0)
+                    owned = std::make_unique<PointEntity>(&map);
+                Entity* entity = owned ? owned.get() : &world;
+
+                entity->classname  = classname;
+                entity->targetname = targetname;
+                entity->origin     = origin;
+                if (i == 0)
+                    worldKV = reader;
+                ReadEntityKVPairs(reader, *entity);
+
+                if (i == 0 || entity->IsBrushEntity())
                 {
-                    yyjson_mut_val* axis_arr = yyjson_mut_arr(doc);
-                    yyjson_mut_arr_append(axis_arr, VectorToYYJson(doc, side.textureAxes[0]));
-                    yyjson_mut_arr_append(axis_arr, VectorToYYJson(doc, side.textureAxes[1]));
-                    yyjson_mut_obj_add_val(doc, side_val, "texture_axis", axis_arr);
+                    for (uint32_t j = firstSolid; j < firstSolid + solidCount; j++)
+                    {
+                        const box::Solid& solid = solids[j];
+                        if (solid.firstSide > sides.size() || solid.sideCount > sides.size() - solid.firstSide)
+                        {
+                            reader.failed = true;
+                            break;
+                        }
+
+                        for (uint32_t k = solid.firstSide; k < solid.firstSide + solid.sideCount; k++)
+                        {
+                            const box::Side& side = sides[k];
+
+                            Side& thisSide = sideData.emplace_back();
+                            thisSide.plane          = planes[k];
+                            thisSide.material       = side.material < materials.size() ? materials[side.material] : nullptr;
+                            thisSide.textureAxes    = { side.textureAxes[0], side.textureAxes[1] };
+                            thisSide.scale          = { side.scale[0], side.scale[1] };
+                            thisSide.rotate         = side.rotate;
+                            thisSide.lightmapScale  = side.lightmapScale;
+                            thisSide.smoothing      = side.smoothing;
+                        }
+
+                        if (i == 0)
+                        {
+                            worldBrushes.push_back(std::move(sideData));
+                        }
+                        else
+                        {
+                            auto& brush = static_cast<BrushEntity&>(*entity).AddBrush(std::move(sideData));
+                            brush.UpdateMesh();
+                        }
+                        sideData.clear();
+                    }
                 }
 
-                // Scale
+                if (owned)
+                    entities.push_back(std::move(owned));
+            }
+
+            if (reader.failed)
+                return false;
+
+            if (entityCount != 0)
+            {
+                map.classname  = std::move(world.classname);
+                map.targetname = std::move(world.targetname);
+                map.origin     = world.origin;
+                ReadEntityKVPairs(worldKV, map);
+                for (std::vector<Side>& brushSides : worldBrushes)
                 {
-                    yyjson_mut_val* scale_arr = yyjson_mut_arr(doc);
-                    yyjson_mut_arr_add_real(doc, scale_arr, side.scale[0]);
-                    yyjson_mut_arr_add_real(doc, scale_arr, side.scale[1]);
-                    yyjson_mut_obj_add_val(doc, side_val, "scale", scale_arr);
+                    auto& brush = map.AddBrush(std::move(brushSides));
+                    brush.UpdateMesh();
                 }
-
-                yyjson_mut_obj_add_real(doc, side_val, "rotate", side.rotate);
-                yyjson_mut_obj_add_real(doc, side_val, "lightmap_scale", side.lightmapScale);
-                yyjson_mut_obj_add_int(doc, side_val, "smoothing_groups", side.smoothing);
             }
-            yyjson_mut_obj_add_val(doc, solid_val, "sides", side_arr);
+
+            for (std::unique_ptr<Entity>& entity : entities)
+                map.AddEntity(entity.release());
         }
-        yyjson_mut_obj_add_val(doc, val, "solids", solid_arr);
+
+        return true;
     }
 
-    static void WritePointEntity(yyjson_mut_doc* doc, yyjson_mut_val* val, const PointEntity& entity)
+    bool ImportBox(std::string_view filepath, Map& map)
     {
-        WriteEntityKVPairs(doc, val, entity);
+        auto file = fs::readFile(filepath);
+        if (!file)
+            return false;
+
+        const uint8_t* data = (const uint8_t*)file->data();
+        if (file->size() >= sizeof(uint32_t))
+        {
+            uint32_t magic;
+            memcpy(&magic, data, sizeof(magic));
+            if (magic == box::Magic)
+                return ImportBoxBinary(data, file->size(), map);
+        }
+
+        return ImportBoxJSON(data, file->size(), map);
     }
 
-    static void WriteMap(yyjson_mut_doc* doc, yyjson_mut_val* map_val, Map& map)
+//-----------------------------------------------------------------------------
+
+    struct BoxSections
     {
-        // Write the world first
-        WriteBrushEntity(doc, map_val, map);
+        box::SectionWriter materials;
+        box::SectionWriter entities;
+        std::vector<box::Solid> solids;
+        std::vector<Plane> planes;
+        std::vector<box::Side> sides;
+
+        std::unordered_map<const Material*, uint32_t> materialIndices;
+        uint32_t materialCount = 0;
+    };
 
-        // Now write the individual entities
-        yyjson_mut_val *ent_arr = yyjson_mut_arr(doc);
-        for (Entity* ent : map.Entities())
+    static uint32_t GetMaterialIndex(BoxSections& out, const Material* material)
+    {
+        if (!material)
+            return box::NoMaterial;
+
+        auto [it, inserted] = out.materialIndices.try_emplace(material, out.materialCount);
+        if (inserted)
         {
-            yyjson_mut_val* ent_val = yyjson_mut_arr_add_obj(doc, ent_arr);
-            if (ent->IsBrushEntity())
+            out.materials.WriteString((std::string_view)material->GetPath());
+            out.materialCount++;
+        }
+        return it->second;
+    }
+
+    static void WriteEntityKVPairs(box::SectionWriter& out, const kv::KeyValues& kv)
+    {
+        // Patched once we know how many were actually written.
+        size_t countPos = out.data.size();
+        out.Write(uint32_t(0));
+
+        uint32_t count = 0;
+        for (const auto& [key, value] : kv)
+        {
+            auto type = value.GetType();
+            switch (type)
             {
-                WriteBrushEntity(doc, ent_val, static_cast<BrushEntity&>(*ent));
+                case kv::Types::String:
+                case kv::Types::Int:
+                case kv::Types::Float:
+                case kv::Types::Vector2:
+                case kv::Types::Vector3:
+                case kv::Types::Vector4:
+                    break;
+                default:
+                    // Nested keyvalues and pointers have no place in a map file.
+                    continue;
             }
-            else
+
+            out.WriteString(key);
+            out.Write(uint8_t(type));
+            switch (type)
             {
-                WritePointEntity(doc, ent_val, static_cast<PointEntity&>(*ent));
+                case kv::Types::String:  out.WriteString((std::string_view)value); break;
+                case kv::Types::Int:     out.Write((int64_t)value); break;
+                case kv::Types::Float:   out.Write((double)value); break;
+                case kv::Types::Vector2: out.Write((vec2)value); break;
+                case kv::Types::Vector3: out.Write((vec3)value); break;
+                case kv::Types::Vector4: out.Write((vec4)value); break;
+                default: break;
             }
+            count++;
         }
-        yyjson_mut_obj_add_val(doc, map_val, "entities", ent_arr);
+
+        memcpy(out.data.data() + countPos, &count, sizeof(count));
     }
 
-    bool ExportBox(std::string_view filepath, Map& map)
+    static void WriteEntity(BoxSections& out, const MapSnapshot::Entity& entity)
     {
-        std::string path_string = std::string(filepath);
-        FILE* file = fopen(path_string.c_str(), "wb");
-        if (!file)
+        out.entities.WriteString(entity.classname.empty() ? "worldspawn" : entity.classname); // TODO: worldspawn doesn't have a classname! should asset on no classname
+        out.entities.WriteString(entity.targetname);
+        out.entities.Write(entity.origin);
+        out.entities.Write(uint8_t(entity.brushEntity));
+        out.entities.Write(uint32_t(out.solids.size()));
+        out.entities.Write(uint32_t(entity.solids.size()));
+        WriteEntityKVPairs(out.entities, entity.kv);
+
+        for (const MapSnapshot::Solid& solid : entity.solids)
         {
-            return false;
+            out.solids.push_back(box::Solid{ uint32_t(out.sides.size()), uint32_t(solid.sides.size()) });
+
+            for (const Side& side : solid.sides)
+            {
+                out.planes.push_back(side.plane);
+                out.sides.push_back(box::Side{
+                    .textureAxes    = { side.textureAxes[0], side.textureAxes[1] },
+                    .scale          = { side.scale[0], side.scale[1] },
+                    .rotate         = side.rotate,
+                    .lightmapScale  = side.lightmapScale,
+                    .smoothing      = side.smoothing,
+                    .material       = GetMaterialIndex(out, side.material.ptr()),
+                });
+            }
         }
+    }
+
+    template <typename T> requires std::is_trivially_copyable_v<T>
+    static std::span<const uint8_t> AsBytes(const std::vector<T>& values)
+    {
+        return { reinterpret_cast<const uint8_t*>(values.data()), values.size() * sizeof(T) };
+    }
 
-        bool success = false;
+    /**
+     * Streams sections into a box file. Each section is compressed as its own
+     * zstd frame straight into the file, one fixed-size chunk at a time, so a
+     * save never holds more than the raw section and a single output chunk.
+     */
+    class BoxSectionStream
+    {
+    public:
+        BoxSectionStream(FILE* file, uint64_t offset)
+            : m_file(file)
+            , m_offset(offset)
+            , m_chunk(ZSTD_CStreamOutSize())
+        {
+            if (box_compression_level == 0)
+                return;
 
-        yyjson_mut_doc* doc = yyjson_mut_doc_new(NULL);
-        yyjson_mut_val* root = yyjson_mut_obj(doc);
-        yyjson_mut_doc_set_root(doc, root);
+            m_cctx = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, box_compression_level);
+            ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_checksumFlag, 1);
 
-        yyjson_mut_val* map_val = yyjson_mut_obj(doc);
-        WriteMap(doc, map_val, map);
-        yyjson_mut_obj_add_val(doc, root, "world", map_val);
+            // Fails harmlessly if zstd was built without threading support.
+            if (box_compression_threads > 0)
+                ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_nbWorkers, box_compression_threads);
+        }
 
-        size_t len = 0;
-        const char* json = yyjson_mut_write(doc, 0, &len);
-        success = json != nullptr;
+        ~BoxSectionStream()
+        {
+            ZSTD_freeCCtx(m_cctx);
+        }
 
-        if (success)
+        bool Write(box::Section& section, box::SectionID id, std::span<const uint8_t> raw)
         {
-            size_t bound = std::max<size_t>(ZSTD_compressBound(len) * 2, 128 * 1024 * 1024);
-            auto buffer = std::make_unique<uint8_t[]>(bound);
+            section.id      = id;
+            section.offset  = m_offset;
+            section.rawSize = raw.size();
 
-            if (box_compression_level != 0)
-            {
-                size_t compressed_size = ZSTD_compress(buffer.get(), bound, json, len, box_compression_level);
-                free((void*)json);
-                fwrite(buffer.get(), 1, compressed_size, file);
-            }
-            else
+            bool success = m_cctx
+                ? WriteCompressed(section, raw)
+                : WriteStored(section, raw);
+
+            m_offset += section.size;
+            return success;
+        }
+
+    private:
+        bool WriteStored(box::Section& section, std::span<const uint8_t> raw)
+        {
+            section.compression = box::Compression::None;
+            section.size        = raw.size();
+            return fwrite(raw.data(), 1, raw.size(), m_file) == raw.size();
+        }
+
+        bool WriteCompressed(box::Section& section, std::span<const uint8_t> raw)
+        {
+            section.compression = box::Compression::Zstd;
+            section.size        = 0;
+
+            // Keep the content size in the frame header so readers can allocate up front.
+            ZSTD_CCtx_reset(m_cctx, ZSTD_reset_session_only);
+            ZSTD_CCtx_setPledgedSrcSize(m_cctx, raw.size());
+
+            ZSTD_inBuffer in = { raw.data(), raw.size(), 0 };
+            size_t remaining;
+            do
             {
-                fwrite(buffer.get(), 1, len, file);
-                free((void*)json);
+                ZSTD_outBuffer out = { m_chunk.data(), m_chunk.size(), 0 };
+                remaining = ZSTD_compressStream2(m_cctx, &out, &in, ZSTD_e_end);
+                if (ZSTD_isError(remaining))
+                    return false;
+
+                if (fwrite(m_chunk.data(), 1, out.pos, m_file) != out.pos)
+                    return false;
+                section.size += out.pos;
             }
+            while (remaining != 0);
+
+            return true;
+        }
+
+        FILE* m_file;
+        uint64_t m_offset;
+        ZSTD_CCtx* m_cctx = nullptr;
+        std::vector<uint8_t> m_chunk;
+    };
+
+    bool ExportBox(std::string_view filepath, const MapSnapshot& map)
+    {
+        BoxSections sections;
+
+        // Entity count up front, the world goes first.
+        sections.entities.Write(uint32_t(map.entities.size() + 1));
+        sections.materials.Write(uint32_t(0));
+
+        WriteEntity(sections, map.world);
+        for (const MapSnapshot::Entity& entity : map.entities)
+            WriteEntity(sections, entity);
+
+        memcpy(sections.materials.data.data(), &sections.materialCount, sizeof(uint32_t));
+
+        std::string path_string = std::string(filepath);
+        FILE* file = fopen(path_string.c_str(), "wb");
+        if (!file)
+        {
+            return false;
         }
 
-        yyjson_mut_doc_free(doc);
-        fclose(file);
+        // The table of contents is written last, once the compressed sizes are known.
+        std::array<box::Section, 5> toc{};
+
+        box::Header header{};
+        header.magic        = box::Magic;
+        header.version      = box::Version;
+        header.sectionCount = uint32_t(toc.size());
+        const uint64_t dataOffset = sizeof(box::Header) + toc.size() * sizeof(box::Section);
+
+        bool success = fseek(file, long(dataOffset), SEEK_SET) == 0;
+        {
+            BoxSectionStream stream(file, dataOffset);
+            success = success &&
+                stream.Write(toc[0], box::SectionID::Materials, AsBytes(sections.materials.data)) &&
+                stream.Write(toc[1], box::SectionID::Entities,  AsBytes(sections.entities.data)) &&
+                stream.Write(toc[2], box::SectionID::Solids,    AsBytes(sections.solids)) &&
+                stream.Write(toc[3], box::SectionID::Planes,    AsBytes(sections.planes)) &&
+                stream.Write(toc[4], box::SectionID::Sides,     AsBytes(sections.sides));
+        }
+
+        success = success &&
+            fseek(file, 0, SEEK_SET) == 0 &&
+            fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(toc.data(), sizeof(box::Section), toc.size(), file) == toc.size();
+
+        success = fclose(file) == 0 && success;
         return success;
     }
 }
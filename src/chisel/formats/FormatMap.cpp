@@ -1,15 +1,18 @@
 #include "../Chisel.h"
+#include "common/BufferedWriter.h"
 
 namespace chisel
 {
     // Writes a single KV pair
-    static void WriteKVPair(std::ofstream& out, const std::string_view key, const std::string_view value)
+    static void WriteKVPair(BufferedWriter& out, const std::string_view key, const auto&... values)
     {
-        out << "\"" << key << "\"" << ' ' << "\"" << value << "\"\n";
+        out << '"' << key << "\" \"";
+        (out << ... << values);
+        out << "\"\n";
     }
 
     // Writes all KV pairs in an entity, including classname and targetname
-    static void WriteEntityKVPairs(std::ofstream& out, const Entity& entity)
+    static void WriteEntityKVPairs(BufferedWriter& out, const MapSnapshot::Entity& entity)
     {
         // Write classname
         if (entity.classname.empty())
@@ -22,9 +25,7 @@ namespace chisel
         }
 
         // Write the origin
-        char originString[64];
-        snprintf(originString, sizeof(originString), "%g %g %g", entity.origin.x, entity.origin.y, entity.origin.z);
-        WriteKVPair(out, "origin", originString);
+        WriteKVPair(out, "origin", entity.origin);
 
         // Write targetname
         if (!entity.targetname.empty())
@@ -35,91 +36,82 @@ namespace chisel
         // Write all keyvalues
         for (const auto& pair : entity.kv)
         {
-            WriteKVPair(out, pair.first, pair.second);
+            WriteKVPair(out, pair.first, (std::string_view)pair.second);
         }
     }
 
     // Point entity
-    static void WritePointEntity(std::ofstream& out, const PointEntity& entity)
+    static void WritePointEntity(BufferedWriter& out, const MapSnapshot::Entity& entity)
     {
         WriteEntityKVPairs(out, entity);
     }
 
     // Brush entity
-    static void WriteBrushEntity(std::ofstream& out, BrushEntity& entity)
+    static void WriteBrushEntity(BufferedWriter& out, const MapSnapshot::Entity& entity)
     {
         WriteEntityKVPairs(out, entity);
 
-        for (Solid& solid : entity.Brushes())
+        for (const MapSnapshot::Solid& solid : entity.solids)
         {
             out << "{\n";
 
-            for (const Face& face : solid.GetFaces())
+            for (const MapSnapshot::Face& face : solid.faces)
             {
                 assert(face.points.size() >= 3);
 
-                std::string_view materialName = face.side->material != nullptr ? (const char*)face.side->material->GetPath() : "DEFAULT";
+                const Side& side = solid.sides[face.sideIdx];
+
+                std::string_view materialName = side.material != nullptr ? (const char*)side.material->GetPath() : "DEFAULT";
                 if (materialName.starts_with("materials/") || materialName.starts_with("materials\\"))
                     materialName = materialName.substr(10);
                 if (materialName.ends_with(".vmt"))
                     materialName = materialName.substr(0, materialName.length() - 4);
 
-                char str[512];
-                snprintf(str, sizeof(str),
-                    "( %g %g %g ) ( %g %g %g ) ( %g %g %g ) %.*s [ %g %g %g %g ] [ %g %g %g %g ] %g %g %g \n",
-                    face.points[0].x, face.points[0].y, face.points[0].z,
-                    face.points[1].x, face.points[1].y, face.points[1].z,
-                    face.points[2].x, face.points[2].y, face.points[2].z,
-                    int(materialName.length()), materialName.data(),
-                    face.side->textureAxes[0].x, face.side->textureAxes[0].y, face.side->textureAxes[0].z, face.side->textureAxes[0].w,
-                    face.side->textureAxes[1].x, face.side->textureAxes[1].y, face.side->textureAxes[1].z, face.side->textureAxes[1].w,
-                    face.side->rotate,
-                    face.side->scale[0],
-                    face.side->scale[1]
-                );
-
-                out << str;
+                out << "( " << face.points[0] << " ) ( " << face.points[1] << " ) ( " << face.points[2] << " ) "
+                    << materialName
+                    << " [ " << side.textureAxes[0] << " ] [ " << side.textureAxes[1] << " ] "
+                    << side.rotate << ' ' << side.scale[0] << ' ' << side.scale[1] << " \n";
             }
 
             out << "}\n";
         }
     }
 
-    static void WriteMap(std::ofstream& out, Map& map)
+    static void WriteMap(BufferedWriter& out, const MapSnapshot& map)
     {
         // Write the world first
         out << "{\n";
-        WriteBrushEntity(out, map);
+        WriteBrushEntity(out, map.world);
         out << "}\n";
 
         // Now write the individual entities
-        for (Entity* ent : map.Entities())
+        for (const MapSnapshot::Entity& ent : map.entities)
         {
             out << "{\n";
 
-            if (ent->IsBrushEntity())
+            if (ent.brushEntity)
             {
-                WriteBrushEntity(out, static_cast<BrushEntity&>(*ent));
+                WriteBrushEntity(out, ent);
             }
             else
             {
-                WritePointEntity(out, static_cast<PointEntity&>(*ent));
+                WritePointEntity(out, ent);
             }
 
             out << "}\n";
         }
     }
 
-    bool ExportMap(std::string_view filepath, Map& map)
+    bool ExportMap(std::string_view filepath, const MapSnapshot& map)
     {
-        std::ofstream out = std::ofstream(std::string(filepath));
-        if (out.bad())
+        BufferedWriter out;
+        if (!out.Open(filepath))
         {
             return false;
         }
 
         WriteMap(out, map);
-        return true;
+        return out.Close();
     }
 
 }
@@ -1,5 +1,9 @@
 #include "../Chisel.h"
 #include "../FGD/FGD.h"
+#include "common/BufferedWriter.h"
+#include "common/Time.h"
+
+#include <unordered_map>
 
 namespace chisel
 {
@@ -8,20 +12,79 @@ namespace chisel
     // Good enough for now.
     static uint32_t s_VMFUniqueID = 0;
 
-    static void WriteKVPair(std::ofstream& out, const std::string_view key, const std::string_view value)
+    // Writes "key" "value", where the value is built from any number of parts
+    static void WriteKVPair(BufferedWriter& out, const std::string_view key, const auto&... values)
+    {
+        out << '"' << key << "\" \"";
+        (out << ... << values);
+        out << "\"\n";
+    }
+
+    // Writes a displacement field as a block of "rowN" keys.
+    // Each row is built straight from the verts, 'get' picks the value out of one vert.
+    static void WriteDispField(BufferedWriter& out, const std::string_view name, const DispInfo& disp, const auto& get)
+    {
+        out << name << "\n";
+        out << "{\n";
+
+        for (int y = 0; y < disp.length; y++)
+        {
+            const DispVert* row = disp[y];
+
+            out << "\"row" << y << "\" \"";
+            for (int x = 0; x < disp.length; x++)
+            {
+                if (x != 0)
+                    out << ' ';
+                out << get(row[x]);
+            }
+            out << "\"\n";
+        }
+
+        out << "}\n";
+    }
+
+    static void WriteDispTriangleTags(BufferedWriter& out, const DispInfo& disp)
     {
-        out << "\"" << key << "\"" << ' ' << "\"" << value << "\"\n";
+        out << "triangle_tags\n";
+        out << "{\n";
+
+        // 2 triangles per quad, one row per row of quads
+        const int rowLength = (disp.length - 1) * 2;
+        for (int y = 0; y < disp.length - 1; y++)
+        {
+            out << "\"row" << y << "\" \"";
+            for (int x = 0; x < rowLength; x++)
+            {
+                if (x != 0)
+                    out << ' ';
+                out << disp.triangleTags[y * rowLength + x];
+            }
+            out << "\"\n";
+        }
+
+        out << "}\n";
     }
 
-    static void WriteKVPair(std::ofstream& out, const std::string_view key, const char* fmt, auto... args)
+    static void WriteDispAllowedVerts(BufferedWriter& out, const DispInfo& disp)
     {
-        char tmp[1024];
-        snprintf(tmp, 1024, fmt, args...);
-        out << "\"" << key << "\"" << ' ' << "\"" << tmp << "\"\n";
+        out << "allowed_verts\n";
+        out << "{\n";
+
+        out << "\"" << disp.allowedVerts.size() << "\" \"";
+        for (size_t i = 0; i < disp.allowedVerts.size(); i++)
+        {
+            if (i != 0)
+                out << ' ';
+            out << disp.allowedVerts[i];
+        }
+        out << "\"\n";
+
+        out << "}\n";
     }
 
     // Writes all KV pairs in an entity, including classname and targetname
-    static void WriteEntityKVPairs(std::ofstream& out, const Entity& entity)
+    static void WriteEntityKVPairs(BufferedWriter& out, const MapSnapshot::Entity& entity)
     {
         // Write classname
         if (entity.classname.empty())
@@ -34,7 +97,7 @@ namespace chisel
         }
 
         // Write the origin
-        WriteKVPair(out, "origin", "%g %g %g", entity.origin.x, entity.origin.y, entity.origin.z);
+        WriteKVPair(out, "origin", entity.origin);
 
         // Write targetname
         if (!entity.targetname.empty())
@@ -45,34 +108,36 @@ namespace chisel
         // Write all keyvalues
         for (const auto& pair : entity.kv)
         {
-            WriteKVPair(out, pair.first, pair.second);
+            WriteKVPair(out, pair.first, (std::string_view)pair.second);
         }
     }
 
-    static void WritePointEntity(std::ofstream& out, PointEntity& entity)
+    static void WritePointEntity(BufferedWriter& out, const MapSnapshot::Entity& entity)
     {
         WriteEntityKVPairs(out, entity);
     }
 
-    static void WriteBrushEntity(std::ofstream& out, BrushEntity& entity)
+    static void WriteBrushEntity(BufferedWriter& out, const MapSnapshot::Entity& entity)
     {
         WriteEntityKVPairs(out, entity);
 
-        for (Solid& solid : entity.Brushes())
+        for (const MapSnapshot::Solid& solid : entity.solids)
         {
             out << "solid\n";
             out << "{\n";
 
-            WriteKVPair(out, "id", "%u", s_VMFUniqueID++);
+            WriteKVPair(out, "id", s_VMFUniqueID++);
 
-            for (const Face& face : solid.GetFaces())
+            for (const MapSnapshot::Face& face : solid.faces)
             {
+                const Side& side = solid.sides[face.sideIdx];
+
                 out << "side\n";
                 out << "{\n";
 
-                WriteKVPair(out, "id", "%u", s_VMFUniqueID++);
+                WriteKVPair(out, "id", s_VMFUniqueID++);
 
-                std::string_view materialName = face.side->material != nullptr ? (const char*)face.side->material->GetPath() : "DEFAULT";
+                std::string_view materialName = side.material != nullptr ? (const char*)side.material->GetPath() : "DEFAULT";
                 if (materialName.starts_with("materials/") || materialName.starts_with("materials\\"))
                     materialName = materialName.substr(10);
                 if (materialName.ends_with(".vmt"))
@@ -80,36 +145,34 @@ namespace chisel
                 WriteKVPair(out, "material", materialName);
 
                 WriteKVPair(out, "plane",
-                    "(%g %g %g) (%g %g %g) (%g %g %g)",
-                    face.points[0].x, face.points[0].y, face.points[0].z,
-                    face.points[1].x, face.points[1].y, face.points[1].z,
-                    face.points[2].x, face.points[2].y, face.points[2].z);
-
-                WriteKVPair(out, "uaxis",
-                    "[%g %g %g %g] %g",
-                    face.side->textureAxes[0].x, face.side->textureAxes[0].y, face.side->textureAxes[0].z, face.side->textureAxes[0].w, face.side->scale[0]);
-
-                WriteKVPair(out, "vaxis",
-                    "[%g %g %g %g] %g",
-                    face.side->textureAxes[1].x, face.side->textureAxes[1].y, face.side->textureAxes[1].z, face.side->textureAxes[1].w, face.side->scale[1]);
-
-                WriteKVPair(out, "rotation", "%g", face.side->rotate);
-                WriteKVPair(out, "lightmapscale", "%g", face.side->lightmapScale);
-                WriteKVPair(out, "smoothing_groups", "%u", face.side->smoothing);
+                    '(', face.points[0], ") (", face.points[1], ") (", face.points[2], ')');
+
+                WriteKVPair(out, "uaxis", '[', side.textureAxes[0], "] ", side.scale[0]);
+                WriteKVPair(out, "vaxis", '[', side.textureAxes[1], "] ", side.scale[1]);
+
+                WriteKVPair(out, "rotation", side.rotate);
+                WriteKVPair(out, "lightmapscale", side.lightmapScale);
+                WriteKVPair(out, "smoothing_groups", side.smoothing);
                 
-                if (face.side->disp.has_value())
+                if (side.disp.has_value())
                 {
                     out << "dispinfo\n";
                     out << "{\n";
 
-                    WriteKVPair(out, "power", "%d", face.side->disp->power);
-                    WriteKVPair(out, "startposition", "[%g %g %g]",
-                        face.side->disp->startPos.x, face.side->disp->startPos.y, face.side->disp->startPos.z);
-                    WriteKVPair(out, "elevation", "%g", face.side->disp->elevation);
-                    WriteKVPair(out, "subdiv", "%u", face.side->disp->subdiv);
-                    WriteKVPair(out, "flags", "%u", face.side->disp->flags);
-
-                    // TODO: Displacement vertex data
+                    WriteKVPair(out, "power", side.disp->power);
+                    WriteKVPair(out, "startposition", '[', side.disp->startPos, ']');
+                    WriteKVPair(out, "elevation", side.disp->elevation);
+                    WriteKVPair(out, "subdiv", uint(side.disp->subdiv));
+                    WriteKVPair(out, "flags", side.disp->flags);
+
+                    const DispInfo& disp = *side.disp;
+                    WriteDispField(out, "normals",        disp, [](const DispVert& v) { return v.normal; });
+                    WriteDispField(out, "distances",      disp, [](const DispVert& v) { return v.dist; });
+                    WriteDispField(out, "offsets",        disp, [](const DispVert& v) { return v.offset; });
+                    WriteDispField(out, "offset_normals", disp, [](const DispVert& v) { return v.offsetNormal; });
+                    WriteDispField(out, "alphas",         disp, [](const DispVert& v) { return v.alpha; });
+                    WriteDispTriangleTags(out, disp);
+                    WriteDispAllowedVerts(out, disp);
 
                     out << "}\n";
                 }
@@ -122,48 +185,48 @@ namespace chisel
         }
     }
 
-    static void WriteMap(std::ofstream& out, Map& map)
+    static void WriteMap(BufferedWriter& out, const MapSnapshot& map)
     {
         out << "world\n";
         out << "{\n";
 
-        WriteKVPair(out, "id", "%u", s_VMFUniqueID++);
+        WriteKVPair(out, "id", s_VMFUniqueID++);
 
-        WriteBrushEntity(out, map);
+        WriteBrushEntity(out, map.world);
 
         out << "}\n";
 
         // Now write the individual entities
-        for (Entity* ent : map.Entities())
+        for (const MapSnapshot::Entity& ent : map.entities)
         {
             out << "entity\n";
             out << "{\n";
 
-            if (ent->IsBrushEntity())
+            if (ent.brushEntity)
             {
-                WriteBrushEntity(out, static_cast<BrushEntity&>(*ent));
+                WriteBrushEntity(out, ent);
             }
             else
             {
-                WritePointEntity(out, static_cast<PointEntity&>(*ent));
+                WritePointEntity(out, ent);
             }
 
             out << "}\n";
         }
     }
 
-    bool ExportVMF(std::string_view filepath, Map& map)
+    bool ExportVMF(std::string_view filepath, const MapSnapshot& map)
     {
         s_VMFUniqueID = 0;
 
-        std::ofstream out = std::ofstream(std::string(filepath));
-        if (out.bad())
+        BufferedWriter out;
+        if (!out.Open(filepath))
         {
             return false;
         }
 
         WriteMap(out, map);
-        return true;
+        return out.Close();
     }
 
     static Plane ParsePlane(std::string_view string)
@@ -214,6 +277,14 @@ namespace chisel
     using DispField1 = std::vector<DispRow1>;
     using DispField3 = std::vector<DispRow3>;
 
+    // "row12" -> 12
+    static size_t ParseRowIndex(std::string_view key)
+    {
+        if (!key.starts_with("row"))
+            return SIZE_MAX;
+        return stream::ParseSimple<size_t>(key.substr(3));
+    }
+
     static DispRow1 ParseRow1(std::string_view value)
     {
         DispRow1 row;
@@ -244,8 +315,9 @@ namespace chisel
         field.resize(obj.ChildCount());
         for (auto& [key, value] : obj)
         {
-            int i = key[3] - '0';
-            field[i] = ParseRow1(value);
+            size_t i = ParseRowIndex(key);
+            if (i < field.size())
+                field[i] = ParseRow1(value);
         }
         return field;
     }
@@ -256,14 +328,76 @@ namespace chisel
         field.resize(obj.ChildCount());
         for (auto& [key, value] : obj)
         {
-            int i = key[3] - '0';
-            field[i] = ParseRow3(value);
+            size_t i = ParseRowIndex(key);
+            if (i < field.size())
+                field[i] = ParseRow3(value);
         }
         return field;
     }
 
 
-    static bool AddSolid(BrushEntity& map, kv::KeyValues& kvWorld, std::string& matNameScratch)
+    // Per-import state. A big map has hundreds of thousands of sides but only
+    // a few hundred materials, so those get resolved once per name up front.
+    // Props are the same, thousands of entities share a few models.
+    struct VMFImport
+    {
+        struct NameHash
+        {
+            using is_transparent = void;
+            size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+        };
+
+        std::unordered_map<std::string, Rc<Material>, NameHash, std::equal_to<>> materials;
+        std::unordered_map<std::string, Rc<Mesh>, NameHash, std::equal_to<>> models;
+        Time::Seconds meshTime = 0;
+    };
+
+    static Rc<Mesh> LoadModel(std::string_view name, VMFImport& import)
+    {
+        auto it = import.models.find(name);
+        if (it == import.models.end())
+            it = import.models.emplace(name, Assets.Load<Mesh>(PathKey(name))).first;
+        return it->second;
+    }
+
+    static void CollectMaterials(kv::KeyValues& kvBrushes, VMFImport& import)
+    {
+        auto solids = kvBrushes.FindAll("solid");
+        for (; solids.first != solids.second; solids.first++)
+        {
+            auto& solid = solids.first->second;
+            if (solid.GetType() != kv::Types::KeyValues)
+                continue;
+
+            auto sides = ((kv::KeyValues&)solid).FindAll("side");
+            for (; sides.first != sides.second; sides.first++)
+            {
+                auto& side = sides.first->second;
+                if (side.GetType() != kv::Types::KeyValues)
+                    continue;
+
+                auto name = (std::string_view)((kv::KeyValues&)side)["material"];
+                if (!import.materials.contains(name))
+                    import.materials.emplace(name, nullptr);
+            }
+        }
+    }
+
+    static void QueueMaterials(VMFImport& import)
+    {
+        std::string path;
+        for (auto& [name, material] : import.materials)
+        {
+            path = "materials/";
+            path += name;
+            path += ".vmt";
+
+            // Only queues the load, the VMTs are read and parsed in parallel on the loader threads.
+            material = Assets.LoadAsync<Material>(PathKey(path));
+        }
+    }
+
+    static bool AddSolid(BrushEntity& map, kv::KeyValues& kvWorld, VMFImport& import)
     {
         std::vector<Side> sideData;
 
@@ -287,11 +421,11 @@ namespace chisel
 
                 Side thisSide{};
                 thisSide.plane = ParsePlane(kvSide["plane"]);
-                matNameScratch = "materials/";
-                matNameScratch += (std::string_view)kvSide["material"];
-                matNameScratch += ".vmt";
 
-                thisSide.material = Assets.Load<Material>(matNameScratch);
+                auto material = import.materials.find((std::string_view)kvSide["material"]);
+                if (material != import.materials.end())
+                    thisSide.material = material->second;
+
                 ParseAxis(kvSide["uaxis"], thisSide.textureAxes[0], thisSide.scale[0]);
                 ParseAxis(kvSide["vaxis"], thisSide.textureAxes[1], thisSide.scale[1]);
                 thisSide.rotate = kvSide["rotate"];
@@ -312,7 +446,6 @@ namespace chisel
                     DispField3 offsets = ParseField3(kvDisp["offsets"]);
                     DispField3 offset_normals = ParseField3(kvDisp["offset_normals"]);
                     DispField1 alphas = ParseField1(kvDisp["alphas"]);
-                    // TODO: triangle_tags, allowed_verts
 
                     for (uint y = 0; y < thisSide.disp->length; y++)
                     {
@@ -327,6 +460,31 @@ namespace chisel
                             (*thisSide.disp)[y][x] = vert;
                         }
                     }
+
+                    if (kvDisp.Contains("triangle_tags"))
+                    {
+                        DispField1 tags = ParseField1(kvDisp["triangle_tags"]);
+                        // One row per row of quads, anything past that doesn't fit the displacement
+                        const uint rows = thisSide.disp->length - 1;
+                        const uint rowLength = rows * 2;
+                        for (uint y = 0; y < rows && y < tags.size(); y++)
+                        {
+                            for (uint x = 0; x < rowLength && x < tags[y].size(); x++)
+                                thisSide.disp->triangleTags[y * rowLength + x] = uint16_t(tags[y][x]);
+                        }
+                    }
+
+                    if (kvDisp.Contains("allowed_verts"))
+                    {
+                        kv::KeyValues& kvAllowed = kvDisp["allowed_verts"];
+                        for (auto& [key, value] : kvAllowed)
+                        {
+                            // Bitfields, parse as ints so they don't go through a float.
+                            auto numbers = str::split(value, " ");
+                            for (size_t i = 0; i < numbers.size() && i < thisSide.disp->allowedVerts.size(); i++)
+                                thisSide.disp->allowedVerts[i] = stream::ParseSimple<int>(numbers[i]);
+                        }
+                    }
                 }
 
                 sideData.emplace_back(thisSide);
@@ -334,8 +492,10 @@ namespace chisel
                 sides.first++;
             }
 
+            Time::Seconds meshStart = Time::GetTime();
             auto& brush = map.AddBrush(std::move(sideData));
             brush.UpdateMesh();
+            import.meshTime += Time::GetTime() - meshStart;
             sideData.clear();
 
             solids.first++;
@@ -343,7 +503,7 @@ namespace chisel
         return true;
     }
 
-    static bool AddEntity(Map& map, kv::KeyValues& kvEntity, std::string& matNameScratch)
+    static bool AddEntity(Map& map, kv::KeyValues& kvEntity, VMFImport& import)
     {
         auto solids = kvEntity.FindAll("solid");
         std::string classname = std::string(kvEntity["classname"]);
@@ -355,7 +515,7 @@ namespace chisel
         if (point && prop)
         {
             ModelEntity* model = new ModelEntity(&map);
-            model->model = Assets.Load<Mesh>((std::string)kvEntity["model"]);
+            model->model = LoadModel((std::string_view)kvEntity["model"], import);
             entity = model;
         }
         else if (point)
@@ -366,7 +526,7 @@ namespace chisel
         else
         {
             BrushEntity* brush = new BrushEntity(&map);
-            AddSolid(*brush, kvEntity, matNameScratch);
+            AddSolid(*brush, kvEntity, import);
             entity = brush;
         }
 
@@ -386,6 +546,8 @@ namespace chisel
 
     bool ImportVMF(std::string_view filepath, Map& map)
     {
+        Time::Seconds startTime = Time::GetTime();
+
         auto text = fs::readTextFile(filepath);
         if (!text)
             return false;
@@ -398,19 +560,31 @@ namespace chisel
         if (world.GetType() != kv::Types::KeyValues)
             return false;
 
+        kv::KeyValues& kvWorld = (kv::KeyValues&)world;
+        auto entities = kv->FindAll("entity");
+
+        Time::Seconds parseTime = Time::GetTime();
+
+        // Queue every material the map uses in one batch, they finish loading in the background.
+        VMFImport import;
+        CollectMaterials(kvWorld, import);
+        for (auto it = entities.first; it != entities.second; it++)
+        {
+            if (it->second.GetType() == kv::Types::KeyValues)
+                CollectMaterials((kv::KeyValues&)it->second, import);
+        }
+        QueueMaterials(import);
+
+        Time::Seconds queueTime = Time::GetTime();
+
         // Add solids.
-        Chisel.brushAllocator->open();
         {
-            std::string matname;
-            kv::KeyValues& kvWorld = (kv::KeyValues&)world;
+            BrushUploadScope upload(Chisel.brushAllocator.get());
+
             // TODO: Do we want to parse the other "worldspawn" KVs?
-            if (!AddSolid(map, kvWorld, matname))
-            {
-                Chisel.brushAllocator->close();
+            if (!AddSolid(map, kvWorld, import))
                 return false;
-            }
 
-            auto entities = kv->FindAll("entity");
             while (entities.first != entities.second)
             {
                 auto& entity = entities.first->second;
@@ -418,16 +592,20 @@ namespace chisel
                     return false;
 
                 kv::KeyValues& kvEntity = (kv::KeyValues&)entity;
-                if (!AddEntity(map, kvEntity, matname))
-                {
-                    Chisel.brushAllocator->close();
+                if (!AddEntity(map, kvEntity, import))
                     return false;
-                }
 
                 entities.first++;
             }
         }
-        Chisel.brushAllocator->close();
+
+        Time::Seconds endTime = Time::GetTime();
+        Console.Log("[VMF] Imported '{}' in {:.2f}s (parse {:.2f}s, queue {} materials {:.2f}s, meshes {:.2f}s, other {:.2f}s)",
+            filepath, endTime - startTime,
+            parseTime - startTime,
+            import.materials.size(), queueTime - parseTime,
+            import.meshTime,
+            endTime - queueTime - import.meshTime);
 
         // TODO: Load cameras...
 
@@ -1,11 +1,18 @@
 #pragma once
 
+#include "chisel/map/MapSnapshot.h"
+
 namespace chisel
 {
-    bool ExportBox(std::string_view filepath, Map& map);
-    bool ExportMap(std::string_view filepath, Map& map);
-    bool ExportVMF(std::string_view filepath, Map& map);
+    // Exporters only read from the snapshot and are safe to run off the main thread.
+    bool ExportBox(std::string_view filepath, const MapSnapshot& map);
+    bool ExportMap(std::string_view filepath, const MapSnapshot& map);
+    bool ExportVMF(std::string_view filepath, const MapSnapshot& map);
+
+    // Picks one of the above by the file's extension.
+    bool ExportSnapshot(std::string_view filepath, const MapSnapshot& map);
 
+    // Importers create assets and GPU resources and must run on the main thread.
     bool ImportBox(std::string_view filepath, Map& map);
     bool ImportVMF(std::string_view filepath, Map& map);
 }
@@ -126,4 +126,28 @@ namespace chisel
         uint8_t*                   m_base = nullptr;
         uint32_t                   m_refs = 0;
     };
+
+    // Keeps the brush buffer mapped while lots of brushes are built at once.
+    // Headless there is no allocator, and brushes are only built on the CPU.
+    struct BrushUploadScope
+    {
+        explicit BrushUploadScope(BrushGPUAllocator* allocator)
+            : m_allocator(allocator)
+        {
+            if (m_allocator)
+                m_allocator->open();
+        }
+
+        ~BrushUploadScope()
+        {
+            if (m_allocator)
+                m_allocator->close();
+        }
+
+        BrushUploadScope(const BrushUploadScope&) = delete;
+        BrushUploadScope& operator=(const BrushUploadScope&) = delete;
+
+    private:
+        BrushGPUAllocator* m_allocator;
+    };
 }
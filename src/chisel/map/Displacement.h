@@ -2,6 +2,7 @@
 
 #include "math/Math.h"
 
+#include <array>
 #include <vector>
 #include <memory>
 
@@ -25,6 +26,8 @@ namespace chisel
         bool                    subdiv;
         int                     flags;
         std::vector<DispVert>   verts;
+        std::vector<uint16_t>   triangleTags;   // 2 per quad, row-major. Walkable/buildable bits etc.
+        std::array<int, 10>     allowedVerts;   // Bitfield of verts allowed to move when sewing neighbours
         int                     pointStartIndex = -1;
 
         DispInfo(int power)
@@ -32,6 +35,8 @@ namespace chisel
             length((1 << power) + 1)
         {
             verts.resize(length * length);
+            triangleTags.resize(GetTriangleCount());
+            allowedVerts.fill(-1);
         }
 
         DispVert* operator[](int row)
@@ -39,6 +44,17 @@ namespace chisel
             return &verts[row * length];
         }
 
+        const DispVert* operator[](int row) const
+        {
+            return &verts[row * length];
+        }
+
+        uint GetTriangleCount() const
+        {
+            int quadLength = length - 1;
+            return 2 * quadLength * quadLength;
+        }
+
         uint GetIndexCount()
         {
             // 2^n x 2^m quads, 2 tris per quad, 3 verts per tri.
@@ -38,10 +38,12 @@ namespace chisel
     void PointEntity::Transform(const mat4x4& matrix)
     {
         origin = matrix * vec4(origin, 1.0f);
+        Map::MarkEdited();
     }
     void PointEntity::AlignToGrid(vec3 gridSize)
     {
         origin = math::Snap(origin, gridSize);
+        Map::MarkEdited();
     }
     Selectable* PointEntity::Duplicate()
     {
@@ -109,12 +111,14 @@ namespace chisel
 
     Solid& BrushEntity::AddBrush(std::vector<Side> sides)
     {
+        Map::MarkEdited();
         return m_solids.emplace_back(this, sides);
     }
 
     void BrushEntity::RemoveBrush(const Solid& brush)
     {
         m_solids.remove(brush);
+        Map::MarkEdited();
     }
 
     std::optional<RayHit> BrushEntity::QueryRay(const Ray& ray) const
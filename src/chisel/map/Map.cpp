@@ -2,6 +2,28 @@
 
 namespace chisel
 {
+    static void SnapshotEntity(MapSnapshot::Entity& snapshot, Entity& entity)
+    {
+        snapshot.classname  = entity.classname;
+        snapshot.targetname = entity.targetname;
+        snapshot.origin     = entity.origin;
+        snapshot.kv         = entity.kv;
+
+        if (!entity.IsBrushEntity())
+            return;
+
+        snapshot.brushEntity = true;
+        for (Solid& solid : static_cast<BrushEntity&>(entity).Brushes())
+        {
+            MapSnapshot::Solid& solidSnapshot = snapshot.solids.emplace_back();
+            solidSnapshot.sides = solid.GetSides();
+
+            solidSnapshot.faces.reserve(solid.GetFaces().size());
+            for (const Face& face : solid.GetFaces())
+                solidSnapshot.faces.push_back(MapSnapshot::Face{ face.sideIdx, face.points });
+        }
+    }
+
     Map::Map()
         : BrushEntity(nullptr)
     {
@@ -19,6 +41,7 @@ namespace chisel
 
     void Map::Clear()
     {
+        MarkEdited();
         m_solids.clear();
         for (Entity* ent : m_entities)
             delete ent;
@@ -30,11 +53,24 @@ namespace chisel
         return true;
     }
 
+    MapSnapshot Map::Snapshot()
+    {
+        MapSnapshot snapshot;
+        SnapshotEntity(snapshot.world, *this);
+
+        snapshot.entities.resize(m_entities.size());
+        for (size_t i = 0; i < m_entities.size(); i++)
+            SnapshotEntity(snapshot.entities[i], *m_entities[i]);
+
+        return snapshot;
+    }
+
     PointEntity* Map::AddPointEntity(const char* classname)
     {
         PointEntity* ent = new PointEntity(this);
         ent->classname = classname;
         m_entities.push_back(ent);
+        MarkEdited();
         return ent;
     }
 
@@ -42,6 +78,7 @@ namespace chisel
     {
         // CHANGE ME
         m_entities.push_back(entity);
+        MarkEdited();
     }
 
     void Map::RemoveEntity(Entity& entity)
@@ -54,5 +91,6 @@ namespace chisel
             m_entities.end());
 
         delete &entity;
+        MarkEdited();
     }
 }
@@ -4,6 +4,7 @@
 
 #include "Entity.h"
 #include "Action.h"
+#include "MapSnapshot.h"
 
 namespace chisel
 {
@@ -28,12 +29,38 @@ namespace chisel
         void RemoveEntity(Entity& entity);
 
         auto Entities() { return IteratorPassthru(m_entities); }
+
+        // Calls func(Solid&) for every brush, the world's and every brush entity's.
+        void ForEachBrush(auto func)
+        {
+            for (Solid& solid : Brushes())
+                func(solid);
+
+            for (Entity* entity : m_entities)
+            {
+                if (!entity->IsBrushEntity())
+                    continue;
+
+                for (Solid& solid : static_cast<BrushEntity*>(entity)->Brushes())
+                    func(solid);
+            }
+        }
         ActionList& Actions() { return m_actions; }
 
+        // Bumped by every change to brushes and entities, so views can tell
+        // when what they drew is out of date. Shared by all maps for now.
+        static uint64 EditGeneration() { return s_editGeneration; }
+        static void MarkEdited() { s_editGeneration++; }
+
+        // Copies the document into a snapshot that can be exported off the main thread.
+        MapSnapshot Snapshot();
+
     private:
         // TODO: Polymorphic linked list
         std::vector<Entity*> m_entities;
 
         ActionList m_actions;
+
+        static inline uint64 s_editGeneration = 0;
     };
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Face.h"
+#include "formats/KeyValues.h"
+
+#include <string>
+#include <vector>
+
+namespace chisel
+{
+    /**
+     * A self-contained copy of everything the exporters need from a map.
+     *
+     * Taken on the main thread in a single frame, it shares nothing mutable
+     * with the live document, so formatting, compressing and writing it out
+     * can happen on a worker thread while editing carries on.
+     *
+     * Materials are held by Rc. Drop the snapshot on the main thread so the
+     * last reference to an asset is never released from a worker.
+     */
+    struct MapSnapshot
+    {
+        struct Face
+        {
+            uint sideIdx;
+            std::vector<vec3> points;
+        };
+
+        struct Solid
+        {
+            std::vector<Side> sides;
+            std::vector<Face> faces;
+        };
+
+        struct Entity
+        {
+            std::string classname;
+            std::string targetname;
+            vec3 origin = vec3(0.0f);
+            kv::KeyValues kv;
+
+            bool brushEntity = false;
+            std::vector<Solid> solids;
+        };
+
+        Entity world;
+        std::vector<Entity> entities;
+    };
+}
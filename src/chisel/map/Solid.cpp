@@ -3,6 +3,7 @@
 #include "common/Bit.h"
 #include "math/Winding.h"
 
+#include <algorithm>
 #include <unordered_set>
 
 namespace chisel
@@ -18,6 +19,14 @@ namespace chisel
     ConVar<bool> r_displacements("r_displacements", true, "Render displacements", RebuildDisplacements);
     ConVar<bool> r_disp_mask_solid("r_disp_mask_solid", true, "Hide unused faces of displacement brushes", RebuildDisplacements);
 
+    // Solids by the material or texture they're waiting for. Never destroyed,
+    // solids in other static objects unregister themselves on the way out.
+    static std::unordered_map<const Asset*, std::unordered_set<Solid*>>& Waiting()
+    {
+        static auto* waiting = new std::unordered_map<const Asset*, std::unordered_set<Solid*>>;
+        return *waiting;
+    }
+
     Solid::Solid(BrushEntity* parent)
         : Atom(parent)
     {
@@ -52,10 +61,74 @@ namespace chisel
 
         for (auto& face : m_faces)
             face.solid = this;
+
+        m_waitingOn = std::move(other.m_waitingOn);
+        other.m_waitingOn.clear();
+        for (const Asset* asset : m_waitingOn)
+        {
+            auto& solids = Waiting()[asset];
+            solids.erase(&other);
+            solids.insert(this);
+        }
     }
         
     Solid::~Solid()
     {
+        StopWaiting();
+    }
+
+    void Solid::WaitForAssets()
+    {
+        StopWaiting();
+
+        for (const Side& side : m_sides)
+        {
+            const Material* material = side.material.ptr();
+            if (!material)
+                continue;
+
+            // The base texture is only requested once the material has loaded.
+            const Asset* pending = nullptr;
+            if (material->IsLoading())
+                pending = material;
+            else if (material->baseTexture && material->baseTexture->IsLoading())
+                pending = material->baseTexture.ptr();
+
+            if (pending && std::find(m_waitingOn.begin(), m_waitingOn.end(), pending) == m_waitingOn.end())
+            {
+                m_waitingOn.push_back(pending);
+                Waiting()[pending].insert(this);
+            }
+        }
+    }
+
+    void Solid::StopWaiting()
+    {
+        for (const Asset* asset : m_waitingOn)
+        {
+            auto it = Waiting().find(asset);
+            if (it == Waiting().end())
+                continue;
+
+            it->second.erase(this);
+            if (it->second.empty())
+                Waiting().erase(it);
+        }
+        m_waitingOn.clear();
+    }
+
+    void Solid::AssetsLoaded(std::span<Asset* const> assets)
+    {
+        std::unordered_set<Solid*> stale;
+        for (Asset* asset : assets)
+        {
+            auto node = Waiting().extract(asset);
+            if (!node.empty())
+                stale.merge(node.mapped());
+        }
+
+        for (Solid* solid : stale)
+            solid->UpdateMesh();
     }
 
     void Solid::Clip(Side side)
@@ -69,14 +142,18 @@ namespace chisel
         static bit::bitvector sideSelected;
         static std::unordered_set<AssetID> uniqueMaterials;
 
-        BrushGPUAllocator& a = *Chisel.brushAllocator;
+        Map::MarkEdited();
+        WaitForAssets();
+
+        // Null when running headless, meshes are still built for the tools.
+        BrushGPUAllocator* a = Chisel.brushAllocator.get();
 
         // TODO: Avoid clearing meshes out every time.
         for (auto& mesh : m_meshes)
         {
             if (mesh.alloc)
             {
-                a.free(*mesh.alloc);
+                a->free(*mesh.alloc);
                 mesh.alloc = std::nullopt;
             }
         }
@@ -222,11 +299,11 @@ namespace chisel
                 float mappingHeight = 32.0f;
                 if (face.side->material != nullptr && face.side->material->baseTexture != nullptr && face.side->material->baseTexture->texture != nullptr)
                 {
-                    D3D11_TEXTURE2D_DESC desc;
-                    face.side->material->baseTexture->texture->GetDesc(&desc);
+                    // Not the resident size, streamed textures may only have their small mips loaded.
+                    uint2 size = face.side->material->baseTexture->GetSize();
 
-                    mappingWidth = float(desc.Width);
-                    mappingHeight = float(desc.Height);
+                    mappingWidth = float(size.x);
+                    mappingHeight = float(size.y);
                 }
 
                 float u = glm::dot(vec3(face.side->textureAxes[0].xyz), vec3(pos)) / face.side->scale[0] + face.side->textureAxes[0].w;
@@ -386,18 +463,22 @@ namespace chisel
             faceIdx++;
         }
 
+        if (!a)
+            return;
+
         // Upload all meshes after they're complete
-        a.open();
+        a->open();
         for (auto& mesh : m_meshes)
         {
             uint32_t verticesSize = sizeof(VertexSolid) * mesh.vertices.size();
             uint32_t indicesSize = sizeof(uint32_t) * mesh.indices.size();
-            mesh.alloc = a.alloc(verticesSize + indicesSize);
+            mesh.alloc = a->alloc(verticesSize + indicesSize);
             // Store vertices then indices.
-            memcpy(&a.data()[mesh.alloc->offset + 0],            mesh.vertices.data(), verticesSize);
-            memcpy(&a.data()[mesh.alloc->offset + verticesSize], mesh.indices.data(),  indicesSize);
+            memcpy(&a->data()[mesh.alloc->offset + 0],            mesh.vertices.data(), verticesSize);
+            memcpy(&a->data()[mesh.alloc->offset + verticesSize], mesh.indices.data(),  indicesSize);
+            a->rctx().CountStat(&render::RenderStats::brushBytes, verticesSize + indicesSize);
         }
-        a.close();
+        a->close();
     }
 
     void Solid::Transform(const mat4x4& _matrix)
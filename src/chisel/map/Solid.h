@@ -12,6 +12,7 @@
 #include "Face.h"
 
 #include <memory>
+#include <span>
 #include <unordered_map>
 
 namespace chisel
@@ -52,6 +53,9 @@ namespace chisel
 
         void UpdateMesh();
 
+        // Rebuilds the solids whose meshes were built while one of these was still loading.
+        static void AssetsLoaded(std::span<Asset* const> assets);
+
 
     // Selectable Interface //
 
@@ -70,7 +74,11 @@ namespace chisel
     private:
         friend struct Face;
 
+        void WaitForAssets();
+        void StopWaiting();
+
         bool m_displacement = false;
+        std::vector<const Asset*> m_waitingOn;
 
         std::vector<BrushMesh> m_meshes;
         std::vector<Side> m_sides;
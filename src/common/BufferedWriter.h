@@ -0,0 +1,156 @@
+#pragma once
+
+#include "common/Common.h"
+#include "common/Path.h"
+#include "math/Math.h"
+
+#include <cassert>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+namespace chisel
+{
+    /**
+     * Text file writer backed by one large reusable buffer.
+     *
+     * Numbers are formatted with std::to_chars (shortest round-trip
+     * representation for floats) straight into the buffer, and the buffer
+     * is handed to the OS in a single write whenever it fills up.
+     */
+    class BufferedWriter
+    {
+    public:
+        static constexpr size_t DefaultBufferSize = 4 * 1024 * 1024; // 4 mb
+
+        // Longest output of to_chars for any arithmetic type we write.
+        static constexpr size_t MaxNumberLength = 32;
+
+        explicit BufferedWriter(size_t bufferSize = DefaultBufferSize)
+            : m_buffer(std::make_unique<char[]>(bufferSize))
+            , m_capacity(bufferSize)
+        {
+        }
+
+        BufferedWriter(const BufferedWriter&) = delete;
+        BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+        ~BufferedWriter()
+        {
+            Close();
+        }
+
+        bool Open(const fs::Path& path)
+        {
+            Close();
+
+            m_file = std::fopen(path, "wb");
+            if (!m_file)
+                return false;
+
+            // We do our own buffering, don't let the CRT copy everything again.
+            std::setvbuf(m_file, nullptr, _IONBF, 0);
+            m_size = 0;
+            m_failed = false;
+            return true;
+        }
+
+        // Flushes and closes the file. Returns false if any write failed.
+        bool Close()
+        {
+            if (!m_file)
+                return !m_failed;
+
+            Flush();
+            if (std::fclose(m_file) != 0)
+                m_failed = true;
+            m_file = nullptr;
+            return !m_failed;
+        }
+
+        bool IsOpen() const { return m_file != nullptr; }
+        bool Good() const { return m_file != nullptr && !m_failed; }
+
+        void Flush()
+        {
+            if (m_size == 0)
+                return;
+
+            if (m_file && std::fwrite(m_buffer.get(), 1, m_size, m_file) != m_size)
+                m_failed = true;
+            m_size = 0;
+        }
+
+    // Writing //
+
+        BufferedWriter& Write(std::string_view str)
+        {
+            // Large strings skip the buffer entirely.
+            if (str.size() > m_capacity)
+            {
+                Flush();
+                if (m_file && std::fwrite(str.data(), 1, str.size(), m_file) != str.size())
+                    m_failed = true;
+                return *this;
+            }
+
+            char* dst = Reserve(str.size());
+            std::memcpy(dst, str.data(), str.size());
+            m_size += str.size();
+            return *this;
+        }
+
+        BufferedWriter& Write(const char* str) { return Write(std::string_view(str)); }
+
+        BufferedWriter& Write(char c)
+        {
+            *Reserve(1) = c;
+            m_size++;
+            return *this;
+        }
+
+        template <typename T> requires (std::is_arithmetic_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>)
+        BufferedWriter& Write(T value)
+        {
+            char* dst = Reserve(MaxNumberLength);
+            auto [end, err] = std::to_chars(dst, dst + MaxNumberLength, value);
+            assert(err == std::errc{});
+            m_size += size_t(end - dst);
+            return *this;
+        }
+
+        // Vectors are written as space-separated components, eg. "1 2 3"
+        template <int N, typename T>
+        BufferedWriter& Write(const glm::vec<N, T>& vec)
+        {
+            for (int i = 0; i < N; i++)
+            {
+                if (i != 0)
+                    Write(' ');
+                Write(vec[i]);
+            }
+            return *this;
+        }
+
+        BufferedWriter& operator <<(const auto& value) { return Write(value); }
+
+    private:
+        // Ensures there is room for 'count' more bytes at the end of the buffer.
+        char* Reserve(size_t count)
+        {
+            if (m_size + count > m_capacity)
+                Flush();
+            return m_buffer.get() + m_size;
+        }
+
+        std::unique_ptr<char[]> m_buffer;
+        size_t m_capacity;
+        size_t m_size = 0;
+
+        FILE* m_file = nullptr;
+        bool m_failed = false;
+    };
+}
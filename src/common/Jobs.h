@@ -0,0 +1,151 @@
+#pragma once
+
+#include "common/Common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chisel
+{
+    /**
+     * Pool of worker threads for background work, eg. asset I/O and decoding.
+     *
+     * Jobs start in the order they are submitted but may finish in any order.
+     * They must not touch the GPU, the console or the asset table; hand the
+     * results back to the main thread instead.
+     */
+    inline class JobSystem
+    {
+    public:
+        ~JobSystem()
+        {
+            Stop();
+        }
+
+        // Starts the workers. Zero picks one less than the number of cores.
+        void Start(uint threadCount = 0)
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_threads.empty())
+                return;
+
+            if (threadCount == 0)
+                threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+            m_stopping = false;
+            for (uint i = 0; i < threadCount; i++)
+                m_threads.emplace_back([this] { WorkerMain(); });
+        }
+
+        // Lets running jobs finish, drops the ones still queued and joins the workers.
+        void Stop()
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                m_stopping = true;
+                m_jobs.clear();
+            }
+            m_wake.notify_all();
+
+            for (auto& thread : m_threads)
+                thread.join();
+            m_threads.clear();
+        }
+
+        // Queues a job, starting the workers if needed. Main thread only.
+        void Submit(std::function<void()> job)
+        {
+            if (m_threads.empty())
+                Start();
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_jobs.push_back(std::move(job));
+            }
+            m_wake.notify_one();
+        }
+
+        // Runs fn(i) for every i in [0, count) on the workers and the calling thread,
+        // and returns once all of them are done. The caller always makes progress
+        // itself, so this is safe to call from inside a job.
+        void ParallelFor(uint count, std::function<void(uint)> fn)
+        {
+            struct State
+            {
+                std::function<void(uint)> fn;
+                uint count;
+                std::atomic<uint> next = 0;
+                std::atomic<uint> done = 0;
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+            auto state = std::make_shared<State>();
+            state->fn = std::move(fn);
+            state->count = count;
+
+            // Helpers that start late find nothing left and return straight away.
+            auto work = [state]
+            {
+                for (uint i; (i = state->next++) < state->count; )
+                {
+                    state->fn(i);
+                    if (++state->done == state->count)
+                    {
+                        std::lock_guard lock(state->mutex);
+                        state->finished.notify_all();
+                    }
+                }
+            };
+
+            const uint helpers = count > 1 ? std::min(ThreadCount(), count - 1) : 0;
+            if (helpers)
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    for (uint i = 0; i < helpers; i++)
+                        m_jobs.push_front(work);
+                }
+                m_wake.notify_all();
+            }
+
+            work();
+
+            std::unique_lock lock(state->mutex);
+            state->finished.wait(lock, [&] { return state->done == state->count; });
+        }
+
+        uint ThreadCount() const { return uint(m_threads.size()); }
+
+    private:
+        void WorkerMain()
+        {
+            for (;;)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock lock(m_mutex);
+                    m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                    if (m_stopping)
+                        return;
+
+                    job = std::move(m_jobs.front());
+                    m_jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::deque<std::function<void()>> m_jobs;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        bool m_stopping = false;
+    } Jobs;
+}
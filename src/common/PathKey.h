@@ -0,0 +1,151 @@
+#pragma once
+
+#include "common/Common.h"
+#include "common/Hash.h"
+
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+namespace chisel
+{
+    /**
+     * Interned, normalized file path for use as a lookup key.
+     *
+     * Case is folded and '\\' becomes '/' once, when a path is first
+     * interned. Every key for the same path points at the same entry, so
+     * comparing keys is a pointer compare and hashing one is a load.
+     * Entries are never freed. Lookups of paths that are already interned
+     * only take the table's lock shared, so they don't contend.
+     */
+    class PathKey
+    {
+    public:
+        PathKey() = default;
+
+        // Interns the path if it hasn't been seen before.
+        explicit PathKey(std::string_view path) : m_entry(Table().Intern(path)) {}
+
+        // Looks a path up without interning it. Gives an empty key if the
+        // path was never interned, ie. nothing can be stored under it.
+        static PathKey Find(std::string_view path)
+        {
+            PathKey key;
+            key.m_entry = Table().Find(path);
+            return key;
+        }
+
+        bool empty() const { return m_entry == nullptr; }
+        explicit operator bool() const { return m_entry != nullptr; }
+
+        // The normalized path
+        std::string_view str() const { return m_entry ? std::string_view(m_entry->str) : std::string_view(); }
+        Hash hash() const { return m_entry ? m_entry->hash : 0; }
+
+        bool operator ==(const PathKey& other) const { return m_entry == other.m_entry; }
+
+        static constexpr char Fold(char c)
+        {
+            if (c == '\\')
+                return '/';
+            return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+
+        static constexpr Hash HashPath(std::string_view path)
+        {
+            Hash hash = FNV_1a<Hash>::offset;
+            for (char c : path)
+                hash = (hash ^ Fold(c)) * FNV_1a<Hash>::prime;
+            return hash;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string str;
+            Hash hash;
+        };
+
+        // Unnormalized paths can be looked up directly, they are folded while hashing and comparing.
+        struct EntryHash
+        {
+            using is_transparent = void;
+            size_t operator()(std::string_view path) const { return HashPath(path); }
+            size_t operator()(const Entry& entry) const { return entry.hash; }
+        };
+
+        struct EntryEqual
+        {
+            using is_transparent = void;
+            bool operator()(std::string_view a, const Entry& b) const { return Equal(a, b.str); }
+            bool operator()(const Entry& a, std::string_view b) const { return Equal(a.str, b); }
+            bool operator()(const Entry& a, const Entry& b) const { return &a == &b || Equal(a.str, b.str); }
+
+            static bool Equal(std::string_view a, std::string_view b)
+            {
+                if (a.size() != b.size())
+                    return false;
+
+                for (size_t i = 0; i < a.size(); i++)
+                {
+                    if (Fold(a[i]) != Fold(b[i]))
+                        return false;
+                }
+                return true;
+            }
+        };
+
+        struct InternTable
+        {
+            // Nodes of an unordered_set never move, so entries can be pointed to.
+            std::unordered_set<Entry, EntryHash, EntryEqual> entries;
+            std::shared_mutex mutex;
+
+            const Entry* Find(std::string_view path)
+            {
+                std::shared_lock lock(mutex);
+                auto it = entries.find(path);
+                return it != entries.end() ? &*it : nullptr;
+            }
+
+            const Entry* Intern(std::string_view path)
+            {
+                if (const Entry* entry = Find(path))
+                    return entry;
+
+                // Someone else may have interned it between the two locks.
+                std::unique_lock lock(mutex);
+                auto it = entries.find(path);
+                if (it != entries.end())
+                    return &*it;
+
+                Entry entry = { std::string(path), HashPath(path) };
+                for (char& c : entry.str)
+                    c = Fold(c);
+                return &*entries.insert(std::move(entry)).first;
+            }
+        };
+
+        // Function-local so loaders registering during static init can use it,
+        // and never destroyed so keys stay valid in other static destructors.
+        static InternTable& Table()
+        {
+            static InternTable* table = new InternTable;
+            return *table;
+        }
+
+        const Entry* m_entry = nullptr;
+    };
+}
+
+template<>
+struct std::hash<chisel::PathKey>
+{
+    std::size_t operator()(const chisel::PathKey& key) const
+    {
+        return key.hash();
+    }
+};
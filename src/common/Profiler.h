@@ -0,0 +1,118 @@
+#pragma once
+
+#include "common/Common.h"
+#include "common/Time.h"
+
+#include <array>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace chisel
+{
+    /**
+     * Hierarchical frame profiler.
+     *
+     * CPU scopes are timed on the main thread with PROFILE_SCOPE, GPU scopes
+     * with D3D11 timestamp queries around PROFILE_GPU_SCOPE, which are read
+     * back a few frames later. The last MaxFrames frames are kept for the
+     * profiler window and can be exported in Chrome's trace format.
+     * While not recording, scopes cost one branch.
+     *
+     * Implemented in chisel/Profiler.cpp, next to the engine loop.
+     */
+    inline class Profiler
+    {
+    public:
+        static constexpr uint MaxFrames = 300;
+
+        struct Scope
+        {
+            std::string_view name;      // Has to outlive the profiler, usually a literal
+            uint depth;
+            Time::Seconds start;        // Since the start of the frame
+            Time::Seconds end;
+        };
+
+        struct Frame
+        {
+            Time::Frames number = 0;
+            Time::Seconds start = 0;    // Time::GetTime() at the start
+            Time::Seconds cpuTime = 0;
+            Time::Seconds gpuTime = 0;  // Zero until the timestamps are read back
+            std::vector<Scope> cpu;
+            std::vector<Scope> gpu;
+        };
+
+        // Keeps the recorded frames as they are, for looking at.
+        // Recording itself is switched with the 'profile' convar.
+        bool paused = false;
+
+        void BeginFrame();
+        void EndFrame();
+
+        bool IsRecording() const { return m_recording; }
+
+        // Indices into the current frame's scopes, pass them back to End.
+        uint BeginScope(std::string_view name);
+        void EndScope(uint index);
+        uint BeginGPUScope(std::string_view name);
+        void EndGPUScope(uint index);
+
+        // Finished frames, 0 is the oldest.
+        uint FrameCount() const { return m_count; }
+        const Frame& GetFrame(uint index) const { return m_frames[(m_next + MaxFrames - m_count + index) % MaxFrames]; }
+
+        // For chrome://tracing or ui.perfetto.dev
+        bool ExportChromeTrace(std::string_view path) const;
+
+    private:
+        void ReadGPUQueries();
+
+        std::array<Frame, MaxFrames> m_frames;
+        uint m_next = 0;        // Frame being recorded
+        uint m_count = 0;
+        uint m_depth = 0;
+        uint m_gpuDepth = 0;
+        bool m_recording = false;
+        std::thread::id m_mainThread;
+    } Profiler;
+
+    struct ProfileScope
+    {
+        ProfileScope(std::string_view name, bool gpu = false)
+        {
+            if (Profiler.IsRecording()) [[unlikely]]
+            {
+                m_gpu = gpu;
+                m_index = gpu ? Profiler.BeginGPUScope(name) : Profiler.BeginScope(name);
+            }
+        }
+
+        ~ProfileScope()
+        {
+            if (m_index != ~0u) [[unlikely]]
+            {
+                if (m_gpu)
+                    Profiler.EndGPUScope(m_index);
+                else
+                    Profiler.EndScope(m_index);
+            }
+        }
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        uint m_index = ~0u;
+        bool m_gpu = false;
+    };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// Times the rest of the enclosing block on the CPU.
+#define PROFILE_SCOPE(name)     ::chisel::ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+// Times the GPU work submitted in the rest of the enclosing block.
+#define PROFILE_GPU_SCOPE(name) ::chisel::ProfileScope PROFILE_CONCAT(profileGPUScope_, __LINE__)(name, true)
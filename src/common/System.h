@@ -3,11 +3,13 @@
 #include <list>
 #include <memory>
 #include <map>
+#include <string_view>
 #include <typeinfo>
 #include <typeindex>
 #include <type_traits>
 
 #include "common/Ranges.h"
+#include "common/Profiler.h"
 
 namespace chisel
 {
@@ -22,6 +24,29 @@ namespace chisel
 
     using SystemFunc = void(System*);
 
+    // Readable name of a type without its namespace, eg. "MapRender"
+    template <typename T>
+    constexpr std::string_view TypeName()
+    {
+#ifdef _MSC_VER
+        std::string_view name = __FUNCSIG__;
+        name = name.substr(name.find("TypeName<") + 9);
+        name = name.substr(0, name.rfind(">(void)"));
+        for (std::string_view prefix : { "struct ", "class " })
+        {
+            if (name.starts_with(prefix))
+                name.remove_prefix(prefix.size());
+        }
+#else
+        std::string_view name = __PRETTY_FUNCTION__;
+        name = name.substr(name.find("T = ") + 4);
+        name = name.substr(0, name.find_first_of(";]"));
+#endif
+        if (name.starts_with("chisel::"))
+            name.remove_prefix(8);
+        return name;
+    }
+
     template <class T>
     concept SystemClass = std::is_base_of_v<System, T>;
 
@@ -36,6 +61,7 @@ namespace chisel
         struct Callback {
             System* system;
             SystemFunc* func;
+            std::string_view name;  // For the profiler
         };
 
         struct SystemRecord {
@@ -67,7 +93,9 @@ namespace chisel
             record.Update = OnUpdate.end();
             record.Tick   = OnTick.end();
 
-            record.Start = RegisterCallback(OnStart, sys, [](System* sys) { static_cast<Sys*>(sys)->Start(); });
+            constexpr std::string_view name = TypeName<Sys>();
+
+            record.Start = RegisterCallback(OnStart, sys, [](System* sys) { static_cast<Sys*>(sys)->Start(); }, name);
 
             // If Start() has already been called, then call
             // it on new systems as soon as they're created.
@@ -75,9 +103,9 @@ namespace chisel
                 system->Start();
             }
 
-            record.Update = RegisterCallback(OnUpdate, sys, [](System* sys) { static_cast<Sys*>(sys)->Update(); });
+            record.Update = RegisterCallback(OnUpdate, sys, [](System* sys) { static_cast<Sys*>(sys)->Update(); }, name);
 
-            record.Tick = RegisterCallback(OnTick, sys, [](System* sys) { static_cast<Sys*>(sys)->Tick(); });
+            record.Tick = RegisterCallback(OnTick, sys, [](System* sys) { static_cast<Sys*>(sys)->Tick(); }, name);
 
             return *sys;
         }
@@ -145,15 +173,16 @@ namespace chisel
 
         inline void Call(auto& event) {
             int i = 0;
-            for (auto& [sys, Func] : event) {
+            for (auto& [sys, Func, name] : event) {
                 // TODO: Why is this necessary?
                 if (i++ > event.size()) return;
+                PROFILE_SCOPE(name);
                 Func(sys);
             }
         }
 
-        inline auto RegisterCallback(auto& event, System* system, SystemFunc* func) {
-            return event.insert(event.end(), Callback {system, func});
+        inline auto RegisterCallback(auto& event, System* system, SystemFunc* func, std::string_view name) {
+            return event.insert(event.end(), Callback {system, func, name});
         }
 
         inline void UnregisterCallbacks(const SystemRecord& record)
@@ -15,6 +15,9 @@
 
 namespace chisel
 {
+    // Bumped whenever any ConVar is set, so things drawn with them can tell they're stale.
+    inline uint64 conVarGeneration = 0;
+
     /** Represents a console variable. */
     template <typename T = const char*>
     struct ConVar : public ConCommand
@@ -48,6 +51,7 @@ namespace chisel
         inline void SetValue(T t)
         {
             value = t;
+            conVarGeneration++;
             
             // Allow callback to set the value without recursing!
             if (!inCallback && callback)
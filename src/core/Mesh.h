@@ -34,6 +34,13 @@ namespace chisel
             return groups.emplace_back();
         }
 
+        size_t GetMemoryUsage() const override {
+            size_t size = 0;
+            for (const auto& group : groups)
+                size += group.vertices.Size() + group.indices.Size();
+            return size;
+        }
+
         Mesh(VertexLayout& layout, auto& vertices, auto& indices) {
             Init(layout, vertices, indices);
         }
@@ -248,7 +248,7 @@ namespace chisel::kv
 
         KeyValues(const KeyValues& other)
         {
-            for (const auto& [name, child] : m_children)
+            for (const auto& [name, child] : other.m_children)
                 m_children.emplace(name, KeyValuesVariant(child));
         }
 
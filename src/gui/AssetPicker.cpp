@@ -5,10 +5,13 @@
 #include "chisel/FGD/FGD.h"
 #include "chisel/map/Map.h"
 #include "chisel/Selection.h"
+#include "assets/ThumbnailCache.h"
 #include "gui/IconsMaterialCommunity.h"
 
 #include <misc/cpp/imgui_stdlib.h>
+#include <algorithm>
 #include <string>
+#include <unordered_set>
 
 namespace chisel
 {
@@ -29,7 +32,7 @@ namespace chisel
         
         s_AssetPickers.insert(this);
         m_LastWindowSize = uint2(1024, 512);
-        m_AssetsPerRow = uint(floor(m_LastWindowSize.x / (AssetThumbnailSize.x + AssetPadding.x)));
+        m_AssetsPerRow = std::max(uint(floor(m_LastWindowSize.x / (AssetThumbnailSize.x + AssetPadding.x))), 1u);
         Refresh();
     }
 
@@ -39,23 +42,19 @@ namespace chisel
             s_AssetPickers.erase(this);
     }
 
-    bool AssetPicker::IsAssetVisible(uint index) const
+    void AssetPicker::RequestThumbnails(int64 first, int64 last, ThumbnailCache::Priority priority)
     {
-        return index > m_FirstVisibleAsset
-            && index < m_FirstVisibleAsset + (m_AssetsPerRow * m_NumVisibleRows);
-    }
-    
-    bool AssetPicker::IsAssetAlmostVisible(uint index) const
-    {
-        return index > m_FirstVisibleAsset - (m_AssetsPerRow * m_NumVisibleRows * 2)
-            && index < m_FirstVisibleAsset + (m_AssetsPerRow * m_NumVisibleRows * 2);
+        first = std::max<int64>(first, 0);
+        last = std::min<int64>(last, int64(m_materials.size()));
+        for (int64 i = first; i < last; i++)
+            ThumbnailCache.Request(m_materials[i].key, priority);
     }
 
     void AssetPicker::Draw()
     {
         if (ImGui::BeginMenuBar())
         {
-            ImGui::Text("Loaded %u/%llu", m_LoadedAssetCount, m_materials.size());
+            ImGui::Text("Loaded %llu/%llu", ThumbnailCache.Count(), m_materials.size());
             // Right side
             ImGui::Spacing();
             ImGui::SameLine(ImGui::GetWindowWidth() - 200);
@@ -70,7 +69,7 @@ namespace chisel
 
         ImVec2 windowSize = ImGui::GetWindowSize();
         m_LastWindowSize = uint2(windowSize.x, windowSize.y);
-        m_AssetsPerRow = uint(floor(m_LastWindowSize.x / (AssetThumbnailSize.x + AssetPadding.x)));
+        m_AssetsPerRow = std::max(uint(floor(m_LastWindowSize.x / (AssetThumbnailSize.x + AssetPadding.x))), 1u);
 
         float scroll = ImGui::GetScrollY();
         
@@ -82,7 +81,7 @@ namespace chisel
         // This is in a lambda so we can PopFont when we're done
         auto render = [&]
         {
-            if (m_materials.size() == 0)
+            if (m_FirstVisibleAsset >= m_materials.size())
                 return;
 
             uint currentAsset = m_FirstVisibleAsset;
@@ -95,41 +94,24 @@ namespace chisel
                     ImVec2 basePos = ImVec2(column * (AssetThumbnailSize.x + AssetPadding.x) + initialXPadding, (xAssetRow + row) * (AssetThumbnailSize.y + AssetPadding.y) + initialYPadding);
 
                     auto& material = m_materials[currentAsset];
+                    Texture* thumbnail = ThumbnailCache.Find(material.key);
 
-                    if (material.thing != nullptr && material.thing->baseTexture != nullptr && material.thing->baseTexture->srvLinear != nullptr)
-                    {
-                        ImGui::SetCursorPos(basePos);
-
-                        bool selected = Chisel.activeMaterial == material.thing;
-                        if (selected)
-                            ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetColorU32(ImGuiCol_TabActive));
+                    ImGui::SetCursorPos(basePos);
 
-                        if (ImGui::ImageButton(material.path.c_str(), (ImTextureID)material.thing->baseTexture->srvLinear.ptr(),
-                            ImVec2(float(AssetThumbnailSize.x), float(AssetThumbnailSize.y)), ImVec2(0, 0), ImVec2(1, 1), ImVec4(0, 0, 0, 0), ImVec4(1, 1, 1, 1)))
-                        {
-                            Chisel.activeMaterial = material.thing;
-                        }
+                    bool selected = Chisel.activeMaterial != nullptr && Chisel.activeMaterial->GetKey() == material.key;
+                    if (selected)
+                        ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetColorU32(ImGuiCol_TabActive));
 
-                        if (selected)
-                            ImGui::PopStyleColor();
-                    }
-                    else
+                    ImTextureID image = thumbnail ? (ImTextureID)thumbnail->srvLinear.ptr() : (ImTextureID)nullptr;
+                    if (ImGui::ImageButton(material.path.c_str(), image,
+                        ImVec2(float(AssetThumbnailSize.x), float(AssetThumbnailSize.y)), ImVec2(0, 0), ImVec2(1, 1), ImVec4(0, 0, 0, 0), ImVec4(1, 1, 1, 1)))
                     {
-                        ImGui::SetCursorPos(basePos);
-
-                        if (ImGui::ImageButton(material.path.c_str(), (ImTextureID)nullptr,
-                            ImVec2(float(AssetThumbnailSize.x), float(AssetThumbnailSize.y)), ImVec2(0, 0), ImVec2(1, 1), ImVec4(0, 0, 0, 0), ImVec4(1, 1, 1, 1)))
-                        {
-                            Chisel.activeMaterial = material.thing;
-                        }
-
-                        if (!material.triedToLoad && !m_thumbnailQueueSet.contains(currentAsset))
-                        {
-                            m_thumbnailQueue.push_front(currentAsset);
-                            m_thumbnailQueueSet.insert(currentAsset);
-                        }
+                        Chisel.activeMaterial = material.Load();
                     }
 
+                    if (selected)
+                        ImGui::PopStyleColor();
+
                     if (ImGui::IsItemHovered())
                     {
                         ImGui::BeginTooltip();
@@ -156,86 +138,65 @@ namespace chisel
         render();
 
         ImGui::PopFont();
-    }
-
-    void AssetPicker::Tick()
-    {
-        if (!open)
-            return;
 
-        int numLoaded = 0;
-        if (m_thumbnailQueue.size() > 0)
-        {
-            // Load 8 textures per tick as we scroll in new textures
-			while ( m_thumbnailQueue.size() > 0 && numLoaded++ < 8 )
-			{
-                uint index = m_thumbnailQueue.front();
-                m_materials[index].Load();
-                m_thumbnailQueue.pop_front();
-                m_LoadedAssetCount++;
-                m_thumbnailQueueSet.erase(index);
-			}
-        }
-        else
-        {
-            // Otherwise, load 4 models per tick from off-screen
-			for ( uint i = 0; i < m_materials.size() && numLoaded <= 4; i++ )
-			{
-				if ( !m_materials[i].triedToLoad && IsAssetAlmostVisible(i) )
-				{
-					m_materials[i].Load();
-                    m_LoadedAssetCount++;
-					numLoaded++;
-				}
-			}
-        }
+        // Only what's on screen is ever requested, then a page either side of it
+        // so scrolling a little finds thumbnails ready. Everything else is
+        // cancelled by not being asked for again.
+        const int64 first = m_FirstVisibleAsset;
+        const int64 page = int64(m_AssetsPerRow) * m_NumVisibleRows;
+        RequestThumbnails(first, first + page, ThumbnailCache::Visible);
+        RequestThumbnails(first + page, first + page * 2, ThumbnailCache::NearlyVisible);
+        RequestThumbnails(first - page, first, ThumbnailCache::NearlyVisible);
+        ThumbnailCache.Update();
     }
 
     bool AssetPicker::OverrideContentSize(uint2& size)
     {
         uint count = uint(m_materials.size());
-        uint numRows = count / m_AssetsPerRow;
+        uint numRows = (count + m_AssetsPerRow - 1) / m_AssetsPerRow;
         // Never have an X scrollbar.
         size = uint2(m_LastWindowSize.x, numRows * (AssetThumbnailSize.y + AssetPadding.y));
         return true;
     }
 
+    // Path under materials/, or the last folder and file name, without the extension.
+    // The key is the same path folded, so it's searched instead of the path.
+    static std::string_view DisplayName(std::string_view path, std::string_view folded)
+    {
+        size_t start = 0;
+        if (folded.starts_with("materials/"))
+            start = 10;
+        else if (size_t pos = folded.find("/materials/"); pos != std::string_view::npos)
+            start = pos + 11;
+        else if (size_t file = folded.find_last_of('/'); file != std::string_view::npos && file > 0)
+        {
+            size_t dir = folded.find_last_of('/', file - 1);
+            start = dir == std::string_view::npos ? 0 : dir + 1;
+        }
+
+        std::string_view name = path.substr(start);
+        size_t dot = name.find_last_of("./\\");
+        if (dot != std::string_view::npos && name[dot] == '.')
+            name = name.substr(0, dot);
+        return name;
+    }
+
     void AssetPicker::Refresh()
     {
         m_materials.clear();
-        m_thumbnailQueue.clear();
 
-        Assets.ForEachFile<Material>(
-        [&](const fs::Path& p)
+        // Straight from the file index, nothing here touches the disk.
+        Assets.ForEachFile<Material>([&](const PathKey& key, std::string_view path)
         {
             AssetPickerAsset<Material>& asset = m_materials.emplace_back();
-            asset.path = std::string(p);
-
-            fs::Path subpath;
-            std::filesystem::path path = p;
-            bool foundMaterials = false;
-            for (auto& part : path)
-            {
-                if (foundMaterials)
-                    subpath /= part;
-                if (part == "materials")
-                    foundMaterials = true;
-            }
-            if (!foundMaterials)
-                subpath = p.dirname().filename() / p.filename();
-
-            // Remove materials/ and .vmt for display name
-            std::string_view name = subpath;
-            if (name.starts_with("materials") && (name[9] == '/' || name[9] == '\\'))
-                name.remove_prefix(10);
-            name.remove_suffix(std::string_view(p.ext()).size());
-            asset.name = name;
+            asset.path = path;
+            asset.key = key;
+            asset.name = DisplayName(path, key.str());
         });
         std::sort(m_materials.begin(), m_materials.end(), [](AssetPickerAsset<Material>& a, AssetPickerAsset<Material>& b) { return a.path < b.path; });
         if (Chisel.activeMaterial == nullptr && !m_materials.empty())
         {
-            m_materials[0].Load();
-            Chisel.activeMaterial = m_materials[0].thing;
+            Chisel.activeMaterial = m_materials[0].Load();
         }
     }
 }
@@ -3,9 +3,8 @@
 #include "gui/Common.h"
 #include "gui/Window.h"
 #include "assets/Assets.h"
+#include "assets/ThumbnailCache.h"
 
-#include <deque>
-#include <unordered_set>
 namespace chisel
 {
     template <typename T>
@@ -13,16 +12,15 @@ namespace chisel
     {
         std::string path;
         std::string name;
-        Rc<T> thing;
-        bool triedToLoad = false;
+        PathKey key;
 
-        void Load()
+        // The asset itself is only loaded when picked. It's retained by
+        // Assets rather than owned here, so it can still be evicted later.
+        Rc<T> Load()
         {
-            if (thing == nullptr && !triedToLoad)
-            {
-                thing = Assets.Load<T>(path);
-                triedToLoad = true;
-            }
+            Rc<T> thing = Assets.LoadAsync<T>(key);
+            Assets.Retain(thing.ptr());
+            return thing;
         }
     };
 
@@ -32,19 +30,16 @@ namespace chisel
         ~AssetPicker();
 
         void Draw() override;
-        void Tick() override;
 
         bool OverrideContentSize(uint2& size) override;
 
         void Refresh();
 
     private:
-        bool IsAssetVisible(uint index) const;
-        bool IsAssetAlmostVisible(uint index) const;
+        // Asks for the thumbnails in [first, last), clamped to the list.
+        void RequestThumbnails(int64 first, int64 last, ThumbnailCache::Priority priority);
 
         std::vector<AssetPickerAsset<Material>> m_materials;
-        std::deque<uint> m_thumbnailQueue;
-        std::unordered_set<uint> m_thumbnailQueueSet;
 
         uint2 m_LastWindowSize;
         int ThumbnailScale = 7; // size = 16 * scale
@@ -52,6 +47,5 @@ namespace chisel
         uint m_AssetsPerRow;
         uint m_FirstVisibleAsset = 0;
         uint m_NumVisibleRows = 0;
-        uint m_LoadedAssetCount = 0;
     };
 }
@@ -105,13 +105,13 @@ namespace chisel
 
         // Draw entity icon
         Texture* tex = cls.texture.ptr();
-        if (tex == nullptr) {
+        if (tex == nullptr || !*tex) {
             tex = cls.type == FGD::SolidClass ? defaultIconBrush.ptr() : defaultIcon;
             hasDefaultIcon = true;
         }
         if (tex) {
             ImGui::GetWindowDrawList()->AddImage(
-                (cls.texture.ptr() ? cls.texture.ptr() : defaultIcon)->srvLinear.ptr(),
+                (hasDefaultIcon ? defaultIcon : tex)->srvLinear.ptr(),
                 screenPos, endPos,
                 ImVec2(0, 0), ImVec2(1, 1)
             );
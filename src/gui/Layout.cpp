@@ -345,6 +345,7 @@ namespace chisel
                 }
 
                 MenuItem(ICON_MC_COG " Settings", "", &Chisel.settingsWindow->open);
+                MenuItem(ICON_MC_CHART_TIMELINE " Profiler", "", &Chisel.profilerWindow->open);
                 MenuItem(ICON_MC_APPLICATION_OUTLINE " GUI Demo", "", &gui_demo.value);
                 ImGui::EndMenu();
             }
@@ -0,0 +1,124 @@
+#include "ProfilerWindow.h"
+#include "common/Profiler.h"
+#include "console/ConVar.h"
+#include "gui/IconsMaterialCommunity.h"
+
+#include <imgui.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace chisel
+{
+    extern ConVar<bool> profile;
+
+    ProfilerWindow::ProfilerWindow() : GUI::Window(ICON_MC_CHART_TIMELINE, "Profiler", 800, 400, false)
+    {
+    }
+
+    static ImU32 ScopeColor(std::string_view name)
+    {
+        // Stable per name, so the same scope keeps its color between frames.
+        size_t hash = std::hash<std::string_view>{}(name);
+        float hue = float(hash % 360) / 360.0f;
+        float r, g, b;
+        ImGui::ColorConvertHSVtoRGB(hue, 0.5f, 0.75f, r, g, b);
+        return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+    }
+
+    // Draws scopes as bars in rows by depth, 'duration' seconds across the available width.
+    static void DrawTimeline(const char* id, const std::vector<Profiler::Scope>& scopes, Time::Seconds duration)
+    {
+        using namespace ImGui;
+
+        uint rows = 1;
+        for (const auto& scope : scopes)
+            rows = std::max(rows, scope.depth + 1);
+
+        const float rowHeight = GetTextLineHeightWithSpacing();
+        const ImVec2 origin = GetCursorScreenPos();
+        const ImVec2 size = ImVec2(std::max(GetContentRegionAvail().x, 1.0f), rowHeight * rows);
+
+        InvisibleButton(id, size);
+        ImDrawList* draw = GetWindowDrawList();
+        draw->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), GetColorU32(ImGuiCol_FrameBg));
+
+        if (duration <= 0)
+            return;
+
+        const float scale = size.x / float(duration);
+        for (const auto& scope : scopes)
+        {
+            ImVec2 min = ImVec2(origin.x + float(scope.start) * scale, origin.y + scope.depth * rowHeight);
+            ImVec2 max = ImVec2(std::max(origin.x + float(scope.end) * scale, min.x + 1.0f), min.y + rowHeight - 1.0f);
+
+            draw->AddRectFilled(min, max, ScopeColor(scope.name));
+
+            ImVec4 clip = ImVec4(min.x, min.y, max.x, max.y);
+            std::string label = fmt::format("{} {:.2f}ms", scope.name, (scope.end - scope.start) * 1000.0);
+            draw->AddText(nullptr, 0.0f, ImVec2(min.x + 2.0f, min.y), GetColorU32(ImGuiCol_Text), label.data(), label.data() + label.size(), 0.0f, &clip);
+
+            if (IsItemHovered() && IsMouseHoveringRect(min, max))
+                SetTooltip("%s\n%.3fms", label.c_str(), (scope.end - scope.start) * 1000.0);
+        }
+    }
+
+    void ProfilerWindow::Draw()
+    {
+        using namespace ImGui;
+
+        Checkbox("Record", &profile.value);
+        SameLine();
+        Checkbox("Pause", &Profiler.paused);
+        SameLine();
+        Checkbox("Follow latest", &follow);
+        SameLine();
+        if (Button(ICON_MC_EXPORT " Export"))
+            Profiler.ExportChromeTrace("profile.json");
+
+        const uint count = Profiler.FrameCount();
+        if (count == 0)
+        {
+            TextDisabled("Nothing recorded yet.");
+            return;
+        }
+
+        // Frame time history, clicking picks the frame shown below.
+        std::vector<float> times(count);
+        uint selectedIndex = count - 1;
+        for (uint i = 0; i < count; i++)
+        {
+            const auto& frame = Profiler.GetFrame(i);
+            times[i] = float(frame.cpuTime * 1000.0);
+            if (!follow && frame.number == selected)
+                selectedIndex = i;
+        }
+
+        PlotHistogram("##Frames", times.data(), int(count), 0, "CPU ms", 0.0f, FLT_MAX, ImVec2(-FLT_MIN, 60.0f));
+        if (IsItemClicked())
+        {
+            float x = (GetMousePos().x - GetItemRectMin().x) / GetItemRectSize().x;
+            selectedIndex = std::clamp(uint(x * count), 0u, count - 1);
+            follow = false;
+        }
+
+        const auto& frame = Profiler.GetFrame(selectedIndex);
+        selected = frame.number;
+
+        Text("Frame %llu  CPU %.2fms  GPU %.2fms", (unsigned long long)frame.number, frame.cpuTime * 1000.0, frame.gpuTime * 1000.0);
+
+        // Same scale for both, so CPU and GPU work can be compared.
+        const Time::Seconds duration = std::max(frame.cpuTime, frame.gpuTime);
+
+        Separator();
+        TextUnformatted("CPU");
+        DrawTimeline("##CPU", frame.cpu, duration);
+
+        TextUnformatted("GPU");
+        if (frame.gpu.empty())
+            TextDisabled("%s", frame.gpuTime > 0 ? "No GPU scopes." : "Waiting for timestamps...");
+        else
+            DrawTimeline("##GPU", frame.gpu, duration);
+    }
+}
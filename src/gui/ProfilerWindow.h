@@ -0,0 +1,21 @@
+#pragma once
+#include "gui/Window.h"
+#include "common/Time.h"
+
+namespace chisel
+{
+    /**
+     * Frame times of the last few seconds and a timeline of
+     * the CPU and GPU scopes in the selected frame.
+     */
+    struct ProfilerWindow final : public GUI::Window
+    {
+        ProfilerWindow();
+
+        virtual void Draw() override;
+
+    private:
+        Time::Frames selected = 0;  // Frame number, follows the latest frame while 'follow' is set
+        bool follow = true;
+    };
+}
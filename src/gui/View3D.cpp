@@ -3,6 +3,7 @@
 #include "chisel/Selection.h"
 #include "chisel/Chisel.h"
 #include "chisel/Handles.h"
+#include "chisel/Gizmos.h"
 #include "input/Input.h"
 #include "input/Keyboard.h"
 #include "platform/Cursor.h"
@@ -93,6 +94,11 @@ namespace chisel
         if (!visible)
             return;
 
+        // Handles still have to run for input, but anything they'd draw
+        // over a kept image would pile up. Leave them nothing to draw into.
+        if (!rendered)
+            Engine.rctx.SetRenderTargets(0, nullptr, nullptr);
+
         Handles.Begin(viewport, view_axis_allow_flip);
 
         // Get camera matrices
@@ -103,15 +109,22 @@ namespace chisel
         DrawHandles(view, proj);
 
         // Draw grid
-        if (view_grid_show)
+        if (rendered && view_grid_show)
             Handles.DrawGrid(camera, view_grid_size);
 
         OnPostDraw();
+
+        // Everything drawn into this view is still bound
+        if (rendered)
+            Gizmos::Flush();
+        else
+            Gizmos::Discard();
     }
 
     void View3D::Draw()
     {
         popupOpen = false;
+        rendered = false;
         
         ImVec2 startPos = ImGui::GetCursorPos();
 
@@ -132,11 +145,18 @@ namespace chisel
             ImVec2(0, 0), ImVec2(1, 1)
         );
 
+        // Before rendering, NeedsRender compares it with the last drawn frame.
+        mouseOver = ImGui::IsWindowHovered(ImGuiHoveredFlags_None) && IsMouseOver(viewport);
+
         // Actually render the viewport
-        Render();
+        if (NeedsRender())
+        {
+            Render();
+            rendered = true;
+        }
 
         // If mouse is over viewport,
-        if (mouseOver = ImGui::IsWindowHovered(ImGuiHoveredFlags_None) && IsMouseOver(viewport))
+        if (mouseOver)
         {
             Camera& camera = GetCamera();
 
@@ -36,6 +36,13 @@ namespace chisel
         virtual void  Render() = 0;
         virtual void* GetMainTexture() = 0;
 
+        // False if the last image is still up to date. Render is skipped
+        // then, and the view keeps showing what it drew before.
+        virtual bool  NeedsRender() { return true; }
+
+        // Render ran this frame, so PostDraw may draw over the image.
+        bool  rendered       = false;
+
     // Virtual Methods //
 
         virtual void Start() override;
@@ -4,6 +4,7 @@
 #include "chisel/Handles.h"
 #include "chisel/MapRender.h"
 #include "chisel/tools/Tool.h"
+#include "input/Input.h"
 
 #include "math/Plane.h"
 #include "math/Ray.h"
@@ -12,6 +13,8 @@
 
 namespace chisel
 {
+    static ConVar<bool> r_viewport_always_render("r_viewport_always_render", false, "Render viewports every frame, even when nothing they show has changed");
+
     Viewport::Viewport() : View3D(ICON_MC_IMAGE_SIZE_SELECT_ACTUAL, "Viewport", 512, 512, true) {}
 
     void Viewport::Start()
@@ -26,6 +29,7 @@ namespace chisel
         ds_SceneView = Engine.rctx.CreateDepthStencil(width, height);
         rt_ObjectID  = Engine.rctx.CreateRenderTarget(width, height, DXGI_FORMAT_R32_UINT);
         camera.renderTarget = rt_SceneView;
+        Invalidate();
     }
 
     void Viewport::Render()
@@ -33,6 +37,48 @@ namespace chisel
         Chisel.Renderer->DrawViewport(*this);
     }
 
+    bool Viewport::NeedsRender()
+    {
+        Camera& camera = GetCamera();
+
+        DrawnState state = {
+            .view                = camera.ViewMatrix(),
+            .proj                = camera.ProjMatrix(),
+            .size                = rt_SceneView->GetSize(),
+            .drawMode            = drawMode,
+            .tool                = Chisel.tool,
+            .mapGeneration       = Map::EditGeneration(),
+            .selectionGeneration = Selection.Generation(),
+            .conVarGeneration    = conVarGeneration,
+            .finishedLoads       = Assets.FinishedLoads(),
+            .hovered             = mouseOver,
+        };
+
+        if (mouseOver)
+        {
+            state.mouse = GetMousePos();
+            state.input = uint(Mouse.GetButton(Mouse::Left))   << 0
+                        | uint(Mouse.GetButton(Mouse::Right))  << 1
+                        | uint(Mouse.GetButton(Mouse::Middle)) << 2
+                        | uint(Keyboard.ctrl)                  << 3
+                        | uint(Keyboard.shift)                 << 4
+                        | uint(Keyboard.alt)                   << 5;
+        }
+
+        // Widgets can change what's drawn without any of the above noticing,
+        // like convars edited in place. Checkboxes change on release, when
+        // they stop being active, so keep rendering for one more frame.
+        const bool uiActive = ImGui::IsAnyItemActive();
+
+        const bool needed = r_viewport_always_render || m_invalidated
+            || uiActive || m_uiWasActive || state != m_drawn;
+
+        m_drawn       = state;
+        m_invalidated = false;
+        m_uiWasActive = uiActive;
+        return needed;
+    }
+
     void* Viewport::GetMainTexture()
     {
         return GetTexture(drawMode)->srvLinear.ptr();
@@ -45,11 +91,15 @@ namespace chisel
 
     void Viewport::DrawHandles(mat4x4& view, mat4x4& proj)
     {
-        // Draw general handles
-        Chisel.Renderer->DrawHandles(view, proj);
+        // Draw general handles, only over a fresh image
+        if (rendered)
+            Chisel.Renderer->DrawHandles(view, proj);
 
         // Draw transform handles
-        Chisel.tool->DrawHandles(*this);
+        {
+            PROFILE_SCOPE(Chisel.tool->name);
+            Chisel.tool->DrawHandles(*this);
+        }
         
         // Draw view cube
         {
@@ -79,7 +129,21 @@ namespace chisel
             return;
         }
 
-        Chisel.tool->DrawPropertiesWindow(viewport, instance);
+        {
+            PROFILE_SCOPE(Chisel.tool->name);
+            Chisel.tool->DrawPropertiesWindow(viewport, instance);
+        }
+
+        // Render counters for the whole last frame, with r_stats
+        if (Engine.rctx.countStats)
+        {
+            std::string text = Engine.rctx.lastStats.ToString();
+            ImVec2 pos = ImVec2(viewport.x + 8, viewport.y + 32);
+            ImVec2 size = ImGui::CalcTextSize(text.c_str());
+            ImDrawList* draw = ImGui::GetWindowDrawList();
+            draw->AddRectFilled(ImVec2(pos.x - 4, pos.y - 4), ImVec2(pos.x + size.x + 4, pos.y + size.y + 4), IM_COL32(0, 0, 0, 160), 4.0f);
+            draw->AddText(pos, IM_COL32_WHITE, text.c_str());
+        }
 
         if (IsMouseOver(viewport))
         {
@@ -26,6 +26,10 @@ namespace chisel
     // Rendering //
         void  Render() override;
         void* GetMainTexture() override;
+        bool  NeedsRender() override;
+
+        // Render again next frame, for changes NeedsRender can't see.
+        void  Invalidate() { m_invalidated = true; }
 
         void Start() override;
         void OnClick(uint2 mouse) override;
@@ -45,5 +49,31 @@ namespace chisel
         DrawMode drawMode = DrawMode::Shaded;
 
         Texture* GetTexture(DrawMode mode);
+
+    private:
+        // Everything the image depends on, as of the last time it was rendered.
+        struct DrawnState
+        {
+            mat4x4   view;
+            mat4x4   proj;
+            uint2    size;
+            DrawMode drawMode;
+            Tool*    tool;
+            uint64   mapGeneration;
+            uint64   selectionGeneration;
+            uint64   conVarGeneration;
+            uint64   finishedLoads;
+
+            // Tools preview what's under the cursor
+            bool     hovered;
+            uint2    mouse;
+            uint     input;
+
+            bool operator ==(const DrawnState&) const = default;
+        };
+
+        DrawnState m_drawn       = {};
+        bool       m_invalidated = true;
+        bool       m_uiWasActive = false;
     };
 }
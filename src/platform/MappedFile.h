@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common/Common.h"
+
+#include <span>
+
+namespace chisel
+{
+    /**
+     * Read-only memory mapping of a whole file.
+     * The mapping stays valid until Close() or destruction.
+     */
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { Close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Implemented per platform.
+        bool Open(const char* path);
+        void Close();
+
+        bool IsOpen() const { return m_data != nullptr; }
+
+        std::span<const byte> Data() const { return { m_data, m_size }; }
+        size_t Size() const { return m_size; }
+
+    private:
+        const byte* m_data = nullptr;
+        size_t m_size = 0;
+    };
+}
@@ -1,9 +1,14 @@
 
 #include "platform/Platform.h"
+#include "platform/MappedFile.h"
 #include "common/String.h"
 #include "console/Console.h"
 
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <string>
 #include <sstream>
 
@@ -88,4 +93,40 @@ namespace chisel
         // Truncate to first null
         return std::string(filename.data());
     }
+
+    bool MappedFile::Open(const char* path)
+    {
+        Close();
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        // The mapping holds its own reference to the file.
+        void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+            return false;
+
+        m_data = (const byte*)data;
+        m_size = size_t(st.st_size);
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data)
+            munmap((void*)m_data, m_size);
+
+        m_data = nullptr;
+        m_size = 0;
+    }
 }
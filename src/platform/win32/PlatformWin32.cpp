@@ -1,5 +1,6 @@
 
 #include "platform/Platform.h"
+#include "platform/MappedFile.h"
 #include <filesystem>
 #include <string>
 #include <codecvt>
@@ -156,4 +157,45 @@ namespace chisel
         }
         return std::string();
     }
-}
\ No newline at end of file
+
+    bool MappedFile::Open(const char* path)
+    {
+        Close();
+
+        std::wstring wpath = std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(path);
+        HANDLE file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+
+        // The view keeps the mapping alive.
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!data)
+            return false;
+
+        m_data = (const byte*)data;
+        m_size = size_t(size.QuadPart);
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
@@ -13,6 +13,49 @@
 namespace chisel::render
 {
     static ConVar<bool> r_vsync("r_vsync", true, "Enable/disable vsync");
+    static ConVar<bool> r_stats("r_stats", false, "Count draw calls, uploads and state changes, and show them over the viewports");
+
+    size_t Texture::GetMemoryUsage() const
+    {
+        if (!texture)
+            return 0;
+
+        D3D11_TEXTURE2D_DESC desc;
+        texture->GetDesc(&desc);
+
+        const auto [blockWidth, blockHeight] = GetBlockSize(desc.Format);
+        const size_t elementSize = GetElementSize(desc.Format);
+
+        size_t size = 0;
+        for (uint mip = 0; mip < desc.MipLevels; mip++)
+        {
+            uint width  = std::max(desc.Width >> mip, 1u);
+            uint height = std::max(desc.Height >> mip, 1u);
+            size += size_t((width + blockWidth - 1) / blockWidth) * ((height + blockHeight - 1) / blockHeight) * elementSize;
+        }
+        return size * desc.ArraySize;
+    }
+
+    std::string RenderStats::ToString() const
+    {
+        return fmt::format(
+            "Draw calls:      {}\n"
+            "Vertices:        {}\n"
+            "Triangles:       {}\n"
+            "CB uploads:      {} ({:.1f} KB)\n"
+            "Shader changes:  {}\n"
+            "State changes:   {}\n"
+            "Brush uploads:   {:.1f} KB\n"
+            "Elided binds:    {}\n"
+            "Brushes:         {} ({} meshes)\n"
+            "Point entities:  {}",
+            drawCalls, vertices, triangles,
+            cbufferUploads, cbufferBytes / 1024.0,
+            shaderChanges, stateChanges,
+            brushBytes / 1024.0,
+            elidedCalls,
+            brushes, brushMeshes, pointEntities);
+    }
 
     void RenderContext::Init(Window* window)
     {
@@ -98,6 +141,18 @@ namespace chisel::render
         cbuffers.object = CreateCBuffer<cbuffers::ObjectState>();
         cbuffers.brush  = CreateCBuffer<cbuffers::BrushState>();
 
+        // Constant buffer ring, if the driver can bind at offsets and map constant buffers without discarding
+        D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+        device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+        if (options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer)
+        {
+            CreateConstBufferRing(ConstBufferRing::InitialSize);
+        }
+        else
+        {
+            Console.Warn("[D3D11] No constant buffer offsetting, using a buffer per upload.");
+        }
+
         // Global blend states
         CreateBlendState(BlendFuncs::Normal);
         CreateBlendState(BlendFuncs::Add);
@@ -202,8 +257,23 @@ namespace chisel::render
 
     void RenderContext::BeginFrame()
     {
+        lastStats = stats;
+        stats = RenderStats();
+        countStats = r_stats;
+
+        // Anything could have been bound since the last frame
+        InvalidateState();
+
+        // Grow the ring if it ran out last frame
+        if (cbufferRing.full && cbufferRing.size < (1u << 30))
+            CreateConstBufferRing(cbufferRing.size * 2);
+        cbufferRing.full = false;
+
+        // The next upload discards the ring, the GPU may still be reading last frame's constants
+        cbufferRing.offset = 0;
+
         // Bind the backbuffer
-        ctx->OMSetRenderTargets(1, &backbuffer.rtv, nullptr);
+        SetRenderTargets(1, &backbuffer.rtv, nullptr);
 
         uint2 size = backbuffer.GetSize();
         D3D11_VIEWPORT viewport =
@@ -225,7 +295,7 @@ namespace chisel::render
     void RenderContext::EndFrame()
     {
         // Bind the backbuffer
-        ctx->OMSetRenderTargets(1, &backbuffer.rtv, nullptr);
+        SetRenderTargets(1, &backbuffer.rtv, nullptr);
 
         uint2 size = backbuffer.GetSize();
         D3D11_VIEWPORT viewport =
@@ -242,6 +312,7 @@ namespace chisel::render
         // Update ImGui
         ImGui::Render();
         ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+        InvalidateState();
 
         // Present
         swapchain->Present(r_vsync, 0);
@@ -360,6 +431,9 @@ namespace chisel::render
     void RenderContext::SetBlendState(const BlendState& state, vec4 factor, uint32 sampleMask)
     {
         CreateBlendState(state);
+        if (!Changed(m_bound.blend, BlendBinding{ state.handle.ptr(), factor, sampleMask }))
+            return;
+        CountStat(&RenderStats::stateChanges);
         ctx->OMSetBlendState(state.handle.ptr(), &factor.x, sampleMask);
     }
 
@@ -503,13 +577,110 @@ namespace chisel::render
         return buffer;
     }
 
+    bool RenderContext::CreateConstBufferRing(uint size)
+    {
+        D3D11_BUFFER_DESC ringDesc = {
+            .ByteWidth      = size,
+            .Usage          = D3D11_USAGE_DYNAMIC,
+            .BindFlags      = D3D11_BIND_CONSTANT_BUFFER,
+            .CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
+        };
+
+        Com<ID3D11Buffer> buffer;
+        if (FAILED(device->CreateBuffer(&ringDesc, nullptr, &buffer)))
+        {
+            Console.Error("[D3D11] Failed to create a {} KB constant buffer ring.", size / 1024);
+            return false;
+        }
+
+        cbufferRing.buffer = buffer;
+        cbufferRing.size   = size;
+        cbufferRing.offset = 0;
+        return true;
+    }
+
+    bool RenderContext::AppendConstants(const void* data, uint size, uint& firstConstant)
+    {
+        const uint aligned = (size + ConstBufferRing::Alignment - 1) & ~(ConstBufferRing::Alignment - 1);
+        if (cbufferRing.offset + aligned > cbufferRing.size)
+        {
+            // Discarding leaves whatever earlier draws bound from the ring undefined,
+            // and later draws may still use those bindings. Upload them again first.
+            cbufferRing.offset = 0;
+            cbufferRing.full = true;
+            RebindRingConstants();
+        }
+
+        // Draws already recorded keep the old contents when it's discarded
+        D3D11_MAP mapType = cbufferRing.offset == 0 ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        HRESULT hr = ctx->Map(cbufferRing.buffer.ptr(), 0, mapType, 0, &mapped);
+        if (FAILED(hr))
+        {
+            if (!m_skipDraws)
+                Console.Error("[D3D11] Failed to map the constant buffer ring, skipping draws until it maps again.");
+            m_skipDraws = true;
+            return false;
+        }
+        m_skipDraws = false;
+
+        memcpy((uint8*)mapped.pData + cbufferRing.offset, data, size);
+        ctx->Unmap(cbufferRing.buffer.ptr(), 0);
+
+        firstConstant = cbufferRing.offset / 16;
+        cbufferRing.offset += aligned;
+        return true;
+    }
+
+    void RenderContext::KeepRingConstants(int index, ShaderStages flags, const void* data, uint size, uint numConstants)
+    {
+        if (uint(index) >= MaxConstBuffers)
+            return;
+
+        auto keep = [&](RingConstants& kept)
+        {
+            kept.data.assign((const uint8*)data, (const uint8*)data + size);
+            kept.numConstants = numConstants;
+        };
+
+        if (flags & VertexShader)
+            keep(m_ringVS[index]);
+        if (flags & PixelShader)
+            keep(m_ringPS[index]);
+    }
+
+    void RenderContext::RebindRingConstants()
+    {
+        auto rebind = [&](uint index, ShaderStages stage, BoundSlot<ConstBufferBinding>& bound, const RingConstants& kept)
+        {
+            if (!bound.known || bound.value.buffer != cbufferRing.buffer.ptr())
+                return;
+
+            uint firstConstant;
+            if (kept.data.empty() || !AppendConstants(kept.data.data(), uint(kept.data.size()), firstConstant))
+            {
+                bound.known = false;
+                return;
+            }
+            SetConstBuffer(index, cbufferRing.buffer, stage, firstConstant, kept.numConstants);
+        };
+
+        for (uint i = 0; i < MaxConstBuffers; i++)
+        {
+            rebind(i, VertexShader, m_bound.vsCBuffers[i], m_ringVS[i]);
+            rebind(i, PixelShader, m_bound.psCBuffers[i], m_ringPS[i]);
+        }
+    }
+
     //--------------------------------------------------
     //  DrawMesh
     //--------------------------------------------------
 
-    void RenderContext::DrawMesh(Mesh* mesh)
+    void RenderContext::DrawMesh(Mesh* mesh, uint instanceCount, uint startInstance)
     {
         assert(mesh->uploaded);
+        const bool instanced = instanceCount != 1 || startInstance != 0;
         int i = 0;
         for (const Mesh::Group& group : mesh->groups)
         {
@@ -518,26 +689,30 @@ namespace chisel::render
                 // TODO: Consistent material binding mechanism for all materials
                 // e.g. r.Bind(material)
 
-                Rc<Material> material = mesh->materials[group.material];
+                Material* material = mesh->materials[group.material].ptr();
                 ID3D11ShaderResourceView *srv = nullptr;
 
                 // Bind $basetexture
                 if (material->baseTexture != nullptr)
                     srv = material->baseTexture->srvSRGB.ptr();
                 
-                ctx->PSSetShaderResources(0, 1, &srv);
+                SetShaderResource(0, srv);
             }
 
-            uint strides[] = {(uint)group.vertices.Stride()};
-            uint offsets[] = {0};
-            ctx->IASetVertexBuffers(0, 1, (ID3D11Buffer**)&group.vertices.handle, strides, offsets);
+            SetVertexBuffer((ID3D11Buffer*)group.vertices.handle, (uint)group.vertices.Stride());
             
             const IndexBuffer& indices = group.indices;
             if (indices.handle != nullptr) {
-                ctx->IASetIndexBuffer((ID3D11Buffer*)indices.handle, indices.type == indices.UInt32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
-                ctx->DrawIndexed(indices.count, 0, 0);
+                SetIndexBuffer((ID3D11Buffer*)indices.handle, indices.type == indices.UInt32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT);
+                if (instanced)
+                    DrawIndexedInstanced(indices.count, instanceCount, 0, 0, startInstance);
+                else
+                    DrawIndexed(indices.count, 0, 0);
             } else {
-                ctx->Draw(group.vertices.count, 0);
+                if (instanced)
+                    DrawInstanced(group.vertices.count, instanceCount, 0, startInstance);
+                else
+                    Draw(group.vertices.count, 0);
             }
         }
     }
@@ -610,14 +785,41 @@ namespace chisel::render
     //  Shader
     //--------------------------------------------------
 
+    void RenderContext::CountPrimitives(uint count)
+    {
+        D3D11_PRIMITIVE_TOPOLOGY topology = m_bound.topology.value;
+        if (!m_bound.topology.known)
+            ctx->IAGetPrimitiveTopology(&topology);
+
+        stats.drawCalls++;
+        stats.vertices += count;
+        if (topology == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+            stats.triangles += count / 3;
+        else if (topology == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP && count >= 3)
+            stats.triangles += count - 2;
+    }
+
     void RenderContext::SetShader(const Shader& shader)
     {
-        if (shader.inputLayout != nullptr)
+        bool changed = false;
+        if (shader.inputLayout != nullptr && Changed(m_bound.inputLayout, shader.inputLayout.ptr()))
+        {
             ctx->IASetInputLayout(shader.inputLayout.ptr());
-        if (shader.vs != nullptr)
+            changed = true;
+        }
+        if (shader.vs != nullptr && Changed(m_bound.vs, shader.vs.ptr()))
+        {
             ctx->VSSetShader(shader.vs.ptr(), nullptr, 0);
-        if (shader.ps != nullptr)
+            changed = true;
+        }
+        if (shader.ps != nullptr && Changed(m_bound.ps, shader.ps.ptr()))
+        {
             ctx->PSSetShader(shader.ps.ptr(), nullptr, 0);
+            changed = true;
+        }
+
+        if (changed)
+            CountStat(&RenderStats::shaderChanges);
     }
 
     Shader::Shader(ID3D11Device1* device, Span<D3D11_INPUT_ELEMENT_DESC const> ia, std::string_view name)
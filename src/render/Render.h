@@ -8,6 +8,7 @@
 #include "core/Mesh.h"
 
 #include <functional>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -24,13 +25,25 @@ namespace chisel
         Com<ID3D11ShaderResourceView> srvLinear;
         Com<ID3D11ShaderResourceView> srvSRGB;
 
+        // Set for textures whose mips are streamed, see TextureStreamer.
+        uint8 mipCount    = 0;          // Mips in the source file
+        uint8 residentMip = 0;          // Most detailed mip on the GPU
+        uint2 fullSize    = uint2(0);   // Size of mip 0, resident or not
+
         operator bool() const { return texture != nullptr; }
+
+        // Full size, even while only the smaller mips are resident.
         virtual uint2 GetSize()
         {
+            if (mipCount)
+                return fullSize;
+
             D3D11_TEXTURE2D_DESC desc;
             texture->GetDesc(&desc);
             return uint2(desc.Width, desc.Height);
         }
+
+        size_t GetMemoryUsage() const override;
     };
 
     struct Material : Asset
@@ -113,6 +126,86 @@ namespace chisel::render
         Com<ID3D11Buffer> brush;
     };
 
+    // Per frame counters, only kept while r_stats is on.
+    struct RenderStats
+    {
+        uint   drawCalls      = 0;
+        uint64 vertices       = 0;
+        uint64 triangles      = 0;
+        uint   cbufferUploads = 0;
+        uint64 cbufferBytes   = 0;
+        uint   shaderChanges  = 0;
+        uint   stateChanges   = 0;  // Blend, depth stencil, raster and sampler states
+        uint64 brushBytes     = 0;  // Written to the BrushGPUAllocator
+        uint   elidedCalls    = 0;  // Binds skipped because the same thing was already bound
+
+        // Counted by MapRender
+        uint   brushes        = 0;
+        uint   brushMeshes    = 0;
+        uint   pointEntities  = 0;
+
+        // One counter per line, for the overlay and the console
+        std::string ToString() const;
+    };
+
+    // Last value given to a D3D11 setter, so setting it again can be skipped.
+    // Unknown until first set, and again after RenderContext::InvalidateState().
+    template <typename T>
+    struct BoundSlot
+    {
+        T    value = {};
+        bool known = false;
+
+        // True if it's different and has to be set
+        bool Update(const T& newValue)
+        {
+            if (known && value == newValue)
+                return false;
+            value = newValue;
+            known = true;
+            return true;
+        }
+    };
+
+    struct VertexBufferBinding
+    {
+        ID3D11Buffer* buffer;
+        uint stride;
+        uint offset;
+        bool operator==(const VertexBufferBinding&) const = default;
+    };
+
+    struct IndexBufferBinding
+    {
+        ID3D11Buffer* buffer;
+        DXGI_FORMAT format;
+        uint offset;
+        bool operator==(const IndexBufferBinding&) const = default;
+    };
+
+    struct DepthStencilBinding
+    {
+        ID3D11DepthStencilState* state;
+        uint stencilRef;
+        bool operator==(const DepthStencilBinding&) const = default;
+    };
+
+    struct ConstBufferBinding
+    {
+        ID3D11Buffer* buffer;
+        uint firstConstant;
+        uint numConstants;
+        bool operator==(const ConstBufferBinding&) const = default;
+    };
+
+    struct BlendBinding
+    {
+        ID3D11BlendState* state;
+        vec4 factor;
+        uint32 sampleMask;
+        bool operator==(const BlendBinding&) const = default;
+    };
+
     struct RenderContext
     {
         void Init(Window* window);
@@ -129,11 +222,80 @@ namespace chisel::render
 
         void SetShader(const Shader& shader);
 
+        // Pixel shader resources
+        void SetShaderResource(uint slot, ID3D11ShaderResourceView* srv)
+        {
+            if (slot >= MaxShaderResources || Changed(m_bound.srvs[slot], srv))
+                ctx->PSSetShaderResources(slot, 1, &srv);
+        }
+
+        // Slot 1 is for per instance data
+        void SetVertexBuffer(ID3D11Buffer* buffer, uint stride, uint offset = 0, uint slot = 0)
+        {
+            if (slot >= MaxVertexBuffers || Changed(m_bound.vertexBuffers[slot], VertexBufferBinding{ buffer, stride, offset }))
+                ctx->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+        }
+
+        void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, uint offset = 0)
+        {
+            if (Changed(m_bound.indexBuffer, IndexBufferBinding{ buffer, format, offset }))
+                ctx->IASetIndexBuffer(buffer, format, offset);
+        }
+
+        void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+        {
+            if (Changed(m_bound.topology, topology))
+                ctx->IASetPrimitiveTopology(topology);
+        }
+
+        // Binding a texture as output unbinds it as a shader resource, so those are forgotten.
+        void SetRenderTargets(uint count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+        {
+            ctx->OMSetRenderTargets(count, rtvs, dsv);
+            for (auto& srv : m_bound.srvs)
+                srv.known = false;
+        }
+
+        // Call after anything outside RenderContext (ImGui, compute passes)
+        // has set state on the context directly.
+        void InvalidateState() { m_bound = BoundState(); }
 
         // Compatability with existing Mesh class
-        void DrawMesh(Mesh* mesh);
+        void DrawMesh(Mesh* mesh, uint instanceCount = 1, uint startInstance = 0);
         void UploadMesh(Mesh* mesh);
 
+        void Draw(uint vertexCount, uint startVertex = 0)
+        {
+            if (m_skipDraws) [[unlikely]]
+                return;
+            CountDraw(vertexCount);
+            ctx->Draw(vertexCount, startVertex);
+        }
+
+        void DrawIndexed(uint indexCount, uint startIndex = 0, int baseVertex = 0)
+        {
+            if (m_skipDraws) [[unlikely]]
+                return;
+            CountDraw(indexCount);
+            ctx->DrawIndexed(indexCount, startIndex, baseVertex);
+        }
+
+        void DrawInstanced(uint vertexCount, uint instanceCount, uint startVertex = 0, uint startInstance = 0)
+        {
+            if (m_skipDraws) [[unlikely]]
+                return;
+            CountDraw(vertexCount * instanceCount);
+            ctx->DrawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+        }
+
+        void DrawIndexedInstanced(uint indexCount, uint instanceCount, uint startIndex = 0, int baseVertex = 0, uint startInstance = 0)
+        {
+            if (m_skipDraws) [[unlikely]]
+                return;
+            CountDraw(indexCount * instanceCount);
+            ctx->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+        }
+
         template <class T>
         ComputeShaderBuffer CreateCSOutputBuffer() { return CreateCSOutputBuffer(uint(sizeof(T))); }
         ComputeShaderBuffer CreateCSOutputBuffer(uint);
@@ -177,19 +339,75 @@ namespace chisel::render
 
         GlobalCBuffers cbuffers;
 
-        void SetConstBuffer(int index, const Com<ID3D11Buffer>& buf, ShaderStages flags = VertexShader | PixelShader)
+        // Per draw constants are appended to one big buffer and bound at an offset,
+        // instead of renaming a small buffer with WRITE_DISCARD for every draw.
+        // Starts over with a DISCARD every frame, or when it fills up. Filling up
+        // loses what was bound from it, so it's made twice as big for the next frame.
+        // Needs D3D11.1 constant buffer offsetting, without it 'buffer' stays null
+        // and the GlobalCBuffers are used.
+        struct ConstBufferRing
+        {
+            static constexpr uint InitialSize = 4 * 1024 * 1024;
+            static constexpr uint Alignment   = 256;  // Offsets are in multiples of 16 constants
+
+            Com<ID3D11Buffer> buffer;
+            uint size   = InitialSize;
+            uint offset = 0;
+            bool full   = false;
+        } cbufferRing;
+
+        // numConstants 0 binds the whole buffer
+        void SetConstBuffer(int index, const Com<ID3D11Buffer>& buf, ShaderStages flags = VertexShader | PixelShader, uint firstConstant = 0, uint numConstants = 0)
         {
-            if (flags & VertexShader) ctx->VSSetConstantBuffers1(index, 1, &buf, nullptr, nullptr);
-            if (flags & PixelShader) ctx->PSSetConstantBuffers1(index, 1, &buf, nullptr, nullptr);
+            const ConstBufferBinding binding = { buf.ptr(), firstConstant, numConstants };
+            const uint* first = numConstants ? &firstConstant : nullptr;
+            const uint* count = numConstants ? &numConstants : nullptr;
+
+            if ((flags & VertexShader) && (uint(index) >= MaxConstBuffers || Changed(m_bound.vsCBuffers[index], binding)))
+                ctx->VSSetConstantBuffers1(index, 1, &buf, first, count);
+            if ((flags & PixelShader) && (uint(index) >= MaxConstBuffers || Changed(m_bound.psCBuffers[index], binding)))
+                ctx->PSSetConstantBuffers1(index, 1, &buf, first, count);
         }
 
+        // For constants uploaded right before the draws that use them.
+        // 'buf' is only written to when there's no cbufferRing.
         template <typename T>
         void UploadConstBuffer(int index, const Com<ID3D11Buffer>& buf, const T& data, ShaderStages flags = VertexShader | PixelShader)
         {
+            if (cbufferRing.buffer != nullptr) [[likely]]
+            {
+                CountStat(&RenderStats::cbufferUploads);
+                CountStat(&RenderStats::cbufferBytes, sizeof(T));
+
+                static constexpr uint NumConstants = ((sizeof(T) + ConstBufferRing::Alignment - 1) / ConstBufferRing::Alignment) * (ConstBufferRing::Alignment / 16);
+                uint firstConstant;
+                if (!AppendConstants(&data, sizeof(T), firstConstant)) [[unlikely]]
+                    return;
+                SetConstBuffer(index, cbufferRing.buffer, flags, firstConstant, NumConstants);
+                KeepRingConstants(index, flags, &data, sizeof(T), NumConstants);
+                return;
+            }
+
+            UploadConstBufferDirect(index, buf, data, flags);
+        }
+
+        // Always writes 'buf' itself. For constants that stay bound across
+        // many draws, like the camera, so the ring never has to carry them.
+        template <typename T>
+        void UploadConstBufferDirect(int index, const Com<ID3D11Buffer>& buf, const T& data, ShaderStages flags = VertexShader | PixelShader)
+        {
+            CountStat(&RenderStats::cbufferUploads);
+            CountStat(&RenderStats::cbufferBytes, sizeof(T));
+
             UpdateDynamicBuffer(buf.ptr(), &data, sizeof(T));
             SetConstBuffer(index, buf, flags);
         }
 
+        // Copies into cbufferRing and gives the offset in constants. If that fails,
+        // draws are skipped until constants upload again.
+        bool AppendConstants(const void* data, uint size, uint& firstConstant);
+        bool CreateConstBufferRing(uint size);
+
         //-----------------------------------------------------------------------------
 
         struct DepthStates {
@@ -200,6 +418,9 @@ namespace chisel::render
         } Depth;
 
         void SetDepthStencilState(const Com<ID3D11DepthStencilState>& dss, uint stencilRef = 0) {
+            if (!Changed(m_bound.depth, DepthStencilBinding{ dss.ptr(), stencilRef }))
+                return;
+            CountStat(&RenderStats::stateChanges);
             ctx->OMSetDepthStencilState(dss.ptr(), stencilRef);
         }
 
@@ -211,6 +432,9 @@ namespace chisel::render
         } Sample;
 
         void SetSampler(int slot, const Com<ID3D11SamplerState>& ss) {
+            if (uint(slot) < MaxSamplers && !Changed(m_bound.samplers[slot], ss.ptr()))
+                return;
+            CountStat(&RenderStats::stateChanges);
             ctx->PSSetSamplers(slot, 1, &ss);
         }
 
@@ -224,7 +448,80 @@ namespace chisel::render
         } Raster;
 
         void SetRasterState(const Com<ID3D11RasterizerState>& rs) {
+            if (!Changed(m_bound.raster, rs.ptr()))
+                return;
+            CountStat(&RenderStats::stateChanges);
             ctx->RSSetState(rs.ptr());
         }
+
+        //-----------------------------------------------------------------------------
+
+        bool        countStats = false;     // r_stats, latched at BeginFrame
+        RenderStats stats;                  // Frame being drawn
+        RenderStats lastStats;              // Last finished frame
+
+        template <typename T>
+        void CountStat(T RenderStats::* counter, uint64 amount = 1)
+        {
+            if (countStats) [[unlikely]]
+                stats.*counter += T(amount);
+        }
+
+    private:
+        static constexpr uint MaxShaderResources = 8;
+        static constexpr uint MaxSamplers        = 4;
+        static constexpr uint MaxConstBuffers    = 4;
+        static constexpr uint MaxVertexBuffers   = 2;
+
+        // What this context last bound, see BoundSlot
+        struct BoundState
+        {
+            BoundSlot<ID3D11InputLayout*>         inputLayout;
+            BoundSlot<ID3D11VertexShader*>        vs;
+            BoundSlot<ID3D11PixelShader*>         ps;
+            BoundSlot<ID3D11ShaderResourceView*>  srvs[MaxShaderResources];
+            BoundSlot<ID3D11SamplerState*>        samplers[MaxSamplers];
+            BoundSlot<ConstBufferBinding>         vsCBuffers[MaxConstBuffers];
+            BoundSlot<ConstBufferBinding>         psCBuffers[MaxConstBuffers];
+            BoundSlot<ID3D11RasterizerState*>     raster;
+            BoundSlot<DepthStencilBinding>        depth;
+            BoundSlot<BlendBinding>               blend;
+            BoundSlot<VertexBufferBinding>        vertexBuffers[MaxVertexBuffers];
+            BoundSlot<IndexBufferBinding>         indexBuffer;
+            BoundSlot<D3D11_PRIMITIVE_TOPOLOGY>   topology;
+        } m_bound;
+
+        // The constants each slot was last given from cbufferRing. When the ring
+        // starts over mid-frame, slots still bound to it get theirs back.
+        struct RingConstants
+        {
+            std::vector<uint8> data;
+            uint numConstants = 0;
+        };
+        RingConstants m_ringVS[MaxConstBuffers];
+        RingConstants m_ringPS[MaxConstBuffers];
+
+        // Their constants failed to upload
+        bool m_skipDraws = false;
+
+        void KeepRingConstants(int index, ShaderStages flags, const void* data, uint size, uint numConstants);
+        void RebindRingConstants();
+
+        template <typename T>
+        bool Changed(BoundSlot<T>& slot, const T& value)
+        {
+            if (slot.Update(value))
+                return true;
+            CountStat(&RenderStats::elidedCalls);
+            return false;
+        }
+
+        void CountDraw(uint count)
+        {
+            if (countStats) [[unlikely]]
+                CountPrimitives(count);
+        }
+
+        void CountPrimitives(uint count);
     };
 }
@@ -83,6 +83,7 @@ namespace chisel
         case DXGI_FORMAT_R32_FLOAT:
             return 4;
         case DXGI_FORMAT_R32G32_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
         case DXGI_FORMAT_BC1_UNORM_SRGB:
         case DXGI_FORMAT_BC1_UNORM:
         case DXGI_FORMAT_BC1_TYPELESS: